@@ -294,6 +294,33 @@ int mp_audio_make_writeable(struct mp_audio *data)
     return 0;
 }
 
+// Return a new frame referencing the same data. Non-refcounted frames are
+// copied. Returns NULL on error.
+struct mp_audio *mp_audio_new_ref(struct mp_audio *frame)
+{
+    struct mp_audio *new = talloc(NULL, struct mp_audio);
+    *new = *frame;
+    mp_audio_set_null_data(new);
+    talloc_set_destructor(new, mp_audio_destructor);
+    if (!frame->allocated[0]) {
+        mp_audio_realloc(new, frame->samples);
+        new->samples = frame->samples;
+        mp_audio_copy(new, 0, frame, 0, frame->samples);
+        return new;
+    }
+    for (int n = 0; n < MP_NUM_CHANNELS && frame->allocated[n]; n++) {
+        new->allocated[n] = av_buffer_ref(frame->allocated[n]);
+        if (!new->allocated[n]) {
+            talloc_free(new);
+            return NULL;
+        }
+    }
+    for (int n = 0; n < frame->num_planes; n++)
+        new->planes[n] = frame->planes[n];
+    new->samples = frame->samples;
+    return new;
+}
+
 struct mp_audio *mp_audio_from_avframe(struct AVFrame *avframe)
 {
     AVFrame *tmp = NULL;
@@ -74,6 +74,7 @@ void mp_audio_skip_samples(struct mp_audio *data, int samples);
 
 bool mp_audio_is_writeable(struct mp_audio *data);
 int mp_audio_make_writeable(struct mp_audio *data);
+struct mp_audio *mp_audio_new_ref(struct mp_audio *frame);
 
 struct AVFrame;
 struct mp_audio *mp_audio_from_avframe(struct AVFrame *avframe);
@@ -0,0 +1,148 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "common/common.h"
+#include "osdep/atomics.h"
+
+#include "audio_ring.h"
+#include "audio.h"
+
+struct mp_audio_ring {
+    int num_planes;
+    int sstride;
+    int size;
+    uint8_t *planes[MP_NUM_CHANNELS];
+
+    // Linear copy of wrapped data for mp_audio_ring_peek(). Consumer only.
+    uint8_t *scratch[MP_NUM_CHANNELS];
+
+    // Total number of samples written/read since the last reset. wpos is
+    // changed by the producer only, rpos by the consumer only. The data is
+    // copied before the position is updated.
+    atomic_ullong wpos, rpos;
+};
+
+struct mp_audio_ring *mp_audio_ring_create(void *ta_parent, int num_planes,
+                                           int sstride, int size)
+{
+    assert(num_planes >= 1 && num_planes <= MP_NUM_CHANNELS);
+    assert(size > 0);
+    struct mp_audio_ring *r = talloc_zero(ta_parent, struct mp_audio_ring);
+    r->num_planes = num_planes;
+    r->sstride = sstride;
+    r->size = size;
+    for (int n = 0; n < num_planes; n++)
+        r->planes[n] = talloc_size(r, size * sstride);
+    atomic_store(&r->wpos, 0);
+    atomic_store(&r->rpos, 0);
+    return r;
+}
+
+int mp_audio_ring_size(struct mp_audio_ring *r)
+{
+    return r->size;
+}
+
+int mp_audio_ring_buffered(struct mp_audio_ring *r)
+{
+    // Load rpos first, so that the result can't become negative. A stale
+    // rpos only makes the producer see less free space.
+    unsigned long long rpos = atomic_load(&r->rpos);
+    return atomic_load(&r->wpos) - rpos;
+}
+
+int mp_audio_ring_available(struct mp_audio_ring *r)
+{
+    return r->size - mp_audio_ring_buffered(r);
+}
+
+int mp_audio_ring_write(struct mp_audio_ring *r, void **data, int samples)
+{
+    int available = mp_audio_ring_available(r);
+    samples = MPMIN(samples, available);
+    if (samples <= 0)
+        return 0;
+    int pos = atomic_load(&r->wpos) % r->size;
+    int len1 = MPMIN(r->size - pos, samples);
+    int len2 = samples - len1;
+    for (int n = 0; n < r->num_planes; n++) {
+        uint8_t *src = data[n];
+        memcpy(r->planes[n] + pos * r->sstride, src, len1 * r->sstride);
+        memcpy(r->planes[n], src + len1 * r->sstride, len2 * r->sstride);
+    }
+    atomic_fetch_add(&r->wpos, samples);
+    return samples;
+}
+
+int mp_audio_ring_read(struct mp_audio_ring *r, void **data, int samples)
+{
+    int buffered = mp_audio_ring_buffered(r);
+    samples = MPMIN(samples, buffered);
+    if (samples <= 0)
+        return 0;
+    if (data) {
+        int pos = atomic_load(&r->rpos) % r->size;
+        int len1 = MPMIN(r->size - pos, samples);
+        int len2 = samples - len1;
+        for (int n = 0; n < r->num_planes; n++) {
+            uint8_t *dst = data[n];
+            memcpy(dst, r->planes[n] + pos * r->sstride, len1 * r->sstride);
+            memcpy(dst + len1 * r->sstride, r->planes[n], len2 * r->sstride);
+        }
+    }
+    atomic_fetch_add(&r->rpos, samples);
+    return samples;
+}
+
+int mp_audio_ring_peek(struct mp_audio_ring *r, void **planes, int samples)
+{
+    int buffered = mp_audio_ring_buffered(r);
+    samples = MPMAX(0, MPMIN(samples, buffered));
+    int pos = atomic_load(&r->rpos) % r->size;
+    if (pos + samples <= r->size) {
+        for (int n = 0; n < r->num_planes; n++)
+            planes[n] = r->planes[n] + pos * r->sstride;
+        return samples;
+    }
+    int len1 = r->size - pos;
+    int len2 = samples - len1;
+    for (int n = 0; n < r->num_planes; n++) {
+        if (!r->scratch[n])
+            r->scratch[n] = talloc_size(r, r->size * r->sstride);
+        memcpy(r->scratch[n], r->planes[n] + pos * r->sstride,
+               len1 * r->sstride);
+        memcpy(r->scratch[n] + len1 * r->sstride, r->planes[n],
+               len2 * r->sstride);
+        planes[n] = r->scratch[n];
+    }
+    return samples;
+}
+
+void mp_audio_ring_skip(struct mp_audio_ring *r, int samples)
+{
+    mp_audio_ring_read(r, NULL, samples);
+}
+
+void mp_audio_ring_reset(struct mp_audio_ring *r)
+{
+    atomic_store(&r->wpos, 0);
+    atomic_store(&r->rpos, 0);
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AUDIO_RING_H
+#define MP_AUDIO_RING_H
+
+// Lock-free SPSC (single producer, single consumer) ringbuffer for audio with
+// any number of planes. Unlike using one misc/ring.h ring per plane, the
+// read and write positions are shared by all planes, so the reader always
+// sees the same amount of data on every plane.
+//
+// mp_audio_ring_write() may be called by the producer thread only, while
+// mp_audio_ring_read/peek/skip() may be called by the consumer thread only.
+// The other functions can be called from any thread, except reset.
+struct mp_audio_ring;
+
+// size is the capacity in samples, sstride the size of a sample on each
+// plane in bytes.
+struct mp_audio_ring *mp_audio_ring_create(void *ta_parent, int num_planes,
+                                           int sstride, int size);
+
+// Producer: append up to samples samples. Returns the number of samples
+// written, which is less than requested if the ring is full.
+int mp_audio_ring_write(struct mp_audio_ring *r, void **data, int samples);
+
+// Consumer: copy up to samples samples to data and remove them. If data is
+// NULL, the samples are only removed. Returns the number of samples read.
+int mp_audio_ring_read(struct mp_audio_ring *r, void **data, int samples);
+
+// Consumer: set planes[] to up to samples buffered samples without removing
+// them. Returns the number of samples. The pointers point into the ring, or
+// to an internal copy if the data wraps around. They are valid until the
+// next read/peek/skip/reset call.
+int mp_audio_ring_peek(struct mp_audio_ring *r, void **planes, int samples);
+
+// Consumer: remove samples returned by mp_audio_ring_peek().
+void mp_audio_ring_skip(struct mp_audio_ring *r, int samples);
+
+// Drop all data. Must not be called concurrently with the producer or the
+// consumer.
+void mp_audio_ring_reset(struct mp_audio_ring *r);
+
+int mp_audio_ring_size(struct mp_audio_ring *r);
+int mp_audio_ring_buffered(struct mp_audio_ring *r);
+int mp_audio_ring_available(struct mp_audio_ring *r);
+
+#endif
@@ -17,8 +17,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/mem.h>
 
@@ -27,6 +29,7 @@
 #include "common/codecs.h"
 #include "common/msg.h"
 #include "misc/bstr.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
@@ -50,6 +53,37 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+/* Decoder thread (--audio-decode-ahead).
+ *
+ * The thread decodes and filters audio into a queue of up to max_secs
+ * seconds, and audio_decode() takes the data from there. The decoder and the
+ * filter chain are also used by the player directly (mixer, speed changes,
+ * reinit, seeks). Instead of locking each of these, the player stops the
+ * thread with audio_pause_thread() for the time it uses them. The thread
+ * decodes about 1 frame at a time, so pausing never takes long.
+ *
+ * lock protects all fields except decoded, which is owned by the thread while
+ * decoding is set, and by the pausing thread otherwise.
+ */
+struct dec_audio_thread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool quit;
+
+    int pause_count;            // number of audio_pause_thread() calls
+    bool decoding;              // thread is using the decoder
+    struct mp_audio_buffer *queue;
+    struct mp_audio_buffer *decoded;
+    double max_secs;
+    int status;                 // AD_* result that stopped the thread
+    int last_status;            // result of the last decode call
+    double pts;                 // audio_get_pts() at the end of the queue
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+};
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
     audio_reset_decoding(d_audio);
@@ -152,18 +186,87 @@ int audio_init_best_codec(struct dec_audio *d_audio)
     return !!d_audio->ad_driver;
 }
 
+struct dec_audio_frame {
+    struct mp_audio *frame;
+    // d_audio->pts/pts_offset right after the frame was decoded
+    double pts;
+    int pts_offset;
+};
+
+static void free_frames(struct dec_audio_frame *frames, int *num_frames)
+{
+    for (int n = 0; n < *num_frames; n++)
+        talloc_free(frames[n].frame);
+    *num_frames = 0;
+}
+
+// Presentation time of the end/start of the frame.
+static double frame_end(struct dec_audio_frame *f)
+{
+    return f->pts + f->pts_offset / (double)f->frame->rate;
+}
+
+static double frame_start(struct dec_audio_frame *f)
+{
+    return frame_end(f) - f->frame->samples / (double)f->frame->rate;
+}
+
+static void stop_thread(struct dec_audio *d_audio);
+
 void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    stop_thread(d_audio);
     MP_VERBOSE(d_audio, "Uninit audio filters...\n");
     uninit_decoder(d_audio);
     af_destroy(d_audio->afilter);
     talloc_free(d_audio->waiting);
+    free_frames(d_audio->prefill, &d_audio->num_prefill);
+    free_frames(d_audio->cache, &d_audio->num_cache);
     talloc_free(d_audio);
 }
 
-static int decode_new_frame(struct dec_audio *da)
+// Keep a reference to the newly decoded frame in da->waiting for
+// audio_replay_cached().
+static void add_to_cache(struct dec_audio *da)
+{
+    double secs = da->opts->audio_seek_cache;
+    struct dec_audio_frame f = {
+        .frame = da->waiting,
+        .pts = da->pts,
+        .pts_offset = da->pts_offset,
+    };
+    if (secs <= 0 || f.pts == MP_NOPTS_VALUE ||
+        !mp_audio_config_valid(f.frame))
+    {
+        free_frames(da->cache, &da->num_cache);
+        return;
+    }
+
+    // The cache must be contiguous; start over on timestamp discontinuities.
+    if (da->num_cache) {
+        double last_end = frame_end(&da->cache[da->num_cache - 1]);
+        if (fabs(frame_start(&f) - last_end) > 0.1)
+            free_frames(da->cache, &da->num_cache);
+    }
+
+    f.frame = mp_audio_new_ref(f.frame);
+    if (!f.frame) {
+        free_frames(da->cache, &da->num_cache);
+        return;
+    }
+    MP_TARRAY_APPEND(da, da->cache, da->num_cache, f);
+
+    // Drop the oldest frames, as long as secs seconds remain.
+    double end = frame_end(&f);
+    while (da->num_cache > 1 && end - frame_start(&da->cache[1]) >= secs) {
+        talloc_free(da->cache[0].frame);
+        MP_TARRAY_REMOVE_AT(da->cache, da->num_cache, 0);
+    }
+}
+
+static int decode_packets(struct dec_audio *da)
 {
     while (!da->waiting) {
         int ret = da->ad_driver->decode_packet(da, &da->waiting);
@@ -177,18 +280,65 @@ static int decode_new_frame(struct dec_audio *da)
             da->pts_offset += da->waiting->samples;
             da->decode_format = *da->waiting;
             mp_audio_set_null_data(&da->decode_format);
+            add_to_cache(da);
         }
     }
     return mp_audio_config_valid(da->waiting) ? AD_OK : AD_ERR;
 }
 
+static int decode_new_frame(struct dec_audio *da)
+{
+    if (!da->waiting && da->num_prefill) {
+        struct dec_audio_frame p = da->prefill[0];
+        MP_TARRAY_REMOVE_AT(da->prefill, da->num_prefill, 0);
+        da->waiting = p.frame;
+        da->pts = p.pts;
+        da->pts_offset = p.pts_offset;
+        da->decode_format = *da->waiting;
+        mp_audio_set_null_data(&da->decode_format);
+    }
+    return decode_packets(da);
+}
+
 /* Decode packets until we know the audio format. Then reinit the buffer.
  * Returns AD_OK on success, negative AD_* code otherwise.
  * Also returns AD_OK if already initialized (and does nothing).
  */
 int initial_audio_decode(struct dec_audio *da)
 {
-    return decode_new_frame(da);
+    audio_pause_thread(da);
+    int res = decode_new_frame(da);
+    audio_unpause_thread(da);
+    return res;
+}
+
+/* Decode up to secs seconds of audio, and queue it without filtering. Later
+ * decode calls return the queued frames first, so this only moves the decoding
+ * work to an earlier time (used to prepare the next file for gapless audio).
+ * The first frame is made current, so the decode format and pts are set.
+ * Stops early on EOF or errors; these are seen again by later decode calls.
+ */
+void audio_prefill(struct dec_audio *da, double secs)
+{
+    assert(!da->num_prefill);
+    double buffered = 0;
+    while (buffered < secs) {
+        int res = decode_packets(da);
+        if (!da->waiting)
+            break;
+        struct dec_audio_frame p = {
+            .frame = da->waiting,
+            .pts = da->pts,
+            .pts_offset = da->pts_offset,
+        };
+        da->waiting = NULL;
+        MP_TARRAY_APPEND(da, da->prefill, da->num_prefill, p);
+        if (res < 0)
+            break;
+        buffered += p.frame->samples / (double)p.frame->rate;
+    }
+    if (da->num_prefill)
+        decode_new_frame(da);
 }
 
 static bool copy_output(struct af_stream *afs, struct mp_audio_buffer *outbuf,
@@ -206,13 +356,8 @@ static bool copy_output(struct af_stream *afs, struct mp_audio_buffer *outbuf,
     return true;
 }
 
-/* Try to get at least minsamples decoded+filtered samples in outbuf
- * (total length including possible existing data).
- * Return 0 on success, or negative AD_* error code.
- * In the former case outbuf has at least minsamples buffered on return.
- * In case of EOF/error it might or might not be. */
-int audio_decode(struct dec_audio *da, struct mp_audio_buffer *outbuf,
-                 int minsamples)
+static int decode_and_filter(struct dec_audio *da,
+                             struct mp_audio_buffer *outbuf, int minsamples)
 {
     struct af_stream *afs = da->afilter;
     if (afs->initialized < 1)
@@ -252,8 +397,117 @@ int audio_decode(struct dec_audio *da, struct mp_audio_buffer *outbuf,
     return res;
 }
 
+// Move queued audio from the thread to outbuf. See audio_decode().
+static int read_thread_queue(struct dec_audio *da,
+                             struct mp_audio_buffer *outbuf, int minsamples)
+{
+    struct dec_audio_thread *t = da->thread;
+    pthread_mutex_lock(&t->lock);
+    int missing = minsamples - mp_audio_buffer_samples(outbuf);
+    bool got_data = false;
+    if (missing > 0 && mp_audio_buffer_samples(t->queue)) {
+        struct mp_audio data;
+        mp_audio_buffer_peek(t->queue, &data);
+        data.samples = MPMIN(data.samples, missing);
+        mp_audio_buffer_append(outbuf, &data);
+        mp_audio_buffer_skip(t->queue, data.samples);
+        missing -= data.samples;
+        got_data = true;
+        pthread_cond_signal(&t->wakeup); // there's room in the queue again
+    }
+    int res = AD_OK;
+    if (missing > 0) {
+        // The queue is empty now. Report why the thread stopped, if it did,
+        // and let it retry.
+        res = t->status;
+        if (res == AD_OK || res == AD_WAIT)
+            res = got_data ? AD_OK : AD_WAIT;
+        if (t->status != AD_OK) {
+            t->status = AD_OK;
+            pthread_cond_signal(&t->wakeup);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+/* Try to get at least minsamples decoded+filtered samples in outbuf
+ * (total length including possible existing data).
+ * Return 0 on success, or negative AD_* error code.
+ * In the former case outbuf has at least minsamples buffered on return.
+ * In case of EOF/error it might or might not be.
+ * With the decoder thread, this returns only what the thread has queued, and
+ * AD_OK with less data if the thread is still decoding. AD_WAIT means nothing
+ * was queued; the thread's wakeup callback is called when that changes.
+ */
+int audio_decode(struct dec_audio *da, struct mp_audio_buffer *outbuf,
+                 int minsamples)
+{
+    if (da->thread)
+        return read_thread_queue(da, outbuf, minsamples);
+    return decode_and_filter(da, outbuf, minsamples);
+}
+
+// Presentation time of the end of the filtered audio that wasn't returned by
+// audio_decode() yet. The decoder must not be in use by the thread.
+static double get_filtered_pts(struct dec_audio *da)
+{
+    struct mp_audio in_format = da->decode_format;
+
+    if (!mp_audio_config_valid(&in_format) || da->afilter->initialized < 1)
+        return MP_NOPTS_VALUE;
+
+    // first calculate the end pts of audio that has been output by decoder
+    double a_pts = da->pts;
+    if (a_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    // da->pts is the timestamp of the latest input packet with known pts that
+    // the decoder has decoded. da->pts_offset is the number of samples the
+    // decoder has output after that timestamp.
+    a_pts += da->pts_offset / (double)in_format.rate;
+
+    // Decoded but not filtered
+    if (da->waiting)
+        a_pts -= da->waiting->samples / (double)in_format.rate;
+
+    // Data buffered in audio filters, measured in seconds of "missing" output.
+    // Filters divide audio length by playback_speed, so multiply by it to get
+    // the length in original units without speedup or slowdown.
+    return a_pts - af_calc_delay(da->afilter) * da->opts->playback_speed;
+}
+
+// Return the pts value corresponding to the end point of the audio returned by
+// audio_decode() so far, or MP_NOPTS_VALUE if unknown.
+double audio_get_pts(struct dec_audio *da)
+{
+    struct dec_audio_thread *t = da->thread;
+    if (!t)
+        return get_filtered_pts(da);
+
+    pthread_mutex_lock(&t->lock);
+    double pts = t->pause_count ? get_filtered_pts(da) : t->pts;
+    if (pts != MP_NOPTS_VALUE)
+        pts -= mp_audio_buffer_seconds(t->queue) * da->opts->playback_speed;
+    pthread_mutex_unlock(&t->lock);
+    return pts;
+}
+
+static void flush_thread_queue(struct dec_audio *d_audio)
+{
+    struct dec_audio_thread *t = d_audio->thread;
+    if (t) {
+        pthread_mutex_lock(&t->lock);
+        mp_audio_buffer_clear(t->queue);
+        mp_audio_buffer_clear(t->decoded);
+        pthread_mutex_unlock(&t->lock);
+    }
+}
+
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
+    audio_pause_thread(d_audio);
+    flush_thread_queue(d_audio);
     if (d_audio->ad_driver)
         d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
     af_seek_reset(d_audio->afilter);
@@ -263,4 +517,217 @@ void audio_reset_decoding(struct dec_audio *d_audio)
         talloc_free(d_audio->waiting);
         d_audio->waiting = NULL;
     }
+    free_frames(d_audio->prefill, &d_audio->num_prefill);
+    free_frames(d_audio->cache, &d_audio->num_cache);
+    audio_unpause_thread(d_audio);
+}
+
+// Index of the cached frame containing pts, or -1.
+static int find_cached(struct dec_audio *d_audio, double pts)
+{
+    if (!d_audio->num_cache ||
+        pts >= frame_end(&d_audio->cache[d_audio->num_cache - 1]))
+        return -1;
+    for (int n = d_audio->num_cache - 1; n >= 0; n--) {
+        if (frame_start(&d_audio->cache[n]) <= pts)
+            return n;
+    }
+    return -1;
+}
+
+// Whether audio_replay_cached() would succeed.
+bool audio_cache_contains(struct dec_audio *d_audio, double pts)
+{
+    audio_pause_thread(d_audio);
+    bool r = find_cached(d_audio, pts) >= 0;
+    audio_unpause_thread(d_audio);
+    return r;
+}
+
+/* Like audio_reset_decoding(), but restart at the cached frame containing pts
+ * (--audio-seek-cache), instead of discarding the decoder state. The cached
+ * frames are returned again, and then decoding simply continues, so the
+ * demuxer must not be seeked. Returns false and does nothing if pts is not
+ * cached.
+ */
+static bool replay_cached(struct dec_audio *d_audio, double pts)
+{
+    int first = find_cached(d_audio, pts);
+    if (first < 0)
+        return false;
+
+    struct dec_audio_frame *frames = NULL;
+    int num_frames = 0;
+    for (int n = first; n < d_audio->num_cache; n++) {
+        struct dec_audio_frame f = d_audio->cache[n];
+        f.frame = mp_audio_new_ref(f.frame);
+        if (!f.frame) {
+            free_frames(frames, &num_frames);
+            talloc_free(frames);
+            return false;
+        }
+        MP_TARRAY_APPEND(d_audio, frames, num_frames, f);
+    }
+
+    af_seek_reset(d_audio->afilter);
+    talloc_free(d_audio->waiting);
+    d_audio->waiting = NULL;
+    free_frames(d_audio->prefill, &d_audio->num_prefill);
+    talloc_free(d_audio->prefill);
+    d_audio->prefill = frames;
+    d_audio->num_prefill = num_frames;
+    decode_new_frame(d_audio);
+    flush_thread_queue(d_audio);
+    return true;
+}
+
+bool audio_replay_cached(struct dec_audio *d_audio, double pts)
+{
+    audio_pause_thread(d_audio);
+    bool r = replay_cached(d_audio, pts);
+    audio_unpause_thread(d_audio);
+    return r;
+}
+
+static bool thread_can_decode(struct dec_audio *d_audio)
+{
+    struct dec_audio_thread *t = d_audio->thread;
+    return !t->pause_count && t->status == AD_OK &&
+           d_audio->afilter->initialized >= 1 &&
+           mp_audio_buffer_seconds(t->queue) < t->max_secs;
+}
+
+static void *audio_thread(void *arg)
+{
+    struct dec_audio *d_audio = arg;
+    struct dec_audio_thread *t = d_audio->thread;
+    mpthread_set_name("audio decoder");
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->quit) {
+        if (!thread_can_decode(d_audio)) {
+            pthread_cond_wait(&t->wakeup, &t->lock);
+            continue;
+        }
+        t->decoding = true;
+        pthread_mutex_unlock(&t->lock);
+
+        int res = decode_and_filter(d_audio, t->decoded, 1);
+
+        pthread_mutex_lock(&t->lock);
+        struct mp_audio data;
+        mp_audio_buffer_peek(t->decoded, &data);
+        mp_audio_buffer_append(t->queue, &data);
+        mp_audio_buffer_clear(t->decoded);
+        if (res != AD_OK)
+            t->status = res;
+        t->pts = get_filtered_pts(d_audio);
+        t->decoding = false;
+        pthread_cond_broadcast(&t->wakeup); // for audio_pause_thread()
+        // Don't wake up the player for the same EOF or error again, which
+        // would make it retry in a loop. AD_WAIT is retried when the demuxer
+        // wakes up the player.
+        bool notify = data.samples > 0 ||
+                      (res != AD_WAIT && res != t->last_status);
+        t->last_status = res;
+        if (notify) {
+            pthread_mutex_unlock(&t->lock);
+            t->wakeup_cb(t->wakeup_ctx);
+            pthread_mutex_lock(&t->lock);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// Start decoding and filtering up to secs seconds ahead in a separate thread.
+// The filter chain must be initialized. wakeup_cb is called from the thread
+// when new audio was queued, or when decoding stopped (EOF, errors, format
+// changes). The demuxer must be threaded too, because the thread reads the
+// packets with demux_read_packet_async().
+void audio_start_thread(struct dec_audio *d_audio, double secs,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_audio->thread);
+    assert(d_audio->afilter->initialized >= 1);
+    struct dec_audio_thread *t = talloc_zero(NULL, struct dec_audio_thread);
+    t->max_secs = secs;
+    t->queue = mp_audio_buffer_create(t);
+    t->decoded = mp_audio_buffer_create(t);
+    mp_audio_buffer_reinit(t->queue, &d_audio->afilter->output);
+    mp_audio_buffer_reinit(t->decoded, &d_audio->afilter->output);
+    t->status = t->last_status = AD_OK;
+    t->pts = get_filtered_pts(d_audio);
+    t->wakeup_cb = wakeup_cb;
+    t->wakeup_ctx = wakeup_ctx;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    d_audio->thread = t;
+    if (pthread_create(&t->thread, NULL, audio_thread, d_audio)) {
+        MP_ERR(d_audio, "Could not start audio decoder thread.\n");
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->wakeup);
+        talloc_free(t);
+        d_audio->thread = NULL;
+        return;
+    }
+    MP_VERBOSE(d_audio, "Decoding %.2f seconds ahead in a separate thread.\n",
+               secs);
+}
+
+static void stop_thread(struct dec_audio *d_audio)
+{
+    struct dec_audio_thread *t = d_audio->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->wakeup);
+    talloc_free(t);
+    d_audio->thread = NULL;
+}
+
+// Stop the decoder thread after its current decode call, so that the caller
+// can use the decoder and the filter chain. Calls can be nested; the thread
+// continues after the same number of audio_unpause_thread() calls. Does
+// nothing if there is no thread (d_audio can be NULL too).
+void audio_pause_thread(struct dec_audio *d_audio)
+{
+    struct dec_audio_thread *t = d_audio ? d_audio->thread : NULL;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->pause_count++;
+    while (t->decoding)
+        pthread_cond_wait(&t->wakeup, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+void audio_unpause_thread(struct dec_audio *d_audio)
+{
+    struct dec_audio_thread *t = d_audio ? d_audio->thread : NULL;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    assert(t->pause_count > 0);
+    if (--t->pause_count == 0) {
+        struct af_stream *afs = d_audio->afilter;
+        // The filter chain might have been reinitialized for a new AO.
+        struct mp_audio fmt;
+        mp_audio_buffer_get_format(t->queue, &fmt);
+        if (afs->initialized >= 1 && !mp_audio_config_equals(&fmt, &afs->output))
+        {
+            mp_audio_buffer_reinit(t->queue, &afs->output);
+            mp_audio_buffer_reinit(t->decoded, &afs->output);
+        }
+        // Whatever stopped the thread might have been handled by the caller.
+        t->status = AD_OK;
+        t->pts = get_filtered_pts(d_audio);
+        pthread_cond_signal(&t->wakeup);
+    }
+    pthread_mutex_unlock(&t->lock);
 }
@@ -25,6 +25,8 @@
 
 struct mp_audio_buffer;
 struct mp_decoder_list;
+struct dec_audio_frame;
+struct dec_audio_thread;
 
 struct dec_audio {
     struct mp_log *log;
@@ -45,6 +47,16 @@ struct dec_audio {
     double pts;
     // number of samples output by decoder after last known pts
     int pts_offset;
+    // Frames decoded by audio_prefill() (or to be replayed from the cache),
+    // returned before decoding new packets
+    struct dec_audio_frame *prefill;
+    int num_prefill;
+    // Recently decoded frames (--audio-seek-cache), ending with the frame the
+    // decoder returned last
+    struct dec_audio_frame *cache;
+    int num_cache;
+    // Set if audio_start_thread() was called
+    struct dec_audio_thread *thread;
     // For free use by the ad_driver
     void *priv;
 };
@@ -62,7 +74,16 @@ int audio_init_best_codec(struct dec_audio *d_audio);
 int audio_decode(struct dec_audio *d_audio, struct mp_audio_buffer *outbuf,
                  int minsamples);
 int initial_audio_decode(struct dec_audio *d_audio);
+void audio_prefill(struct dec_audio *d_audio, double secs);
 void audio_reset_decoding(struct dec_audio *d_audio);
+bool audio_cache_contains(struct dec_audio *d_audio, double pts);
+bool audio_replay_cached(struct dec_audio *d_audio, double pts);
 void audio_uninit(struct dec_audio *d_audio);
+double audio_get_pts(struct dec_audio *d_audio);
+
+void audio_start_thread(struct dec_audio *d_audio, double secs,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx);
+void audio_pause_thread(struct dec_audio *d_audio);
+void audio_unpause_thread(struct dec_audio *d_audio);
 
 #endif /* MPLAYER_DEC_AUDIO_H */
@@ -38,6 +38,7 @@
 #include "common/common.h"
 
 #include "af.h"
+#include "audio/sample_ops.h"
 #include "options/m_option.h"
 
 // Data for specific instances of this filter
@@ -70,6 +71,7 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    const struct mp_sample_ops *ops;
     // command line
     float scale_nominal;
     float ms_stride;
@@ -115,8 +117,9 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
     return offset - offset_unchanged;
 }
 
-#define UNROLL_PADDING (4 * 4)
-
+// Cross-correlate the windowed overlap with every possible position in the
+// search window. The dot products are done by mp_sample_ops; its C version
+// is the original scalar loop, the others use SIMD.
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
     float best_corr = INT_MIN;
@@ -129,13 +132,10 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
     for (int i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = *pw++ **po++;
 
+    int num = s->samples_overlap - s->num_channels;
     float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = s->ops->dot_float(s->buf_pre_corr, search_start, num);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -158,21 +158,10 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
     for (long i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = (*pw++ **po++) >> 15;
 
+    int num = s->samples_overlap - s->num_channels;
     int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        int64_t corr = 0;
-        int16_t *ps = search_start;
-        ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
-        do {
-            corr += ppc[i + 0] * ps[i + 0];
-            corr += ppc[i + 1] * ps[i + 1];
-            corr += ppc[i + 2] * ps[i + 2];
-            corr += ppc[i + 3] * ps[i + 3];
-            i += 4;
-        } while (i < 0);
+        int64_t corr = s->ops->dot_s32_s16(s->buf_pre_corr, search_start, num);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -364,16 +353,13 @@ static int control(struct af_instance *af, int cmd, void *arg)
             if (use_int) {
                 int64_t t = frames_overlap;
                 int32_t n = 8589934588LL / (t * t); // 4 * (2^31 - 1) / t^2
-                s->buf_pre_corr = realloc(s->buf_pre_corr,
-                                          s->bytes_overlap * 2 + UNROLL_PADDING);
+                s->buf_pre_corr = realloc(s->buf_pre_corr, s->bytes_overlap * 2);
                 s->table_window = realloc(s->table_window,
                                           s->bytes_overlap * 2 - nch * bps * 2);
                 if (!s->buf_pre_corr || !s->table_window) {
                     MP_FATAL(af, "Out of memory\n");
                     return AF_ERROR;
                 }
-                memset((char *)s->buf_pre_corr + s->bytes_overlap * 2, 0,
-                       UNROLL_PADDING);
                 int32_t *pw = s->table_window;
                 for (int i = 1; i < frames_overlap; i++) {
                     int32_t v = (i * (t - i) * n) >> 15;
@@ -404,7 +390,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         s->bytes_queue = (s->frames_search + s->frames_stride + frames_overlap)
                          * bps * nch;
-        s->buf_queue = realloc(s->buf_queue, s->bytes_queue + UNROLL_PADDING);
+        s->buf_queue = realloc(s->buf_queue, s->bytes_queue);
         if (!s->buf_queue) {
             MP_FATAL(af, "Out of memory\n");
             return AF_ERROR;
@@ -461,9 +447,11 @@ static void uninit(struct af_instance *af)
 // Allocate memory and set function pointers
 static int af_open(struct af_instance *af)
 {
+    af_scaletempo_t *s = af->priv;
     af->control   = control;
     af->uninit    = uninit;
     af->filter_frame = filter;
+    s->ops = mp_get_sample_ops();
     return AF_OK;
 }
 
@@ -26,6 +26,7 @@
 #include <limits.h>
 
 #include "common/common.h"
+#include "audio/sample_ops.h"
 #include "af.h"
 #include "demux/demux.h"
 
@@ -41,6 +42,7 @@ struct priv {
     int fast;                   // Use fix-point volume control
     int detach;                 // Detach if gain volume is neutral
     float cfg_volume;
+    const struct mp_sample_ops *ops;
 };
 
 static int control(struct af_instance *af, int cmd, void *arg)
@@ -111,11 +113,7 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
         if (vol != 256) {
             if (af_make_writeable(af, data) < 0)
                 return; // oom
-            int16_t *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
-            }
+            s->ops->volume_s16(data->planes[p], num_samples, vol);
         }
     } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
         float vol = level;
@@ -123,9 +121,11 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
             if (af_make_writeable(af, data) < 0)
                 return; // oom
             float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            if (s->soft) {
+                for (int i = 0; i < num_samples; i++)
+                    a[i] = af_softclip(a[i] * vol);
+            } else {
+                s->ops->volume_float(a, num_samples, vol);
             }
         }
     }
@@ -146,6 +146,7 @@ static int af_open(struct af_instance *af)
     struct priv *s = af->priv;
     af->control = control;
     af->filter_frame = filter;
+    s->ops = mp_get_sample_ops();
     af_from_dB(1, &s->cfg_volume, &s->level, 20.0, -200.0, 60.0);
     return AF_OK;
 }
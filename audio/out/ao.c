@@ -383,6 +383,12 @@ bool ao_eof_reached(struct ao *ao)
     return ao->api->get_eof ? ao->api->get_eof(ao) : true;
 }
 
+// Number of times the AO ran out of audio data while playing. Thread-safe.
+int64_t ao_get_underruns(struct ao *ao)
+{
+    return atomic_load(&ao->underruns);
+}
+
 // Query the AO_EVENT_*s as requested by the events parameter, and return them.
 int ao_query_and_reset_events(struct ao *ao, int events)
 {
@@ -61,6 +61,9 @@ struct ao {
     // Internal events (use ao_request_reload(), ao_hotplug_event())
     atomic_int events_;
 
+    // Incremented by push.c/pull.c (use ao_get_underruns())
+    atomic_llong underruns;
+
     int buffer;
     double def_buffer;
     void *api_priv;
@@ -31,7 +31,7 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 #include "osdep/atomics.h"
-#include "misc/ring.h"
+#include "audio/audio_ring.h"
 
 /*
  * Note: there is some stupid stuff in this file in order to avoid mutexes.
@@ -49,14 +49,21 @@ enum {
 #define IS_PLAYING(st) ((st) == AO_STATE_PLAY || (st) == AO_STATE_BUSY)
 
 struct ao_pull_state {
-    // Be very careful with the order when accessing planes.
-    struct mp_ring *buffers[MP_NUM_CHANNELS];
+    struct mp_audio_ring *buffer;
 
     // AO_STATE_*
     atomic_int state;
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+
+    // Whether the buffer contains the end of the audio, so running out of
+    // data is not an underrun.
+    atomic_bool final_chunk;
+
+    // Accessed by ao_read_data() only. Set while the buffer is empty, so an
+    // underrun is counted only once.
+    bool underrun;
 };
 
 static void set_state(struct ao *ao, int new_state)
@@ -77,26 +84,16 @@ static void set_state(struct ao *ao, int new_state)
 static int get_space(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    // Since the reader will read the last plane last, its free space is the
-    // minimum free space across all planes.
-    return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
+    return mp_audio_ring_available(p->buffer);
 }
 
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct ao_pull_state *p = ao->api_priv;
 
-    int write_samples = get_space(ao);
-    write_samples = MPMIN(write_samples, samples);
-
-    // Write starting from the last plane - this way, the first plane will
-    // always contain the minimum amount of data readable across all planes
-    // (assumes the reader starts with the first plane).
-    int write_bytes = write_samples * ao->sstride;
-    for (int n = ao->num_planes - 1; n >= 0; n--) {
-        int r = mp_ring_write(p->buffers[n], data[n], write_bytes);
-        assert(r == write_bytes);
-    }
+    int write_samples = mp_audio_ring_write(p->buffer, data, samples);
+    atomic_store(&p->final_chunk, write_samples == samples &&
+                                  (flags & AOPLAY_FINAL_CHUNK));
 
     int state = atomic_load(&p->state);
     if (!IS_PLAYING(state)) {
@@ -129,21 +126,23 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
                                         AO_STATE_BUSY))
         goto end;
 
-    // Since the writer will write the first plane last, its buffered amount
-    // of data is the minimum amount across all planes.
-    int buffered_bytes = mp_ring_buffered(p->buffers[0]);
-    bytes = MPMIN(buffered_bytes, full_bytes);
+    int buffered = mp_audio_ring_buffered(p->buffer);
+    int read = mp_audio_ring_read(p->buffer, data, samples);
+    bytes = read * ao->sstride;
 
-    if (bytes > 0)
+    if (read > 0)
         atomic_store(&p->end_time_us, out_time_us);
 
-    for (int n = 0; n < ao->num_planes; n++) {
-        int r = mp_ring_read(p->buffers[n], data[n], bytes);
-        bytes = MPMIN(bytes, r);
+    if (read < samples && !atomic_load(&p->final_chunk)) {
+        if (!p->underrun)
+            atomic_fetch_add(&ao->underruns, 1);
+        p->underrun = true;
+    } else {
+        p->underrun = false;
     }
 
     // Half of the buffer played -> request more.
-    need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2;
+    need_wakeup = buffered - read <= mp_audio_ring_size(p->buffer) / 2;
 
     // Should never fail.
     atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_BUSY}, AO_STATE_PLAY);
@@ -179,7 +178,8 @@ static double get_delay(struct ao *ao)
     int64_t end = atomic_load(&p->end_time_us);
     int64_t now = mp_time_us();
     double driver_delay = MPMAX(0, (end - now) / (1000.0 * 1000.0));
-    return mp_ring_buffered(p->buffers[0]) / (double)ao->bps + driver_delay;
+    return mp_audio_ring_buffered(p->buffer) / (double)ao->samplerate +
+           driver_delay;
 }
 
 static void reset(struct ao *ao)
@@ -188,9 +188,10 @@ static void reset(struct ao *ao)
     if (ao->driver->reset)
         ao->driver->reset(ao); // assumes the audio callback thread is stopped
     set_state(ao, AO_STATE_NONE);
-    for (int n = 0; n < ao->num_planes; n++)
-        mp_ring_reset(p->buffers[n]);
+    mp_audio_ring_reset(p->buffer);
     atomic_store(&p->end_time_us, 0);
+    atomic_store(&p->final_chunk, false);
+    p->underrun = false;
 }
 
 static void pause(struct ao *ao)
@@ -211,7 +212,7 @@ static bool get_eof(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     // For simplicity, ignore the latency. Otherwise, we would have to run an
     // extra thread to time it.
-    return mp_ring_buffered(p->buffers[0]) == 0;
+    return mp_audio_ring_buffered(p->buffer) == 0;
 }
 
 static void drain(struct ao *ao)
@@ -220,7 +221,8 @@ static void drain(struct ao *ao)
     int state = atomic_load(&p->state);
     if (IS_PLAYING(state)) {
         // Wait for lower bound.
-        mp_sleep_us(mp_ring_buffered(p->buffers[0]) / (double)ao->bps * 1e6);
+        mp_sleep_us(mp_audio_ring_buffered(p->buffer) / (double)ao->samplerate
+                    * 1e6);
         // And then poll for actual end. (Unfortunately, this code considers
         // audio APIs which do not want you to use mutexes in the audio
         // callback, and an extra semaphore would require slightly more effort.)
@@ -240,8 +242,8 @@ static void uninit(struct ao *ao)
 static int init(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    for (int n = 0; n < ao->num_planes; n++)
-        p->buffers[n] = mp_ring_new(ao, ao->buffer * ao->sstride);
+    p->buffer = mp_audio_ring_create(ao, ao->num_planes, ao->sstride,
+                                     ao->buffer);
     atomic_store(&p->state, AO_STATE_NONE);
     assert(ao->driver->resume);
     return 0;
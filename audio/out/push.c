@@ -38,22 +38,25 @@
 #include "osdep/atomics.h"
 
 #include "audio/audio.h"
-#include "audio/audio_buffer.h"
+#include "audio/audio_ring.h"
 
 struct ao_push_state {
     pthread_t thread;
     pthread_mutex_t lock;
     pthread_cond_t wakeup;
 
-    // --- protected by lock
+    // Written by play() without holding the lock, so that copying audio data
+    // never blocks the playthread. Read by the playthread with lock held.
+    struct mp_audio_ring *buffer;
 
-    struct mp_audio_buffer *buffer;
+    // --- protected by lock
 
     bool terminate;
     bool wait_on_ao;
     bool still_playing;
     bool need_wakeup;
     bool paused;
+    bool underrun;
 
     // Whether the current buffer contains the complete audio.
     bool final_chunk;
@@ -90,7 +93,8 @@ static double unlocked_get_delay(struct ao *ao)
     double driver_delay = 0;
     if (ao->driver->get_delay)
         driver_delay = ao->driver->get_delay(ao);
-    return driver_delay + mp_audio_buffer_seconds(p->buffer);
+    return driver_delay + mp_audio_ring_buffered(p->buffer) /
+                          (double)ao->samplerate;
 }
 
 static double get_delay(struct ao *ao)
@@ -108,8 +112,9 @@ static void reset(struct ao *ao)
     pthread_mutex_lock(&p->lock);
     if (ao->driver->reset)
         ao->driver->reset(ao);
-    mp_audio_buffer_clear(p->buffer);
+    mp_audio_ring_reset(p->buffer);
     p->paused = false;
+    p->underrun = false;
     if (p->still_playing)
         wakeup_playthread(ao);
     p->still_playing = false;
@@ -151,7 +156,7 @@ static void drain(struct ao *ao)
 
     p->final_chunk = true;
     wakeup_playthread(ao);
-    while (p->still_playing && mp_audio_buffer_samples(p->buffer) > 0)
+    while (p->still_playing && mp_audio_ring_buffered(p->buffer) > 0)
         pthread_cond_wait(&p->wakeup, &p->lock);
 
     if (ao->driver->drain) {
@@ -170,13 +175,13 @@ done:
 static int unlocked_get_space(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    int space = mp_audio_buffer_get_write_available(p->buffer);
+    int space = mp_audio_ring_available(p->buffer);
     if (ao->driver->get_space) {
         // The following code attempts to keep the total buffered audio to
         // ao->buffer in order to improve latency.
         int device_space = ao->driver->get_space(ao);
         int device_buffered = ao->device_buffer - device_space;
-        int soft_buffered = mp_audio_buffer_samples(p->buffer);
+        int soft_buffered = mp_audio_ring_buffered(p->buffer);
         // The extra margin helps avoiding too many wakeups if the AO is fully
         // byte based and doesn't do proper chunked processing.
         int min_buffer = ao->buffer + 64;
@@ -212,10 +217,11 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct ao_push_state *p = ao->api_priv;
 
-    pthread_mutex_lock(&p->lock);
+    // Only this thread writes to the buffer, and reset() is called from the
+    // same thread, so the data can be copied without holding the lock.
+    int write_samples = mp_audio_ring_write(p->buffer, data, samples);
 
-    int write_samples = mp_audio_buffer_get_write_available(p->buffer);
-    write_samples = MPMIN(write_samples, samples);
+    pthread_mutex_lock(&p->lock);
 
     MP_TRACE(ao, "samples=%d flags=%d r=%d\n", samples, flags, write_samples);
 
@@ -223,13 +229,6 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         flags = flags & ~AOPLAY_FINAL_CHUNK;
     bool is_final = flags & AOPLAY_FINAL_CHUNK;
 
-    struct mp_audio audio;
-    mp_audio_buffer_get_format(p->buffer, &audio);
-    for (int n = 0; n < ao->num_planes; n++)
-        audio.planes[n] = data[n];
-    audio.samples = write_samples;
-    mp_audio_buffer_append(p->buffer, &audio);
-
     bool got_data = write_samples > 0 || p->paused || p->final_chunk != is_final;
 
     p->final_chunk = is_final;
@@ -251,33 +250,43 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 static void ao_play_data(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    struct mp_audio data;
-    mp_audio_buffer_peek(p->buffer, &data);
-    int max = data.samples;
+    int max = mp_audio_ring_buffered(p->buffer);
     int space = ao->driver->get_space(ao);
     space = MPMAX(space, 0);
-    if (data.samples > space)
-        data.samples = space;
+    void *planes[MP_NUM_CHANNELS];
+    int samples = mp_audio_ring_peek(p->buffer, planes, MPMIN(max, space));
     int flags = 0;
-    if (p->final_chunk && data.samples == max)
+    if (p->final_chunk && samples == max)
         flags |= AOPLAY_FINAL_CHUNK;
+    // Both the soft buffer and the device buffer ran empty.
+    if (p->still_playing && !p->final_chunk && !max &&
+        space >= ao->device_buffer)
+    {
+        if (!p->underrun) {
+            MP_VERBOSE(ao, "Audio underrun.\n");
+            atomic_fetch_add(&ao->underruns, 1);
+        }
+        p->underrun = true;
+    } else if (max) {
+        p->underrun = false;
+    }
     MP_STATS(ao, "start ao fill");
     int r = 0;
-    if (data.samples)
-        r = ao->driver->play(ao, data.planes, data.samples, flags);
+    if (samples)
+        r = ao->driver->play(ao, planes, samples, flags);
     MP_STATS(ao, "end ao fill");
-    if (r > data.samples) {
+    if (r > samples) {
         MP_WARN(ao, "Audio device returned non-sense value.\n");
-        r = data.samples;
+        r = samples;
     }
     r = MPMAX(r, 0);
     // Probably can't copy the rest of the buffer due to period alignment.
-    bool stuck_eof = r <= 0 && space >= max && data.samples > 0;
+    bool stuck_eof = r <= 0 && space >= max && samples > 0;
     if ((flags & AOPLAY_FINAL_CHUNK) && stuck_eof) {
         MP_ERR(ao, "Audio output driver seems to ignore AOPLAY_FINAL_CHUNK.\n");
         r = max;
     }
-    mp_audio_buffer_skip(p->buffer, r);
+    mp_audio_ring_skip(p->buffer, r);
     if (r > 0)
         p->expected_end_time = 0;
     // Nothing written, but more input data than space - this must mean the
@@ -323,7 +332,7 @@ static void *playthread(void *arg)
                 bool was_playing = p->still_playing;
                 double timeout = -1;
                 if (p->still_playing && !p->paused && p->final_chunk &&
-                    !mp_audio_buffer_samples(p->buffer))
+                    !mp_audio_ring_buffered(p->buffer))
                 {
                     double now = mp_time_sec();
                     if (!p->expected_end_time)
@@ -407,10 +416,8 @@ static int init(struct ao *ao)
         goto err;
     }
 
-    p->buffer = mp_audio_buffer_create(ao);
-    mp_audio_buffer_reinit_fmt(p->buffer, ao->format,
-                               &ao->channels, ao->samplerate);
-    mp_audio_buffer_preallocate_min(p->buffer, ao->buffer);
+    p->buffer = mp_audio_ring_create(ao, ao->num_planes, ao->sstride,
+                                     ao->buffer);
     if (pthread_create(&p->thread, NULL, playthread, ao))
         goto err;
     return 0;
@@ -0,0 +1,255 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "sample_ops.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_SAMPLE_OPS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HAVE_SAMPLE_OPS_X86 0
+#endif
+
+static void volume_s16_c(int16_t *a, int n, int vol)
+{
+    for (int i = 0; i < n; i++) {
+        int64_t x = ((int64_t)a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, INT16_MIN, INT16_MAX);
+    }
+}
+
+static void volume_float_c(float *a, int n, float vol)
+{
+    for (int i = 0; i < n; i++)
+        a[i] = MPCLAMP(a[i] * vol, -1.0f, 1.0f);
+}
+
+static float dot_float_c(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static int64_t dot_s32_s16_c(const int32_t *a, const int16_t *b, int n)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += (int64_t)a[i] * b[i];
+    return sum;
+}
+
+static const struct mp_sample_ops ops_c = {
+    .name = "c",
+    .volume_s16 = volume_s16_c,
+    .volume_float = volume_float_c,
+    .dot_float = dot_float_c,
+    .dot_s32_s16 = dot_s32_s16_c,
+};
+
+#if HAVE_SAMPLE_OPS_X86
+
+// The SIMD versions process blocks of samples and leave the rest to the C
+// versions.
+
+TARGET_SSE2
+static void volume_s16_sse2(int16_t *a, int n, int vol)
+{
+    // The 16x16->32 bit multiply needs vol to fit into int16_t.
+    if (vol < 0 || vol > INT16_MAX) {
+        volume_s16_c(a, n, vol);
+        return;
+    }
+    const __m128i v = _mm_set1_epi16(vol);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i lo = _mm_mullo_epi16(x, v);
+        __m128i hi = _mm_mulhi_epi16(x, v);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+    }
+    volume_s16_c(a + i, n - i, vol);
+}
+
+TARGET_SSE2
+static void volume_float_sse2(float *a, int n, float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, min), max));
+    }
+    volume_float_c(a + i, n - i, vol);
+}
+
+TARGET_SSE2
+static float dot_float_sse2(const float *a, const float *b, int n)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+    }
+    float r[4];
+    _mm_storeu_ps(r, _mm_add_ps(s0, s1));
+    return r[0] + r[1] + r[2] + r[3] + dot_float_c(a + i, b + i, n - i);
+}
+
+static const struct mp_sample_ops ops_sse2 = {
+    .name = "sse2",
+    .volume_s16 = volume_s16_sse2,
+    .volume_float = volume_float_sse2,
+    .dot_float = dot_float_sse2,
+    // There is no signed 32x32->64 bit multiply before SSE4.1.
+    .dot_s32_s16 = dot_s32_s16_c,
+};
+
+TARGET_AVX2
+static void volume_s16_avx2(int16_t *a, int n, int vol)
+{
+    if (vol < 0 || vol > INT16_MAX) {
+        volume_s16_c(a, n, vol);
+        return;
+    }
+    const __m256i v = _mm256_set1_epi16(vol);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i lo = _mm256_mullo_epi16(x, v);
+        __m256i hi = _mm256_mulhi_epi16(x, v);
+        // unpack and packs both work per 128 bit lane, so the order is kept.
+        __m256i p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 8);
+        __m256i p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 8);
+        _mm256_storeu_si256((__m256i *)(a + i), _mm256_packs_epi32(p0, p1));
+    }
+    volume_s16_c(a + i, n - i, vol);
+}
+
+TARGET_AVX2
+static void volume_float_avx2(float *a, int n, float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    const __m256 min = _mm256_set1_ps(-1.0f), max = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v);
+        _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(x, min), max));
+    }
+    volume_float_c(a + i, n - i, vol);
+}
+
+TARGET_AVX2
+static float dot_float_avx2(const float *a, const float *b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 s = _mm256_add_ps(s0, s1);
+    __m128 r4 = _mm_add_ps(_mm256_castps256_ps128(s),
+                           _mm256_extractf128_ps(s, 1));
+    float r[4];
+    _mm_storeu_ps(r, r4);
+    return r[0] + r[1] + r[2] + r[3] + dot_float_c(a + i, b + i, n - i);
+}
+
+TARGET_AVX2
+static int64_t dot_s32_s16_avx2(const int32_t *a, const int16_t *b, int n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)(b + i)));
+        // mul_epi32 multiplies the even 32 bit elements into 64 bit results;
+        // shift the odd elements down to get the other half.
+        sum = _mm256_add_epi64(sum, _mm256_mul_epi32(x, y));
+        sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_srli_epi64(x, 32),
+                                                     _mm256_srli_epi64(y, 32)));
+    }
+    int64_t r[4];
+    _mm256_storeu_si256((__m256i *)r, sum);
+    return r[0] + r[1] + r[2] + r[3] + dot_s32_s16_c(a + i, b + i, n - i);
+}
+
+static const struct mp_sample_ops ops_avx2 = {
+    .name = "avx2",
+    .volume_s16 = volume_s16_avx2,
+    .volume_float = volume_float_avx2,
+    .dot_float = dot_float_avx2,
+    .dot_s32_s16 = dot_s32_s16_avx2,
+};
+
+#endif /* HAVE_SAMPLE_OPS_X86 */
+
+// Best first.
+static const struct {
+    const struct mp_sample_ops *ops;
+    int cpu_flags;
+} impls[] = {
+#if HAVE_SAMPLE_OPS_X86
+    {&ops_avx2, AV_CPU_FLAG_AVX2},
+    {&ops_sse2, AV_CPU_FLAG_SSE2},
+#endif
+    {&ops_c, 0},
+};
+
+static bool impl_supported(int n)
+{
+    return (av_get_cpu_flags() & impls[n].cpu_flags) == impls[n].cpu_flags;
+}
+
+const struct mp_sample_ops *mp_get_sample_ops(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(impls); n++) {
+        if (impl_supported(n))
+            return impls[n].ops;
+    }
+    abort(); // the C version is always supported
+}
+
+const struct mp_sample_ops *mp_get_sample_ops_by_name(const char *name)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(impls); n++) {
+        if (strcmp(impls[n].ops->name, name) == 0)
+            return impl_supported(n) ? impls[n].ops : NULL;
+    }
+    return NULL;
+}
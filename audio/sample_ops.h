@@ -0,0 +1,49 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AUDIO_SAMPLE_OPS_H
+#define MP_AUDIO_SAMPLE_OPS_H
+
+#include <stdint.h>
+
+// Simple per-sample kernels. All functions take a sample count n (for packed
+// data this is samples * channels). There are no alignment requirements.
+// Float samples are in the range [-1, 1].
+struct mp_sample_ops {
+    const char *name;
+
+    // a[i] = clamp((a[i] * vol) >> 8), i.e. vol is 8.8 fixed point.
+    void (*volume_s16)(int16_t *a, int n, int vol);
+    // a[i] = clamp(a[i] * vol, -1, 1)
+    void (*volume_float)(float *a, int n, float vol);
+
+    // Return sum(a[i] * b[i]). The C version sums in order; others may use a
+    // different order, so float results can differ slightly.
+    float (*dot_float)(const float *a, const float *b, int n);
+    int64_t (*dot_s32_s16)(const int32_t *a, const int16_t *b, int n);
+};
+
+// Fastest implementation supported by the CPU. Never returns NULL. This
+// respects av_force_cpu_flags(), so av_force_cpu_flags(0) selects the C
+// reference code.
+const struct mp_sample_ops *mp_get_sample_ops(void);
+
+// Implementation with the given name ("c", "sse2", "avx2"), or NULL if it
+// was not compiled in or is not supported by the CPU. Meant for testing.
+const struct mp_sample_ops *mp_get_sample_ops_by_name(const char *name);
+
+#endif
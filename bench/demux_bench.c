@@ -0,0 +1,209 @@
+/*
+ * Demuxer throughput benchmark. Not a unit test.
+ *
+ * Usage: demux_bench [--bench-seeks=N] [--mpv-option=value ...] file...
+ *
+ * Opens each file with demux_open(), selects all tracks, reads all packets
+ * with demux_read_any_packet(), and then does N seeks to pseudo-random
+ * positions, measuring the time until the first packet after each seek.
+ * mpv options (e.g. --demuxer=lavf, --demuxer-mkv-parse-threads=4) are
+ * applied before opening the files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/av_log.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+
+struct result {
+    const char *demuxer;
+    int files;
+    int64_t packets, bytes;
+    double read_time;
+    int64_t pool_hits, pool_misses;
+    int seeks;
+    double seek_time, seek_max;
+};
+
+static double get_duration(struct demuxer *demuxer)
+{
+    double len = 0;
+    if (demux_control(demuxer, DEMUXER_CTRL_GET_TIME_LENGTH, &len) < 1)
+        len = 0;
+    return len;
+}
+
+static bool bench_file(struct mpv_global *global, struct mp_log *log,
+                       const char *filename, int num_seeks, struct result *r)
+{
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    double open_start = mp_time_sec();
+    struct stream *stream = stream_create(filename, STREAM_READ, cancel, global);
+    struct demuxer *demuxer = stream ? demux_open(stream, NULL, global) : NULL;
+    if (!demuxer) {
+        mp_err(log, "%s: can't open\n", filename);
+        free_stream(stream);
+        talloc_free(cancel);
+        return false;
+    }
+    double open_time = mp_time_sec() - open_start;
+
+    for (int n = 0; n < demuxer->num_streams; n++)
+        demuxer_select_track(demuxer, demuxer->streams[n], true);
+
+    *r = (struct result){.demuxer = demuxer->desc->name, .files = 1};
+
+    struct demux_packet_pool_stats pool0, pool1;
+    demux_packet_pool_get_stats(&pool0);
+
+    double start = mp_time_sec();
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_any_packet(demuxer))) {
+        r->packets++;
+        r->bytes += pkt->len;
+        free_demux_packet(pkt);
+    }
+    r->read_time = mp_time_sec() - start;
+
+    demux_packet_pool_get_stats(&pool1);
+    r->pool_hits = pool1.hits - pool0.hits;
+    r->pool_misses = pool1.misses - pool0.misses;
+
+    double duration = get_duration(demuxer);
+    if (!demuxer->seekable || duration <= 0)
+        num_seeks = 0;
+    uint32_t rnd = 12345;
+    for (int n = 0; n < num_seeks; n++) {
+        rnd = rnd * 1103515245 + 12345;
+        double pos = (rnd >> 8) / (double)(1 << 24) * duration;
+        double t = mp_time_sec();
+        demux_seek(demuxer, pos, SEEK_ABSOLUTE);
+        pkt = demux_read_any_packet(demuxer);
+        t = mp_time_sec() - t;
+        free_demux_packet(pkt);
+        r->seeks++;
+        r->seek_time += t;
+        r->seek_max = MPMAX(r->seek_max, t);
+    }
+
+    mp_info(log, "%s: demuxer %s, opened in %.3f s\n", filename,
+            r->demuxer, open_time);
+
+    free_demuxer(demuxer);
+    free_stream(stream);
+    talloc_free(cancel);
+    return true;
+}
+
+static void print_result(struct mp_log *log, struct result *r)
+{
+    double t = MPMAX(r->read_time, 1e-9);
+    mp_info(log, "  %"PRId64" packets, %.1f MB in %.3f s: %.0f packets/s, "
+            "%.1f MB/s\n", r->packets, r->bytes / 1e6, r->read_time,
+            r->packets / t, r->bytes / 1e6 / t);
+    // Only counts packet data allocated through the pool: packets larger than
+    // the largest pool class, or referencing libavformat's buffers, are not
+    // included.
+    mp_info(log, "  packet pool: %"PRId64" misses (new buffers), %"PRId64
+            " hits (reused)\n", r->pool_misses, r->pool_hits);
+    if (r->seeks) {
+        mp_info(log, "  %d seeks: average %.2f ms, max %.2f ms\n", r->seeks,
+                r->seek_time / r->seeks * 1e3, r->seek_max * 1e3);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(global);
+    struct mp_log *log = mp_log_new(global, global->log, "!bench");
+
+    struct m_config *config = m_config_new(global, log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    global->opts = config->optstruct;
+    init_libav(global);
+
+    int num_seeks = 0;
+    char **files = NULL;
+    int num_files = 0;
+    for (int n = 1; n < argc; n++) {
+        bstr arg = bstr0(argv[n]);
+        if (bstr_eatstart0(&arg, "--")) {
+            bstr name, val;
+            if (!bstr_split_tok(arg, "=", &name, &val))
+                val = bstr0("yes");
+            if (bstr_equals0(name, "bench-seeks")) {
+                num_seeks = bstrtoll(val, NULL, 10);
+            } else if (m_config_set_option_ext(config, name, val, 0) < 0) {
+                mp_fatal(log, "invalid option: %s\n", argv[n]);
+                return 1;
+            }
+        } else {
+            MP_TARRAY_APPEND(global, files, num_files, argv[n]);
+        }
+    }
+    mp_msg_update_msglevels(global);
+
+    if (!num_files) {
+        mp_info(log, "Usage: %s [--bench-seeks=N] [--option=value...] "
+                "file...\n", argv[0]);
+        return 1;
+    }
+
+    struct result *totals = NULL;
+    int num_totals = 0;
+    int failed = 0;
+    for (int n = 0; n < num_files; n++) {
+        struct result r;
+        if (!bench_file(global, log, files[n], num_seeks, &r)) {
+            failed++;
+            continue;
+        }
+        print_result(log, &r);
+
+        struct result *total = NULL;
+        for (int i = 0; i < num_totals; i++) {
+            if (strcmp(totals[i].demuxer, r.demuxer) == 0)
+                total = &totals[i];
+        }
+        if (!total) {
+            MP_TARRAY_APPEND(global, totals, num_totals,
+                             (struct result){.demuxer = r.demuxer});
+            total = &totals[num_totals - 1];
+        }
+        total->files += 1;
+        total->packets += r.packets;
+        total->bytes += r.bytes;
+        total->read_time += r.read_time;
+        total->pool_hits += r.pool_hits;
+        total->pool_misses += r.pool_misses;
+        total->seeks += r.seeks;
+        total->seek_time += r.seek_time;
+        total->seek_max = MPMAX(total->seek_max, r.seek_max);
+    }
+
+    if (num_files > 1) {
+        for (int i = 0; i < num_totals; i++) {
+            mp_info(log, "Total for demuxer %s (%d files):\n",
+                    totals[i].demuxer, totals[i].files);
+            print_result(log, &totals[i]);
+        }
+    }
+
+    uninit_libav(global);
+    mp_msg_uninit(global);
+    talloc_free(global);
+    return failed ? 1 : 0;
+}
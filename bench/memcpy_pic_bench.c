@@ -0,0 +1,176 @@
+/*
+ * Benchmark for the plane copy functions (video/memcpy_pic.c). Not a unit
+ * test.
+ *
+ * Usage: memcpy_pic_bench [--threads=N] [--time=SECONDS]
+ *                         [--mpv-option=value ...]
+ *
+ * Runs mp_image_copy() and mp_image_clear() on 2160p frames with 8, 10 and 16
+ * bit per component. "copy" uses images without padding between lines, so
+ * each plane is copied at once; "copy (cropped)" copies line by line. Each
+ * case is run with the C code (av_force_cpu_flags(0)), with the code selected
+ * for the CPU, and with that code and N slice threads (default: one per CPU).
+ * Each run takes the given time (default 1 second), and the throughput is
+ * reported in frames per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/av_log.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "video/img_format.h"
+#include "video/memcpy_pic.h"
+#include "video/mp_image.h"
+#include "video/slice_threads.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+static const struct {
+    const char *name;
+    int imgfmt;
+} formats[] = {
+    {"8 bit", IMGFMT_420P},
+    {"10 bit", IMGFMT_420P10},
+    {"16 bit", IMGFMT_420P16},
+};
+
+enum op {
+    OP_COPY,
+    OP_COPY_CROPPED,
+    OP_CLEAR,
+    OP_COUNT
+};
+
+static const char *const op_names[OP_COUNT] = {
+    [OP_COPY]           = "copy",
+    [OP_COPY_CROPPED]   = "copy (cropped)",
+    [OP_CLEAR]          = "clear",
+};
+
+static struct mp_image *gen_image(int imgfmt)
+{
+    struct mp_image *img = mp_image_alloc(imgfmt, WIDTH, HEIGHT);
+    if (!img)
+        abort();
+    uint32_t rnd = 12345;
+    for (int p = 0; p < img->num_planes; p++) {
+        int line_bytes = mp_image_plane_w(img, p) * img->fmt.bytes[p];
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + y * img->stride[p];
+            for (int x = 0; x < line_bytes; x++) {
+                rnd = rnd * 1103515245 + 12345;
+                line[x] = rnd >> 24;
+            }
+        }
+    }
+    return img;
+}
+
+// Returns frames per second.
+static double run(enum op op, struct mp_image *src, double secs)
+{
+    struct mp_image *dst = mp_image_alloc(src->imgfmt, src->w, src->h);
+    if (!dst)
+        abort();
+    struct mp_image s = *src, d = *dst;
+    if (op == OP_COPY_CROPPED) {
+        // Makes the lines shorter than the stride.
+        mp_image_crop(&s, 0, 0, s.w - 16, s.h);
+        mp_image_crop(&d, 0, 0, d.w - 16, d.h);
+    }
+
+    int frames = 0;
+    double start = mp_time_sec(), now;
+    do {
+        switch (op) {
+        case OP_COPY:
+        case OP_COPY_CROPPED:
+            mp_image_copy(&d, &s);
+            break;
+        case OP_CLEAR:
+            mp_image_clear(&d, 0, 0, d.w, d.h);
+            break;
+        default:
+            abort();
+        }
+        frames++;
+        now = mp_time_sec();
+    } while (now - start < secs);
+
+    talloc_free(dst);
+    return frames / (now - start);
+}
+
+int main(int argc, char **argv)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(global);
+    struct mp_log *log = mp_log_new(global, global->log, "!bench");
+
+    struct m_config *config = m_config_new(global, log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    global->opts = config->optstruct;
+    init_libav(global);
+
+    int threads = av_cpu_count();
+    double secs = 1;
+    for (int n = 1; n < argc; n++) {
+        bstr arg = bstr0(argv[n]);
+        bstr name, val;
+        if (!bstr_eatstart0(&arg, "--")) {
+            mp_info(log, "Usage: %s [--threads=N] [--time=SECONDS] "
+                    "[--option=value...]\n", argv[0]);
+            return 1;
+        }
+        if (!bstr_split_tok(arg, "=", &name, &val))
+            val = bstr0("yes");
+        if (bstr_equals0(name, "threads")) {
+            threads = bstrtoll(val, NULL, 10);
+        } else if (bstr_equals0(name, "time")) {
+            secs = bstrtod(val, NULL);
+        } else if (m_config_set_option_ext(config, name, val, 0) < 0) {
+            mp_fatal(log, "invalid option: %s\n", argv[n]);
+            return 1;
+        }
+    }
+    mp_msg_update_msglevels(global);
+
+    mp_info(log, "Frames per second at %dx%d, C / %s / %s + %d threads:\n",
+            WIDTH, HEIGHT, mp_pic_impl_name(), mp_pic_impl_name(), threads);
+    for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+        struct mp_image *src = gen_image(formats[f].imgfmt);
+        for (int op = 0; op < OP_COUNT; op++) {
+            mp_slice_threads_init(1);
+            av_force_cpu_flags(0);
+            double fps_c = run(op, src, secs);
+            av_force_cpu_flags(-1);
+            double fps_simd = run(op, src, secs);
+            mp_slice_threads_uninit();
+
+            mp_slice_threads_init(threads);
+            double fps_sliced = run(op, src, secs);
+            mp_slice_threads_uninit();
+
+            mp_info(log, "%-6s %-14s %8.1f / %8.1f / %8.1f  (%.2fx / %.2fx)\n",
+                    formats[f].name, op_names[op], fps_c, fps_simd, fps_sliced,
+                    fps_simd / fps_c, fps_sliced / fps_c);
+        }
+        talloc_free(src);
+    }
+
+    uninit_libav(global);
+    mp_msg_uninit(global);
+    talloc_free(global);
+    return 0;
+}
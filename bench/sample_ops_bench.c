@@ -0,0 +1,156 @@
+/*
+ * Benchmark for the audio sample kernels in audio/sample_ops.c. Not a unit
+ * test.
+ *
+ * Usage: sample_ops_bench [--channels=N] [--samples=N] [--time=SECONDS]
+ *
+ * Runs every kernel of every implementation supported by the CPU on a buffer
+ * of N channels with N samples each (default 32 channels of 4096 samples),
+ * reports the throughput in million samples per second, and checks that the
+ * results match the C reference implementation (except for the float dot
+ * product, see run()).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "audio/sample_ops.h"
+
+struct buffers {
+    int nch, samples, n;
+    int16_t *s16, *s16_out;
+    int32_t *s32;
+    float *flt, *flt_out;
+    int64_t dot_s32;
+    float dot_flt;
+};
+
+enum kernel {
+    K_VOLUME_S16,
+    K_VOLUME_FLOAT,
+    K_DOT_FLOAT,
+    K_DOT_S32_S16,
+    K_COUNT
+};
+
+static const char *const kernel_names[K_COUNT] = {
+    [K_VOLUME_S16]      = "volume s16",
+    [K_VOLUME_FLOAT]    = "volume float",
+    [K_DOT_FLOAT]       = "dot float",
+    [K_DOT_S32_S16]     = "dot s32 * s16",
+};
+
+static void fill_input(struct buffers *b)
+{
+    uint32_t rnd = 12345;
+    for (int i = 0; i < b->n; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        b->s16[i] = rnd >> 16;
+        b->s32[i] = rnd;
+        // Slightly out of [-1, 1] to exercise clipping.
+        b->flt[i] = ((rnd >> 8) / (float)(1 << 24) - 0.5f) * 2.2f;
+    }
+}
+
+// Run the kernel once and return a pointer to the output data. The float dot
+// product is allowed to differ from the C version (summation order), so its
+// result is not returned for comparison (*out_size is 0).
+static void *run(const struct mp_sample_ops *ops, enum kernel k,
+                 struct buffers *b, size_t *out_size)
+{
+    switch (k) {
+    case K_VOLUME_S16:
+        memcpy(b->s16_out, b->s16, b->n * sizeof(int16_t));
+        ops->volume_s16(b->s16_out, b->n, 300);
+        *out_size = b->n * sizeof(int16_t);
+        return b->s16_out;
+    case K_VOLUME_FLOAT:
+        memcpy(b->flt_out, b->flt, b->n * sizeof(float));
+        ops->volume_float(b->flt_out, b->n, 1.3f);
+        *out_size = b->n * sizeof(float);
+        return b->flt_out;
+    case K_DOT_FLOAT:
+        b->dot_flt = ops->dot_float(b->flt, b->flt_out, b->n);
+        *out_size = 0;
+        return &b->dot_flt;
+    case K_DOT_S32_S16:
+        b->dot_s32 = ops->dot_s32_s16(b->s32, b->s16, b->n);
+        *out_size = sizeof(b->dot_s32);
+        return &b->dot_s32;
+    default:
+        abort();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nch = 32, samples = 4096;
+    double min_time = 0.25;
+    for (int n = 1; n < argc; n++) {
+        if (sscanf(argv[n], "--channels=%d", &nch) == 1 ||
+            sscanf(argv[n], "--samples=%d", &samples) == 1 ||
+            sscanf(argv[n], "--time=%lf", &min_time) == 1)
+            continue;
+        printf("Usage: %s [--channels=N] [--samples=N] [--time=SECONDS]\n",
+               argv[0]);
+        return 1;
+    }
+    if (nch < 1 || samples < 1)
+        return 1;
+
+    mp_time_init();
+
+    void *ta = talloc_new(NULL);
+    struct buffers b = {.nch = nch, .samples = samples, .n = nch * samples};
+    b.s16 = talloc_array(ta, int16_t, b.n);
+    b.s16_out = talloc_array(ta, int16_t, b.n);
+    b.s32 = talloc_array(ta, int32_t, b.n);
+    b.flt = talloc_array(ta, float, b.n);
+    b.flt_out = talloc_array(ta, float, b.n);
+    fill_input(&b);
+    memcpy(b.flt_out, b.flt, b.n * sizeof(float));
+
+    const char *const impls[] = {"c", "sse2", "avx2"};
+    const struct mp_sample_ops *ref = mp_get_sample_ops_by_name("c");
+    void *ref_out = talloc_size(ta, b.n * sizeof(float));
+
+    printf("%d channels, %d samples per channel, best: %s\n", nch, samples,
+           mp_get_sample_ops()->name);
+
+    bool mismatch = false;
+    for (int k = 0; k < K_COUNT; k++) {
+        size_t size;
+        void *out = run(ref, k, &b, &size);
+        memcpy(ref_out, out, size);
+
+        printf("%-20s", kernel_names[k]);
+        for (int i = 0; i < MP_ARRAY_SIZE(impls); i++) {
+            const struct mp_sample_ops *ops = mp_get_sample_ops_by_name(impls[i]);
+            if (!ops)
+                continue;
+            out = run(ops, k, &b, &size);
+            bool ok = memcmp(out, ref_out, size) == 0;
+            mismatch |= !ok;
+
+            int64_t iterations = 0;
+            double start = mp_time_sec(), t;
+            do {
+                for (int n = 0; n < 16; n++)
+                    run(ops, k, &b, &size);
+                iterations += 16;
+                t = mp_time_sec() - start;
+            } while (t < min_time);
+
+            printf(" %5s: %8.1f Ms/s%s", ops->name, iterations * b.n / t / 1e6,
+                   ok ? "" : " (MISMATCH)");
+        }
+        printf("\n");
+    }
+
+    talloc_free(ta);
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * af_scaletempo CPU usage benchmark. Not a unit test.
+ *
+ * Usage: scaletempo_bench [--bench-secs=N] [--mpv-option=value ...]
+ *
+ * Runs N seconds (default 10) of generated audio through a filter chain
+ * containing only scaletempo, for float and s16 input, several channel
+ * counts and several playback speeds. Each case is run with the C reference
+ * correlation code (av_force_cpu_flags(0)) and with the code selected for the
+ * CPU, and reports the CPU time spent per second of input audio. Only the
+ * af_filter_frame() calls are timed, with the process CPU time clock. Options
+ * such as --af=scaletempo=stride=30:search=20 are applied before the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/av_log.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "audio/audio.h"
+#include "audio/format.h"
+#include "audio/filter/af.h"
+
+#define RATE 48000
+#define CHUNK 1024
+
+static const int formats[] = {AF_FORMAT_FLOAT, AF_FORMAT_S16};
+static const int channels[] = {1, 2, 6, 8};
+static const double speeds[] = {1.25, 1.5, 2.0};
+
+static struct mp_audio *gen_audio(struct mp_audio *fmt, int samples)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(a, fmt);
+    mp_audio_realloc(a, samples);
+    a->samples = samples;
+    for (int i = 0; i < samples; i++) {
+        for (int c = 0; c < a->nch; c++) {
+            // A different chord on every channel.
+            double t = i / (double)RATE;
+            double v = 0.3 * sin(2 * M_PI * (220 + 55 * c) * t) +
+                       0.2 * sin(2 * M_PI * (330 + 77 * c) * t);
+            if (a->format == AF_FORMAT_S16) {
+                ((int16_t *)a->planes[0])[i * a->nch + c] = v * 32767;
+            } else {
+                ((float *)a->planes[0])[i * a->nch + c] = v;
+            }
+        }
+    }
+    return a;
+}
+
+static double cpu_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the CPU time spent filtering, or -1 on error.
+static double run(struct mpv_global *global, struct mp_audio *src,
+                  double speed)
+{
+    struct af_stream *afs = af_new(global);
+    mp_audio_copy_config(&afs->input, src);
+    mp_audio_copy_config(&afs->output, src);
+    if (af_init(afs) < 0) {
+        af_destroy(afs);
+        return -1;
+    }
+    af_control_all(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &speed);
+
+    double t = 0;
+    for (int pos = 0; pos < src->samples; pos += CHUNK) {
+        int len = MPMIN(CHUNK, src->samples - pos);
+        struct mp_audio *in = talloc_zero(NULL, struct mp_audio);
+        mp_audio_copy_config(in, src);
+        mp_audio_realloc(in, len);
+        in->samples = len;
+        mp_audio_copy(in, 0, src, pos, len);
+        double start = cpu_time();
+        int r = af_filter_frame(afs, in);
+        t += cpu_time() - start;
+        if (r < 0)
+            break;
+        struct mp_audio *out;
+        while ((out = af_read_output_frame(afs)))
+            talloc_free(out);
+    }
+
+    af_destroy(afs);
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(global);
+    struct mp_log *log = mp_log_new(global, global->log, "!bench");
+
+    struct m_config *config = m_config_new(global, log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    global->opts = config->optstruct;
+    init_libav(global);
+
+    m_config_set_option_ext(config, bstr0("af"), bstr0("scaletempo"), 0);
+
+    double secs = 10;
+    for (int n = 1; n < argc; n++) {
+        bstr arg = bstr0(argv[n]);
+        bstr name, val;
+        if (!bstr_eatstart0(&arg, "--")) {
+            mp_info(log, "Usage: %s [--bench-secs=N] [--option=value...]\n",
+                    argv[0]);
+            return 1;
+        }
+        if (!bstr_split_tok(arg, "=", &name, &val))
+            val = bstr0("yes");
+        if (bstr_equals0(name, "bench-secs")) {
+            secs = bstrtod(val, NULL);
+        } else if (m_config_set_option_ext(config, name, val, 0) < 0) {
+            mp_fatal(log, "invalid option: %s\n", argv[n]);
+            return 1;
+        }
+    }
+    mp_msg_update_msglevels(global);
+
+    mp_info(log, "CPU time per second of audio (ms), reference / optimized:\n");
+    for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+        for (int c = 0; c < MP_ARRAY_SIZE(channels); c++) {
+            struct mp_audio fmt = {.rate = RATE};
+            mp_audio_set_format(&fmt, formats[f]);
+            mp_audio_set_num_channels(&fmt, channels[c]);
+            struct mp_audio *src = gen_audio(&fmt, secs * RATE);
+
+            mp_info(log, "%-5s %d ch:", af_fmt_to_str(formats[f]), channels[c]);
+            for (int s = 0; s < MP_ARRAY_SIZE(speeds); s++) {
+                av_force_cpu_flags(0);
+                double t_ref = run(global, src, speeds[s]);
+                av_force_cpu_flags(-1);
+                double t_opt = run(global, src, speeds[s]);
+                if (t_ref < 0 || t_opt < 0) {
+                    mp_fatal(log, "could not initialize the filter chain\n");
+                    return 1;
+                }
+                mp_info(log, "  %.2fx %6.2f / %6.2f", speeds[s],
+                        t_ref / secs * 1e3, t_opt / secs * 1e3);
+            }
+            mp_info(log, "\n");
+
+            talloc_free(src);
+        }
+    }
+
+    uninit_libav(global);
+    mp_msg_uninit(global);
+    talloc_free(global);
+    return 0;
+}
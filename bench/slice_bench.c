@@ -0,0 +1,184 @@
+/*
+ * Benchmark for slice threading (video/slice_threads.c). Not a unit test.
+ *
+ * Usage: slice_bench [--threads=N] [--time=SECONDS] [--mpv-option=value ...]
+ *
+ * Runs mp_image_copy(), mp_image_clear() and the eq filter on 1080p and 2160p
+ * yuv420p frames, once with a single thread and once with N slice threads
+ * (default: one per CPU). Each case runs for the given time (default 1
+ * second), and the throughput is reported in frames per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/av_log.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/slice_threads.h"
+#include "video/filter/vf.h"
+
+static const struct {
+    const char *name;
+    int w, h;
+} sizes[] = {
+    {"1080p", 1920, 1080},
+    {"2160p", 3840, 2160},
+};
+
+enum op {
+    OP_COPY,
+    OP_CLEAR,
+    OP_EQ,
+    OP_COUNT
+};
+
+static const char *const op_names[OP_COUNT] = {
+    [OP_COPY]   = "copy",
+    [OP_CLEAR]  = "clear",
+    [OP_EQ]     = "eq filter",
+};
+
+static struct mp_image *gen_image(int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, w, h);
+    if (!img)
+        abort();
+    uint32_t rnd = 12345;
+    for (int p = 0; p < img->num_planes; p++) {
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + y * img->stride[p];
+            for (int x = 0; x < mp_image_plane_w(img, p); x++) {
+                rnd = rnd * 1103515245 + 12345;
+                line[x] = rnd >> 24;
+            }
+        }
+    }
+    return img;
+}
+
+static struct vf_chain *create_eq(struct mpv_global *global,
+                                  struct mp_image_params *params)
+{
+    struct vf_chain *c = vf_new(global);
+    for (int n = IMGFMT_START; n < IMGFMT_END; n++)
+        c->allowed_output_formats[n - IMGFMT_START] = 1;
+    char *args[] = {"contrast", "1.2", "brightness", "0.1",
+                    "saturation", "1.5", NULL};
+    if (!vf_append_filter(c, "eq", args) || vf_reconfig(c, params, params) < 0)
+    {
+        vf_destroy(c);
+        return NULL;
+    }
+    return c;
+}
+
+// Returns frames per second, or -1 on error.
+static double run(struct mpv_global *global, enum op op, struct mp_image *src,
+                  double secs)
+{
+    struct mp_image *dst = mp_image_alloc(src->imgfmt, src->w, src->h);
+    struct vf_chain *eq = NULL;
+    if (op == OP_EQ && !(eq = create_eq(global, &src->params))) {
+        talloc_free(dst);
+        return -1;
+    }
+
+    int frames = 0;
+    double start = mp_time_sec(), now;
+    do {
+        switch (op) {
+        case OP_COPY:
+            mp_image_copy(dst, src);
+            break;
+        case OP_CLEAR:
+            mp_image_clear(dst, 0, 0, dst->w, dst->h);
+            break;
+        case OP_EQ:
+            vf_filter_frame(eq, mp_image_new_ref(src));
+            talloc_free(vf_read_output_frame(eq));
+            break;
+        default:
+            abort();
+        }
+        frames++;
+        now = mp_time_sec();
+    } while (now - start < secs);
+
+    vf_destroy(eq);
+    talloc_free(dst);
+    return frames / (now - start);
+}
+
+int main(int argc, char **argv)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(global);
+    struct mp_log *log = mp_log_new(global, global->log, "!bench");
+
+    struct m_config *config = m_config_new(global, log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    global->opts = config->optstruct;
+    init_libav(global);
+
+    int threads = av_cpu_count();
+    double secs = 1;
+    for (int n = 1; n < argc; n++) {
+        bstr arg = bstr0(argv[n]);
+        bstr name, val;
+        if (!bstr_eatstart0(&arg, "--")) {
+            mp_info(log, "Usage: %s [--threads=N] [--time=SECONDS] "
+                    "[--option=value...]\n", argv[0]);
+            return 1;
+        }
+        if (!bstr_split_tok(arg, "=", &name, &val))
+            val = bstr0("yes");
+        if (bstr_equals0(name, "threads")) {
+            threads = bstrtoll(val, NULL, 10);
+        } else if (bstr_equals0(name, "time")) {
+            secs = bstrtod(val, NULL);
+        } else if (m_config_set_option_ext(config, name, val, 0) < 0) {
+            mp_fatal(log, "invalid option: %s\n", argv[n]);
+            return 1;
+        }
+    }
+    mp_msg_update_msglevels(global);
+
+    mp_info(log, "Frames per second, 1 thread / %d threads:\n", threads);
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        struct mp_image *src = gen_image(sizes[s].w, sizes[s].h);
+        for (int op = 0; op < OP_COUNT; op++) {
+            mp_slice_threads_init(1);
+            double fps_single = run(global, op, src, secs);
+            mp_slice_threads_uninit();
+
+            mp_slice_threads_init(threads);
+            double fps_sliced = run(global, op, src, secs);
+            mp_slice_threads_uninit();
+
+            if (fps_single < 0 || fps_sliced < 0) {
+                mp_fatal(log, "could not initialize %s\n", op_names[op]);
+                return 1;
+            }
+            mp_info(log, "%s %-10s %8.1f / %8.1f  (%.2fx)\n", sizes[s].name,
+                    op_names[op], fps_single, fps_sliced,
+                    fps_sliced / fps_single);
+        }
+        talloc_free(src);
+    }
+
+    uninit_libav(global);
+    mp_msg_uninit(global);
+    talloc_free(global);
+    return 0;
+}
@@ -7,6 +7,10 @@
 struct mpv_global {
     struct MPOpts *opts;
     struct mp_log *log;
+    // Shared by all users of the player instance; can be NULL (then it's not
+    // used). Created and destroyed by the player core.
+    struct rar_cache *rar_cache;
+    struct demux_probe_cache *demux_probe_cache;
 };
 
 #endif
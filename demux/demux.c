@@ -32,7 +32,10 @@
 #include "talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "osdep/atomics.h"
+#include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -114,6 +117,11 @@ struct demux_internal {
     double min_secs;
     int min_packs;
     int min_bytes;
+    // Packets already returned to the decoder are kept for seeking if
+    // back_bytes > 0 (total for all streams).
+    int back_bytes;
+    double back_secs;
+    int64_t packet_pool_size;   // as passed to demux_packet_pool_ref()
 
     bool tracks_switched;       // thread needs to inform demuxer of this
 
@@ -124,6 +132,9 @@ struct demux_internal {
     bool refresh_seeks_enabled;
     bool start_refresh_seek;
 
+    struct demux_ctrl_lock_stats lock_stats; // lockless field unused
+    atomic_llong lockless_reads;
+
     // Cached state.
     bool force_cache_update;
     double time_length;
@@ -133,10 +144,20 @@ struct demux_internal {
     int64_t stream_cache_size;
     int64_t stream_cache_fill;
     int stream_cache_idle;
+    double stream_cache_speed;
+    double stream_cache_underrun;
     // Updated during init only.
     char *stream_base_filename;
 };
 
+// Packets per stream that the reader can take without locking.
+#define RING_PACKS 16
+
+struct demux_keyframe {
+    double ts;                  // PTS (or DTS if unknown) of pkt
+    struct demux_packet *pkt;
+};
+
 struct demux_stream {
     struct demux_internal *in;
     enum stream_type type;
@@ -147,16 +168,34 @@ struct demux_stream {
                             // read (like subtitles)
     bool eof;               // end of demuxed stream? (true if all buffer empty)
     bool refreshing;
-    size_t packs;           // number of packets in buffer
-    size_t bytes;           // total bytes of packets in buffer
+    size_t packs;           // number of packets in buffer (from reader_head)
+    size_t bytes;           // total bytes of packets in buffer (from reader_head)
+    size_t back_packs;      // number of packets before reader_head
+    size_t back_bytes;      // total bytes of packets before reader_head
     double base_ts;         // timestamp of the last packet returned to decoder
     double last_ts;         // timestamp of the last packet added to queue
     double last_br_ts;      // timestamp of last packet bitrate was calculated
     size_t last_br_bytes;   // summed packet sizes since last bitrate calculation
     double bitrate;
     int64_t last_pos;
+    // Packet queue. Packets from head to reader_head (exclusive) were already
+    // returned to the decoder, and are kept for seeking only. If the packet
+    // cache is disabled, head==reader_head.
     struct demux_packet *head;
+    struct demux_packet *reader_head; // next packet moved to the ring
     struct demux_packet *tail;
+    // All keyframes in the queue, in queue order.
+    struct demux_keyframe *keyframes;
+    int num_keyframes;
+    // Packets taken from reader_head for the reader, which it can take without
+    // locking (single producer/single consumer). Entries are written only with
+    // in->lock held, and taken only by the reader, with or without the lock.
+    // Moving the reader position (seeks, flushes) frees the entries; this is
+    // done by the reader thread too (it calls demux_seek() etc.).
+    struct demux_packet *ring[RING_PACKS];
+    double ring_ts[RING_PACKS]; // packet_ts() of the entries (only locked)
+    atomic_uint ring_rd;    // next entry the reader takes
+    atomic_uint ring_wr;    // next entry written (ring_wr - ring_rd queued)
 };
 
 // Return "a", or if that is NOPTS, return "def".
@@ -168,19 +207,92 @@ struct demux_stream {
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
+static void ds_fill_ring(struct demux_stream *ds);
+
+static double packet_ts(struct demux_packet *dp)
+{
+    return dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+}
+
+// Lock the packet queues from the user thread, and account for contention
+// with the demuxer thread.
+static void lock_user(struct demux_internal *in)
+{
+    if (pthread_mutex_trylock(&in->lock) != 0) {
+        int64_t start = mp_time_us();
+        pthread_mutex_lock(&in->lock);
+        in->lock_stats.waits++;
+        in->lock_stats.wait_time += (mp_time_us() - start) / 1e6;
+    }
+    in->lock_stats.locks++;
+}
+
+static unsigned int ds_ring_packs(struct demux_stream *ds)
+{
+    return atomic_load(&ds->ring_wr) - atomic_load(&ds->ring_rd);
+}
+
+// Whether the reader can get a packet without the demuxer reading more.
+// called locked
+static bool ds_has_packet(struct demux_stream *ds)
+{
+    return ds->reader_head || ds_ring_packs(ds);
+}
+
+// Timestamp of the next packet the reader takes, or of the last one if the
+// ring is empty. (base_ts is ahead of this by the packets in the ring.)
+// called locked
+static double ds_reader_ts(struct demux_stream *ds)
+{
+    if (!ds_ring_packs(ds))
+        return ds->base_ts;
+    // The entry can't be overwritten while the lock is held.
+    double ts = ds->ring_ts[atomic_load(&ds->ring_rd) % RING_PACKS];
+    return PTS_OR_DEF(ts, ds->base_ts);
+}
+
+// Take the next packet from the ring, or return NULL if it's empty. Called by
+// the reader only; doesn't need the lock.
+static struct demux_packet *ds_ring_pop(struct demux_stream *ds)
+{
+    unsigned int rd = atomic_load(&ds->ring_rd);
+    if (rd == atomic_load(&ds->ring_wr))
+        return NULL;
+    struct demux_packet *pkt = ds->ring[rd % RING_PACKS];
+    atomic_store(&ds->ring_rd, rd + 1); // the producer can reuse the entry now
+
+    // This implies this function is actually called from "the" user thread.
+    if (pkt->pos >= ds->in->d_user->filepos)
+        ds->in->d_user->filepos = pkt->pos;
+
+    return pkt;
+}
+
+// Free the packets in the ring. Called by the reader only, and locked.
+static void ds_flush_ring(struct demux_stream *ds)
+{
+    unsigned int wr = atomic_load(&ds->ring_wr);
+    for (unsigned int rd = atomic_load(&ds->ring_rd); rd != wr; rd++)
+        talloc_free(ds->ring[rd % RING_PACKS]);
+    atomic_store(&ds->ring_rd, wr);
+}
 
 // called locked
 static void ds_flush(struct demux_stream *ds)
 {
+    ds_flush_ring(ds);
     demux_packet_t *dp = ds->head;
     while (dp) {
         demux_packet_t *dn = dp->next;
         free_demux_packet(dp);
         dp = dn;
     }
-    ds->head = ds->tail = NULL;
+    ds->head = ds->reader_head = ds->tail = NULL;
     ds->packs = 0;
     ds->bytes = 0;
+    ds->back_packs = 0;
+    ds->back_bytes = 0;
+    ds->num_keyframes = 0;
     ds->last_ts = ds->base_ts = ds->last_br_ts = MP_NOPTS_VALUE;
     ds->last_br_bytes = 0;
     ds->bitrate = -1;
@@ -241,6 +353,7 @@ void free_demuxer(demuxer_t *demuxer)
         demuxer->desc->close(in->d_thread);
     for (int n = 0; n < demuxer->num_streams; n++)
         ds_flush(demuxer->streams[n]->ds);
+    demux_packet_pool_unref(in->packet_pool_size);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(in->nav_event);
@@ -285,6 +398,13 @@ void demux_stop_thread(struct demuxer *demuxer)
     }
 }
 
+// Whether demux_start_thread() was called (and succeeded). If so, packets can
+// be read from other threads with demux_read_packet_async().
+bool demux_is_threaded(struct demuxer *demuxer)
+{
+    return demuxer->in->threading;
+}
+
 // The demuxer thread will call cb(ctx) if there's a new packet, or EOF is reached.
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx)
 {
@@ -334,6 +454,7 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     dp->stream = stream->index;
     dp->next = NULL;
 
+    bool was_empty = !ds_has_packet(ds);
     ds->last_pos = dp->pos;
     ds->packs++;
     ds->bytes += dp->len;
@@ -345,6 +466,8 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         // first packet in stream
         ds->head = ds->tail = dp;
     }
+    if (!ds->reader_head)
+        ds->reader_head = dp;
 
     // obviously not true anymore
     ds->eof = false;
@@ -355,20 +478,35 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     if (stream->type != STREAM_VIDEO && dp->pts == MP_NOPTS_VALUE)
         dp->pts = dp->dts;
 
-    double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+    double ts = packet_ts(dp);
     if (ts != MP_NOPTS_VALUE && (ts > ds->last_ts || ts + 10 < ds->last_ts))
         ds->last_ts = ts;
     if (ds->base_ts == MP_NOPTS_VALUE)
         ds->base_ts = ds->last_ts;
 
+    if (in->back_bytes > 0 && dp->keyframe) {
+        struct demux_keyframe kf = {
+            .ts = PTS_OR_DEF(dp->pts, dp->dts),
+            .pkt = dp,
+        };
+        MP_TARRAY_APPEND(ds, ds->keyframes, ds->num_keyframes, kf);
+    }
+
     MP_DBG(in, "append packet to %s: size=%d pts=%f dts=%f pos=%"PRIi64" "
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
            dp->len, dp->pts, dp->dts, dp->pos, ds->packs, ds->bytes);
 
-    if (ds->in->wakeup_cb && !ds->head->next)
-        ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
+    ds_fill_ring(ds);
+
+    // Don't call the wakeup callback with the lock held; it usually makes a
+    // syscall, and the player thread might be waiting for the lock.
+    bool wakeup = in->wakeup_cb && was_empty;
+    void (*wakeup_cb)(void *ctx) = in->wakeup_cb;
+    void *wakeup_cb_ctx = in->wakeup_cb_ctx;
     pthread_cond_signal(&in->wakeup);
     pthread_mutex_unlock(&in->lock);
+    if (wakeup)
+        wakeup_cb(wakeup_cb_ctx);
     return 1;
 }
 
@@ -386,7 +524,7 @@ static bool read_packet(struct demux_internal *in)
     for (int n = 0; n < in->d_buffer->num_streams; n++) {
         struct demux_stream *ds = in->d_buffer->streams[n]->ds;
         active |= ds->active;
-        read_more |= ds->active && !ds->head;
+        read_more |= ds->active && !ds_has_packet(ds);
         packs += ds->packs;
         bytes += ds->bytes;
         if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
@@ -409,7 +547,7 @@ static bool read_packet(struct demux_internal *in)
         }
         for (int n = 0; n < in->d_buffer->num_streams; n++) {
             struct demux_stream *ds = in->d_buffer->streams[n]->ds;
-            ds->eof |= !ds->head;
+            ds->eof |= !ds_has_packet(ds);
         }
         pthread_cond_signal(&in->wakeup);
         return false;
@@ -454,7 +592,7 @@ static void ds_get_packets(struct demux_stream *ds)
     MP_DBG(in, "reading packet for %s\n", t);
     in->eof = false; // force retry
     ds->eof = false;
-    while (ds->selected && !ds->head && !ds->eof) {
+    while (ds->selected && !ds_has_packet(ds) && !ds->eof) {
         ds->active = true;
         // Note: the following code marks EOF if it can't continue
         if (in->threading) {
@@ -480,7 +618,7 @@ static void start_refreshing(struct demux_internal *in)
     for (int n = 0; n < demux->num_streams; n++) {
         struct demux_stream *ds = demux->streams[n]->ds;
         if (ds->type == STREAM_VIDEO || ds->type == STREAM_AUDIO)
-            start_ts = MP_PTS_MIN(start_ts, ds->base_ts);
+            start_ts = MP_PTS_MIN(start_ts, ds_reader_ts(ds));
     }
 
     if (start_ts == MP_NOPTS_VALUE || !demux->desc->seek || !demux->seekable ||
@@ -571,19 +709,96 @@ static void *demux_thread(void *pctx)
     return NULL;
 }
 
-static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+// Free the oldest packet of the stream, which must have been returned to the
+// decoder already.
+static void ds_drop_head(struct demux_stream *ds)
 {
+    struct demux_packet *dp = ds->head;
+    assert(dp && dp != ds->reader_head);
+    if (ds->num_keyframes && ds->keyframes[0].pkt == dp)
+        MP_TARRAY_REMOVE_AT(ds->keyframes, ds->num_keyframes, 0);
+    ds->head = dp->next;
     if (!ds->head)
+        ds->tail = NULL;
+    ds->back_packs--;
+    ds->back_bytes -= dp->len;
+    free_demux_packet(dp);
+}
+
+// Drop already returned packets until the packet cache is within the
+// configured limits. Leading non-keyframe packets are always dropped, because
+// they are useless for seeking.
+static void prune_old_packets(struct demux_internal *in)
+{
+    struct demuxer *demux = in->d_buffer;
+    while (1) {
+        size_t total = 0;
+        struct demux_stream *oldest = NULL;
+        double oldest_ts = MP_NOPTS_VALUE;
+        for (int n = 0; n < demux->num_streams; n++) {
+            struct demux_stream *ds = demux->streams[n]->ds;
+            // Drop everything that can't be a seek target, or is too old.
+            while (ds->head && ds->head != ds->reader_head) {
+                double ts = packet_ts(ds->head);
+                bool too_old = in->back_secs > 0 && ts != MP_NOPTS_VALUE &&
+                               ds->base_ts != MP_NOPTS_VALUE &&
+                               ds->base_ts - ts > in->back_secs;
+                bool seekable = ds->head->keyframe || ds->type == STREAM_SUB;
+                if (seekable && !too_old)
+                    break;
+                ds_drop_head(ds);
+            }
+            total += ds->back_bytes;
+            if (ds->back_packs) {
+                double ts = packet_ts(ds->head);
+                if (!oldest || ts == MP_NOPTS_VALUE ||
+                    (oldest_ts != MP_NOPTS_VALUE && ts < oldest_ts))
+                {
+                    oldest = ds;
+                    oldest_ts = ts;
+                }
+            }
+        }
+        if (total <= in->back_bytes || !oldest)
+            break;
+        // Drop the keyframe; following non-keyframes are dropped by the
+        // loop above.
+        ds_drop_head(oldest);
+    }
+}
+
+static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+{
+    struct demux_packet *pkt = ds->reader_head;
+    if (!pkt)
         return NULL;
-    struct demux_packet *pkt = ds->head;
-    ds->head = pkt->next;
+
+    if (ds->in->back_bytes > 0) {
+        // Keep the packet for seeking, and return a new reference to it.
+        // Copy it before touching the queue, so that on failure it stays
+        // queued and can be read again.
+        struct demux_packet *copy = demux_copy_packet(pkt);
+        if (!copy) {
+            MP_ERR(ds->in, "Out of memory while reading a packet.\n");
+            return NULL;
+        }
+        ds->reader_head = pkt->next;
+        ds->bytes -= pkt->len;
+        ds->packs--;
+        ds->back_packs++;
+        ds->back_bytes += pkt->len;
+        pkt = copy;
+    } else {
+        ds->reader_head = pkt->next;
+        ds->bytes -= pkt->len;
+        ds->packs--;
+        ds->head = ds->reader_head;
+        if (!ds->head)
+            ds->tail = NULL;
+    }
     pkt->next = NULL;
-    if (!ds->head)
-        ds->tail = NULL;
-    ds->bytes -= pkt->len;
-    ds->packs--;
 
-    double ts = pkt->dts == MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    double ts = packet_ts(pkt);
     if (ts != MP_NOPTS_VALUE)
         ds->base_ts = ts;
 
@@ -603,13 +818,36 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
     }
     ds->last_br_bytes += pkt->len;
 
-    // This implies this function is actually called from "the" user thread.
-    if (pkt->pos >= ds->in->d_user->filepos)
-        ds->in->d_user->filepos = pkt->pos;
+    if (ds->in->back_bytes > 0)
+        prune_old_packets(ds->in);
 
     return pkt;
 }
 
+// Move packets from reader_head to the ring, until it's full.
+// called locked
+static void ds_fill_ring(struct demux_stream *ds)
+{
+    unsigned int wr = atomic_load(&ds->ring_wr);
+    while (wr - atomic_load(&ds->ring_rd) < RING_PACKS) {
+        struct demux_packet *pkt = dequeue_packet(ds);
+        if (!pkt)
+            break;
+        ds->ring[wr % RING_PACKS] = pkt;
+        ds->ring_ts[wr % RING_PACKS] = packet_ts(pkt);
+        wr++;
+        atomic_store(&ds->ring_wr, wr); // makes the entry visible to the reader
+    }
+}
+
+// Return the next packet for the reader, or NULL if none is queued.
+// called locked
+static struct demux_packet *take_packet(struct demux_stream *ds)
+{
+    ds_fill_ring(ds);
+    return ds_ring_pop(ds);
+}
+
 // Read a packet from the given stream. The returned packet belongs to the
 // caller, who has to free it with talloc_free(). Might block. Returns NULL
 // on EOF.
@@ -618,9 +856,9 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
     struct demux_stream *ds = sh ? sh->ds : NULL;
     struct demux_packet *pkt = NULL;
     if (ds) {
-        pthread_mutex_lock(&ds->in->lock);
+        lock_user(ds->in);
         ds_get_packets(ds);
-        pkt = dequeue_packet(ds);
+        pkt = take_packet(ds);
         pthread_cond_signal(&ds->in->wakeup); // possibly read more
         pthread_mutex_unlock(&ds->in->lock);
     }
@@ -642,9 +880,25 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
     int r = -1;
     *out_pkt = NULL;
     if (ds) {
-        if (ds->in->threading) {
-            pthread_mutex_lock(&ds->in->lock);
-            *out_pkt = dequeue_packet(ds);
+        struct demux_internal *in = ds->in;
+        if (in->threading) {
+            // Packets moved to the ring can be taken without the lock. Refill
+            // it when it's half empty, but don't wait if the demuxer thread
+            // holds the lock: it refills the ring when it adds packets.
+            *out_pkt = ds_ring_pop(ds);
+            if (*out_pkt) {
+                atomic_fetch_add(&in->lockless_reads, 1);
+                if (ds_ring_packs(ds) <= RING_PACKS / 2 &&
+                    pthread_mutex_trylock(&in->lock) == 0)
+                {
+                    ds_fill_ring(ds);
+                    pthread_cond_signal(&in->wakeup); // possibly read more
+                    pthread_mutex_unlock(&in->lock);
+                }
+                return 1;
+            }
+            lock_user(in);
+            *out_pkt = take_packet(ds);
             r = *out_pkt ? 1 : ((ds->eof || !ds->selected) ? -1 : 0);
             ds->active = ds->selected; // enable readahead
             ds->in->eof = false; // force retry
@@ -665,10 +919,11 @@ double demux_get_next_pts(struct sh_stream *sh)
 {
     double res = MP_NOPTS_VALUE;
     if (sh) {
-        pthread_mutex_lock(&sh->ds->in->lock);
+        lock_user(sh->ds->in);
         ds_get_packets(sh->ds);
-        if (sh->ds->head)
-            res = sh->ds->head->pts;
+        ds_fill_ring(sh->ds);
+        if (ds_ring_packs(sh->ds))
+            res = sh->ds->ring[atomic_load(&sh->ds->ring_rd) % RING_PACKS]->pts;
         pthread_mutex_unlock(&sh->ds->in->lock);
     }
     return res;
@@ -679,8 +934,8 @@ bool demux_has_packet(struct sh_stream *sh)
 {
     bool has_packet = false;
     if (sh) {
-        pthread_mutex_lock(&sh->ds->in->lock);
-        has_packet = sh->ds->head;
+        lock_user(sh->ds->in);
+        has_packet = ds_has_packet(sh->ds);
         pthread_mutex_unlock(&sh->ds->in->lock);
     }
     return has_packet;
@@ -695,7 +950,7 @@ struct demux_packet *demux_read_any_packet(struct demuxer *demuxer)
         for (int n = 0; n < demuxer->num_streams; n++) {
             struct sh_stream *sh = demuxer->streams[n];
             sh->ds->active = sh->ds->selected; // force read_packet() to read
-            struct demux_packet *pkt = dequeue_packet(sh->ds);
+            struct demux_packet *pkt = take_packet(sh->ds);
             if (pkt)
                 return pkt;
         }
@@ -951,9 +1206,13 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = demuxer->opts->demuxer_min_secs,
         .min_packs = demuxer->opts->demuxer_min_packs,
         .min_bytes = demuxer->opts->demuxer_min_bytes,
+        .back_bytes = demuxer->opts->demuxer_back_bytes,
+        .back_secs = demuxer->opts->demuxer_back_secs,
+        .packet_pool_size = demuxer->opts->demuxer_packet_pool_size,
     };
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
+    demux_packet_pool_ref(in->packet_pool_size);
 
     if (stream->uncached_stream)
         in->min_secs = MPMAX(in->min_secs, demuxer->opts->demuxer_min_secs_cache);
@@ -1007,6 +1266,126 @@ static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
 
+// Cache of probe results for local files, keyed by path, size and mtime.
+// Reopening a known file skips trying all other demuxers, and lets demux_lavf
+// skip format probing. One instance is shared by the player (mpv_global).
+#define PROBE_CACHE_SIZE 64
+
+struct probe_cache_entry {
+    char *path;
+    int64_t size;
+    int64_t mtime;
+    const struct demuxer_desc *desc;
+    enum demux_check check;
+    char *lavf_format;
+};
+
+struct demux_probe_cache {
+    pthread_mutex_t lock;
+    struct probe_cache_entry entries[PROBE_CACHE_SIZE];
+    int next; // entry to replace next (round robin)
+};
+
+static void probe_cache_destroy(void *ptr)
+{
+    struct demux_probe_cache *cache = ptr;
+    pthread_mutex_destroy(&cache->lock);
+}
+
+struct demux_probe_cache *demux_probe_cache_create(void *talloc_ctx)
+{
+    struct demux_probe_cache *cache =
+        talloc_zero(talloc_ctx, struct demux_probe_cache);
+    pthread_mutex_init(&cache->lock, NULL);
+    talloc_set_destructor(cache, probe_cache_destroy);
+    return cache;
+}
+
+// Fill in the key fields of *key. Returns false if the stream isn't a file.
+static bool get_probe_key(void *ta_ctx, struct stream *stream,
+                          struct probe_cache_entry *key)
+{
+    struct stream *orig = stream->uncached_stream ? stream->uncached_stream
+                                                  : stream;
+    if (orig->type != STREAMTYPE_FILE)
+        return false;
+    char *path = mp_file_url_to_filename(ta_ctx, bstr0(orig->url));
+    if (!path)
+        path = orig->path;
+    struct stat st;
+    if (!path || stat(path, &st) || !S_ISREG(st.st_mode))
+        return false;
+    *key = (struct probe_cache_entry){
+        .path = path,
+        .size = st.st_size,
+        .mtime = st.st_mtime,
+    };
+    return true;
+}
+
+static int probe_cache_find(struct demux_probe_cache *cache,
+                            struct probe_cache_entry *key)
+{
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        struct probe_cache_entry *e = &cache->entries[n];
+        if (e->path && strcmp(e->path, key->path) == 0 &&
+            e->size == key->size && e->mtime == key->mtime)
+            return n;
+    }
+    return -1;
+}
+
+// On a hit, set key->desc/check/lavf_format (lavf_format allocated on ta_ctx).
+static bool probe_cache_lookup(struct demux_probe_cache *cache, void *ta_ctx,
+                               struct probe_cache_entry *key)
+{
+    pthread_mutex_lock(&cache->lock);
+    int n = probe_cache_find(cache, key);
+    if (n >= 0) {
+        struct probe_cache_entry *e = &cache->entries[n];
+        key->desc = e->desc;
+        key->check = e->check;
+        key->lavf_format = talloc_strdup(ta_ctx, e->lavf_format);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return n >= 0;
+}
+
+// Add or replace the entry for key. If desc is NULL, remove it.
+static void probe_cache_store(struct demux_probe_cache *cache,
+                              struct probe_cache_entry *key,
+                              const struct demuxer_desc *desc,
+                              enum demux_check check, const char *filetype)
+{
+    pthread_mutex_lock(&cache->lock);
+    int n = probe_cache_find(cache, key);
+    if (n < 0 && desc) {
+        n = cache->next;
+        cache->next = (cache->next + 1) % PROBE_CACHE_SIZE;
+    }
+    if (n >= 0) {
+        struct probe_cache_entry *e = &cache->entries[n];
+        talloc_free(e->path);
+        *e = (struct probe_cache_entry){0};
+        if (desc) {
+            *e = (struct probe_cache_entry){
+                .path = talloc_strdup(cache, key->path),
+                .size = key->size,
+                .mtime = key->mtime,
+                .desc = desc,
+                .check = check,
+            };
+            // libavformat reports the full name list, e.g. "mov,mp4,m4a,...",
+            // while av_find_input_format() wants a single name.
+            if (desc == &demuxer_desc_lavf && filetype) {
+                e->lavf_format = talloc_strndup(e->path, filetype,
+                                                strcspn(filetype, ","));
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
 // params can be NULL
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global)
@@ -1016,6 +1395,8 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
     char *force_format = params ? params->force_format : NULL;
+    double start_time = mp_time_sec();
+    int tries = 0;
 
     if (!force_format)
         force_format = stream->demuxer;
@@ -1036,14 +1417,41 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    struct demux_probe_cache *cache = global->demux_probe_cache;
+    struct probe_cache_entry key;
+    bool use_cache = cache && !check_desc &&
+                     global->opts->demuxer_probe_cache &&
+                     get_probe_key(log, stream, &key);
+
+    if (use_cache && probe_cache_lookup(cache, log, &key)) {
+        mp_verbose(log, "Using cached probe result: %s\n", key.desc->name);
+        struct demuxer_params p = {0};
+        if (params)
+            p = *params;
+        p.lavf_format_hint = key.lavf_format;
+        tries++;
+        demuxer = open_given_type(global, log, key.desc, stream, &p, key.check);
+        if (demuxer) {
+            talloc_steal(demuxer, log);
+            log = NULL;
+            goto done;
+        }
+        mp_verbose(log, "Cached probe result failed, probing normally.\n");
+        probe_cache_store(cache, &key, NULL, 0, NULL);
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
         for (int n = 0; demuxer_list[n]; n++) {
             const struct demuxer_desc *desc = demuxer_list[n];
             if (!check_desc || desc == check_desc) {
+                tries++;
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
+                    if (use_cache)
+                        probe_cache_store(cache, &key, desc, level,
+                                          demuxer->filetype);
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -1053,6 +1461,10 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     }
 
 done:
+    if (demuxer) {
+        MP_VERBOSE(demuxer, "Opening took %.3f seconds (%d demuxers tried).\n",
+                   mp_time_sec() - start_time, tries);
+    }
     talloc_free(log);
     return demuxer;
 }
@@ -1096,6 +1508,120 @@ void demux_flush(demuxer_t *demuxer)
     pthread_mutex_unlock(&demuxer->in->lock);
 }
 
+// Return the cached keyframe closest to pts, in the direction given by flags.
+static struct demux_keyframe *find_cached_keyframe(struct demux_stream *ds,
+                                                   double pts, int flags)
+{
+    struct demux_keyframe *res = NULL;
+    for (int n = 0; n < ds->num_keyframes; n++) {
+        struct demux_keyframe *kf = &ds->keyframes[n];
+        if (kf->ts == MP_NOPTS_VALUE)
+            continue;
+        if (flags & SEEK_FORWARD) {
+            if (kf->ts >= pts && (!res || kf->ts < res->ts))
+                res = kf;
+        } else {
+            if (kf->ts <= pts && (!res || kf->ts > res->ts))
+                res = kf;
+        }
+    }
+    return res;
+}
+
+// Make dp the next packet returned to the decoder (NULL: after the last
+// packet), and recompute the queue statistics.
+static void ds_set_reader_head(struct demux_stream *ds, struct demux_packet *dp)
+{
+    ds->reader_head = dp;
+    ds->packs = ds->bytes = 0;
+    ds->back_packs = ds->back_bytes = 0;
+    bool back = true;
+    for (struct demux_packet *cur = ds->head; cur; cur = cur->next) {
+        back &= cur != dp;
+        if (back) {
+            ds->back_packs++;
+            ds->back_bytes += cur->len;
+        } else {
+            ds->packs++;
+            ds->bytes += cur->len;
+        }
+    }
+    ds->base_ts = dp ? packet_ts(dp) : ds->last_ts;
+    ds->last_br_ts = MP_NOPTS_VALUE;
+    ds->last_br_bytes = 0;
+    ds->bitrate = -1;
+}
+
+// Try to satisfy the seek from the packet cache, without touching the stream
+// or the demuxer implementation. Returns true on success.
+// must be called locked
+static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
+{
+    struct demuxer *demux = in->d_buffer;
+
+    if (in->back_bytes <= 0 || !(flags & SEEK_ABSOLUTE) ||
+        (flags & SEEK_FACTOR) || in->seeking || in->tracks_switched ||
+        demux->ts_resets_possible)
+        return false;
+
+    for (int n = 0; n < demux->num_streams; n++) {
+        if (demux->streams[n]->ds->refreshing)
+            return false;
+    }
+
+    // Video keyframes are sparse, so they determine where playback resumes.
+    // All other streams are positioned relative to that.
+    double target = MP_NOPTS_VALUE;
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (ds->selected && ds->type == STREAM_VIDEO) {
+            struct demux_keyframe *kf = find_cached_keyframe(ds, pts, flags);
+            if (!kf)
+                return false;
+            target = MP_PTS_MIN(target, kf->ts);
+        }
+    }
+    if (target == MP_NOPTS_VALUE)
+        target = pts;
+
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (!ds->selected || ds->type == STREAM_SUB)
+            continue;
+        if (ds->last_ts == MP_NOPTS_VALUE || target > ds->last_ts ||
+            !find_cached_keyframe(ds, target, SEEK_BACKWARD))
+            return false;
+    }
+
+    MP_VERBOSE(in, "seeking to %f within packet cache\n", target);
+
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+        struct demux_packet *dp = NULL;
+        if (ds->type == STREAM_SUB) {
+            // Subtitles are sparse; resume at the first packet which might
+            // still be visible at the target.
+            for (dp = ds->head; dp; dp = dp->next) {
+                double end = PTS_OR_DEF(dp->pts, dp->dts);
+                if (end != MP_NOPTS_VALUE && dp->duration > 0)
+                    end += dp->duration;
+                if (end == MP_NOPTS_VALUE || end >= target)
+                    break;
+            }
+        } else {
+            dp = find_cached_keyframe(ds, target, SEEK_BACKWARD)->pkt;
+        }
+        ds_flush_ring(ds);
+        ds_set_reader_head(ds, dp);
+    }
+
+    prune_old_packets(in);
+    in->d_user->filepos = -1;
+    return true;
+}
+
 int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 {
     struct demux_internal *in = demuxer->in;
@@ -1124,13 +1650,15 @@ int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 
     pthread_mutex_lock(&in->lock);
 
-    flush_locked(demuxer);
-    in->seeking = true;
-    in->seek_flags = flags;
-    in->seek_pts = rel_seek_secs;
+    if (!try_seek_cache(in, rel_seek_secs, flags)) {
+        flush_locked(demuxer);
+        in->seeking = true;
+        in->seek_flags = flags;
+        in->seek_pts = rel_seek_secs;
 
-    if (!in->threading)
-        execute_seek(in);
+        if (!in->threading)
+            execute_seek(in);
+    }
 
     pthread_cond_signal(&in->wakeup);
     pthread_mutex_unlock(&in->lock);
@@ -1204,6 +1732,7 @@ bool demux_stream_is_selected(struct sh_stream *stream)
     if (!stream)
         return false;
     bool r = false;
+    // Not lock_user(): also called from the demuxer thread.
     pthread_mutex_lock(&stream->ds->in->lock);
     r = stream->ds->selected;
     pthread_mutex_unlock(&stream->ds->in->lock);
@@ -1283,6 +1812,8 @@ static void update_cache(struct demux_internal *in)
     int64_t stream_cache_size = -1;
     int64_t stream_cache_fill = -1;
     int stream_cache_idle = -1;
+    double stream_cache_speed = -1;
+    double stream_cache_underrun = -1;
     struct mp_nav_event *nav_event = NULL;
 
     pthread_mutex_lock(&in->lock);
@@ -1301,6 +1832,9 @@ static void update_cache(struct demux_internal *in)
     stream_control(stream, STREAM_CTRL_GET_CACHE_SIZE, &stream_cache_size);
     stream_control(stream, STREAM_CTRL_GET_CACHE_FILL, &stream_cache_fill);
     stream_control(stream, STREAM_CTRL_GET_CACHE_IDLE, &stream_cache_idle);
+    stream_control(stream, STREAM_CTRL_GET_CACHE_SPEED, &stream_cache_speed);
+    stream_control(stream, STREAM_CTRL_GET_CACHE_UNDERRUN_TIME,
+                   &stream_cache_underrun);
 
     pthread_mutex_lock(&in->lock);
     in->time_length = time_length;
@@ -1308,6 +1842,8 @@ static void update_cache(struct demux_internal *in)
     in->stream_cache_size = stream_cache_size;
     in->stream_cache_fill = stream_cache_fill;
     in->stream_cache_idle = stream_cache_idle;
+    in->stream_cache_speed = stream_cache_speed;
+    in->stream_cache_underrun = stream_cache_underrun;
     if (stream_metadata) {
         talloc_free(in->stream_metadata);
         in->stream_metadata = talloc_steal(in, stream_metadata);
@@ -1342,6 +1878,16 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
             return STREAM_UNSUPPORTED;
         *(int *)arg = in->stream_cache_idle;
         return STREAM_OK;
+    case STREAM_CTRL_GET_CACHE_SPEED:
+        if (in->stream_cache_speed < 0)
+            return STREAM_UNSUPPORTED;
+        *(double *)arg = in->stream_cache_speed;
+        return STREAM_OK;
+    case STREAM_CTRL_GET_CACHE_UNDERRUN_TIME:
+        if (in->stream_cache_underrun < 0)
+            return STREAM_UNSUPPORTED;
+        *(double *)arg = in->stream_cache_underrun;
+        return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (in->stream_size < 0)
             return STREAM_UNSUPPORTED;
@@ -1398,8 +1944,8 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         for (int n = 0; n < in->d_user->num_streams; n++) {
             struct demux_stream *ds = in->d_user->streams[n]->ds;
             if (ds->active) {
-                r->underrun |= !ds->head && !ds->eof;
-                r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], ds->base_ts);
+                r->underrun |= !ds_has_packet(ds) && !ds->eof;
+                r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], ds_reader_ts(ds));
                 r->ts_range[1] = MP_PTS_MIN(r->ts_range[1], ds->last_ts);
                 num_packets += ds->packs;
             }
@@ -1412,6 +1958,12 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             r->ts_duration = 0;
         return DEMUXER_CTRL_OK;
     }
+    case DEMUXER_CTRL_GET_LOCK_STATS: {
+        struct demux_ctrl_lock_stats *r = arg;
+        *r = in->lock_stats;
+        r->lockless = atomic_load(&in->lockless_reads);
+        return DEMUXER_CTRL_OK;
+    }
     case DEMUXER_CTRL_GET_NAV_EVENT:
         if (!in->nav_event)
             return DEMUXER_CTRL_NOTIMPL;
@@ -1428,7 +1980,7 @@ int demux_control(demuxer_t *demuxer, int cmd, void *arg)
     struct demux_internal *in = demuxer->in;
 
     if (in->threading) {
-        pthread_mutex_lock(&in->lock);
+        lock_user(in);
         int cr = cached_demux_control(in, cmd, arg);
         pthread_mutex_unlock(&in->lock);
         if (cr != DEMUXER_CTRL_DONTKNOW)
@@ -49,6 +49,7 @@ enum demux_ctrl {
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_NAV_EVENT,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
+    DEMUXER_CTRL_GET_LOCK_STATS,    // struct demux_ctrl_lock_stats
 };
 
 struct demux_ctrl_reader_state {
@@ -57,6 +58,14 @@ struct demux_ctrl_reader_state {
     double ts_duration;
 };
 
+// Contention of the packet queue lock, as seen from the player thread.
+struct demux_ctrl_lock_stats {
+    int64_t locks;      // number of times the player locked the queues
+    int64_t waits;      // number of times it had to wait for the demux thread
+    double wait_time;   // total time spent waiting (seconds)
+    int64_t lockless;   // number of packets read without locking
+};
+
 struct demux_ctrl_stream_ctrl {
     int ctrl;
     void *arg;
@@ -171,6 +180,7 @@ struct demuxer_params {
     bool *matroska_was_valid;
     bool expect_subtitle;
     bool disable_cache; // demux_open_url() only
+    char *lavf_format_hint; // internal, set by demux_open() probe cache
 };
 
 typedef struct demuxer {
@@ -258,6 +268,9 @@ struct sh_stream *new_sh_stream(struct demuxer *demuxer, enum stream_type type);
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global);
 
+struct demux_probe_cache;
+struct demux_probe_cache *demux_probe_cache_create(void *talloc_ctx);
+
 struct mp_cancel;
 struct demuxer *demux_open_url(const char *url,
                                struct demuxer_params *params,
@@ -266,6 +279,7 @@ struct demuxer *demux_open_url(const char *url,
 
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
+bool demux_is_threaded(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 
 bool demux_cancel_test(struct demuxer *demuxer);
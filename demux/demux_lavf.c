@@ -36,6 +36,7 @@
 #include <libavutil/opt.h>
 
 #include "options/options.h"
+#include "osdep/timer.h"
 #include "common/msg.h"
 #include "common/tags.h"
 #include "common/av_common.h"
@@ -302,6 +303,11 @@ static int lavf_check_file(demuxer_t *demuxer, enum demux_check check)
         format = s->lavf_type;
     if (!format)
         format = avdevice_format;
+    bool hinted = false;
+    if (!format && demuxer->params && demuxer->params->lavf_format_hint) {
+        format = demuxer->params->lavf_format_hint;
+        hinted = true;
+    }
     if (format) {
         if (strcmp(format, "help") == 0) {
             list_formats(demuxer);
@@ -345,7 +351,7 @@ static int lavf_check_file(demuxer_t *demuxer, enum demux_check check)
         if (priv->avif) {
             MP_VERBOSE(demuxer, "Found '%s' at score=%d size=%d%s.\n",
                        priv->avif->name, score, avpd.buf_size,
-                       forced_format ? " (forced)" : "");
+                       hinted ? " (cached)" : forced_format ? " (forced)" : "");
 
             for (int n = 0; format_hacks[n].ff_name; n++) {
                 const struct format_hack *entry = &format_hacks[n];
@@ -799,13 +805,15 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     av_dict_free(&dopts);
 
     priv->avfc = avfc;
+    double start_time = mp_time_sec();
     if (avformat_find_stream_info(avfc, NULL) < 0) {
         MP_ERR(demuxer, "av_find_stream_info() failed\n");
         return -1;
     }
 
     MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
-               " bytes.\n", stream_tell(demuxer->stream));
+               " bytes and %.3f seconds.\n", stream_tell(demuxer->stream),
+               mp_time_sec() - start_time);
 
     for (i = 0; i < avfc->nb_chapters; i++) {
         AVChapter *c = avfc->chapters[i];
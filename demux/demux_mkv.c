@@ -26,6 +26,8 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -45,6 +47,11 @@
 #include "common/av_common.h"
 #include "options/options.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "misc/thread_pool.h"
 #include "misc/bstr.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -183,6 +190,23 @@ typedef struct mkv_demuxer {
     bool index_has_durations;
 
     bool eof_warning;
+
+    struct mkv_index_scan *index_scan;
+
+    // --demuxer-mkv-parse-threads: blocks read ahead, and being parsed
+    struct mp_thread_pool *parse_pool;
+    struct block_info *batch;
+    int num_batch, batch_pos;
+    pthread_mutex_t parse_lock;
+    pthread_cond_t parse_wakeup;
+    int parse_pending;          // protected by parse_lock
+
+    // read_block() may borrow SimpleBlock data from the stream
+    bool borrow_blocks;
+
+    // Throughput statistics, logged on close
+    double parse_time;
+    int64_t parse_bytes;
 } mkv_demuxer_t;
 
 #define OPT_BASE_STRUCT struct demux_mkv_opts
@@ -191,6 +215,9 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs;
     int probe_duration;
     int fix_timestamps;
+    int index_scan;
+    char *index_dir;
+    int parse_threads;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -200,6 +227,9 @@ const struct m_sub_options demux_mkv_conf = {
                    M_OPT_MIN, .min = 0),
         OPT_FLAG("probe-video-duration", probe_duration, 0),
         OPT_FLAG("fix-timestamps", fix_timestamps, 0),
+        OPT_FLAG("index-scan", index_scan, 0),
+        OPT_STRING("index-dir", index_dir, M_OPT_FILE),
+        OPT_INTRANGE("parse-threads", parse_threads, 0, 0, 16),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -1766,6 +1796,397 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
     return 0;
 }
 
+// Background scan of all clusters of a file without Cues, which builds the
+// same kind of index as index_block() does during playback. Uses a separate
+// stream, so it doesn't interfere with the demuxer thread.
+struct mkv_index_scan {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    char *url;
+    char *index_file;           // sidecar file to write when done, or NULL
+    int64_t file_size;
+    unsigned char segment_uid[16];
+    int64_t segment_start, segment_end;
+    int64_t first_cluster;
+    uint64_t tc_scale;
+
+    struct mkv_index_scan_track {
+        uint64_t tnum;
+        int type;               // MATROSKA_TRACK_*
+        bool has_last;
+        int64_t last_tc;
+        int64_t last_cluster;
+    } *tracks;
+    int num_tracks;
+
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    // --- protected by lock
+    mkv_index_t *entries;       // sorted by cluster position
+    size_t num_entries;
+    bool done;                  // scan finished (successfully or not)
+    bool complete;              // scan reached the end of the file
+};
+
+#define INDEX_FILE_HEADER "mpv-mkv-index 1"
+
+static char *index_file_path(void *talloc_ctx, struct demuxer *demuxer)
+{
+    struct demux_mkv_opts *opts = demuxer->opts->demux_mkv;
+    const char *url = demuxer->stream->url;
+    if (!opts->index_dir || !opts->index_dir[0] || !url)
+        return NULL;
+
+    char *dir = mp_get_user_path(talloc_ctx, demuxer->global, opts->index_dir);
+    char *name = talloc_asprintf(talloc_ctx, "%s.mkvidx",
+                                 mp_hash_filename(talloc_ctx, url));
+    return mp_path_join(talloc_ctx, dir, name);
+}
+
+static void write_index_file(struct mkv_index_scan *scan)
+{
+    char *dir = bstrdup0(NULL, mp_dirname(scan->index_file));
+    mp_mkdirp(dir);
+    talloc_free(dir);
+
+    void *tmp = talloc_new(NULL);
+    bstr data = {0};
+    bstr_xappend_asprintf(tmp, &data, "%s\n", INDEX_FILE_HEADER);
+    bstr_xappend_asprintf(tmp, &data, "size %"PRId64"\n", scan->file_size);
+    bstr_xappend_asprintf(tmp, &data, "segment %"PRId64" %"PRId64" %s\n",
+                          scan->segment_start, scan->segment_end,
+                          mp_hex_string(tmp, scan->segment_uid,
+                                        sizeof(scan->segment_uid)));
+    bstr_xappend_asprintf(tmp, &data, "tc-scale %"PRIu64"\n", scan->tc_scale);
+    for (size_t n = 0; n < scan->num_entries; n++) {
+        mkv_index_t *e = &scan->entries[n];
+        bstr_xappend_asprintf(tmp, &data,
+                              "entry %d %"PRIu64" %"PRIu64" %"PRIu64"\n",
+                              e->tnum, e->timecode, e->duration, e->filepos);
+    }
+    if (mp_save_file_atomic(scan->index_file, data)) {
+        MP_VERBOSE(scan, "wrote index file '%s'\n", scan->index_file);
+    } else {
+        MP_ERR(scan, "can't write index file '%s'\n", scan->index_file);
+    }
+    talloc_free(tmp);
+}
+
+// Load the index written by a previous session. Returns false if there is
+// none, or if it doesn't belong to this file.
+static bool read_index_file(struct demuxer *demuxer, int64_t file_size)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+    char *path = index_file_path(tmp, demuxer);
+    if (!path || !mp_path_exists(path))
+        goto done;
+
+    bstr data = stream_read_file(path, tmp, demuxer->global, 256 << 20);
+    bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+    if (!bstr_equals0(line, INDEX_FILE_HEADER))
+        goto done;
+
+    unsigned char *uid = demuxer->matroska_data.uid.segment;
+    char *segment = talloc_asprintf(tmp, "%"PRId64" %"PRId64" %s",
+                                    mkv_d->segment_start, mkv_d->segment_end,
+                                    mp_hex_string(tmp, uid, 16));
+    bool size_ok = false, segment_ok = false, tc_scale_ok = false;
+    mkv_index_t *entries = NULL;
+    size_t num_entries = 0;
+    while (data.len) {
+        line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        bstr key, val;
+        bstr_split_tok(line, " ", &key, &val);
+        if (bstr_equals0(key, "size")) {
+            size_ok = bstrtoll(val, NULL, 10) == file_size;
+        } else if (bstr_equals0(key, "segment")) {
+            segment_ok = bstr_equals0(val, segment);
+        } else if (bstr_equals0(key, "tc-scale")) {
+            tc_scale_ok = bstrtoll(val, NULL, 10) == mkv_d->tc_scale;
+        } else if (bstr_equals0(key, "entry")) {
+            mkv_index_t e;
+            e.tnum = bstrtoll(val, &val, 10);
+            e.timecode = bstrtoll(bstr_strip(val), &val, 10);
+            e.duration = bstrtoll(bstr_strip(val), &val, 10);
+            e.filepos = bstrtoll(bstr_strip(val), &val, 10);
+            MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+        }
+    }
+    ok = size_ok && segment_ok && tc_scale_ok && num_entries;
+    if (ok) {
+        MP_VERBOSE(demuxer, "Loaded %zu index entries from '%s'.\n",
+                   num_entries, path);
+        talloc_free(mkv_d->indexes);
+        mkv_d->indexes = talloc_steal(mkv_d, entries);
+        mkv_d->num_indexes = num_entries;
+        mkv_d->index_has_durations = true;
+        mkv_d->index_complete = true;
+    } else {
+        MP_VERBOSE(demuxer, "Ignoring index file '%s' (file changed?).\n", path);
+    }
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
+static void scan_add_entry(struct mkv_index_scan *scan, int64_t cluster_pos,
+                           uint64_t tnum, int64_t timecode, uint64_t duration)
+{
+    struct mkv_index_scan_track *t = NULL;
+    for (int n = 0; n < scan->num_tracks; n++) {
+        if (scan->tracks[n].tnum == tnum)
+            t = &scan->tracks[n];
+    }
+    if (!t)
+        return;
+    // Same rule as add_block_position().
+    if (t->has_last && t->last_tc >= timecode)
+        return;
+    // Audio has a keyframe in every block. One entry per cluster is enough,
+    // because seeking always starts at the cluster anyway.
+    if (t->type == MATROSKA_TRACK_AUDIO && t->has_last &&
+        t->last_cluster == cluster_pos)
+        return;
+    t->has_last = true;
+    t->last_tc = timecode;
+    t->last_cluster = cluster_pos;
+
+    pthread_mutex_lock(&scan->lock);
+    MP_TARRAY_APPEND(scan, scan->entries, scan->num_entries, (mkv_index_t){
+        .tnum = tnum,
+        .timecode = MPMAX(timecode, 0),
+        .duration = duration,
+        .filepos = cluster_pos,
+    });
+    pthread_mutex_unlock(&scan->lock);
+}
+
+// Read the header of a Block or SimpleBlock (of the given length) and skip the
+// rest. Returns false on errors.
+static bool scan_block_header(struct stream *s, uint64_t length,
+                              uint64_t *tnum, int16_t *time, uint8_t *flags)
+{
+    int64_t end = stream_tell(s) + length;
+    uint8_t buf[16];
+    int len = stream_read(s, buf, MPMIN(length, sizeof(buf)));
+    bstr data = {buf, len};
+    *tnum = ebml_read_vlen_uint(&data);
+    if (*tnum == EBML_UINT_INVALID || data.len < 3)
+        return false;
+    *time = data.start[0] << 8 | data.start[1];
+    *flags = data.start[2];
+    return stream_seek(s, end);
+}
+
+static bool scan_cluster(struct mkv_index_scan *scan, struct stream *s,
+                         int64_t cluster_pos, int64_t end)
+{
+    uint64_t cluster_tc = 0;
+    while (stream_tell(s) < end) {
+        uint32_t id = ebml_read_id(s);
+        switch (id) {
+        case MATROSKA_ID_TIMECODE:
+            cluster_tc = ebml_read_uint(s);
+            if (cluster_tc == EBML_UINT_INVALID)
+                return false;
+            break;
+
+        case MATROSKA_ID_SIMPLEBLOCK: {
+            uint64_t length = ebml_read_length(s);
+            if (length == EBML_UINT_INVALID || stream_tell(s) + length > end)
+                return false;
+            uint64_t tnum;
+            int16_t time;
+            uint8_t flags;
+            if (!scan_block_header(s, length, &tnum, &time, &flags))
+                return false;
+            if (flags & 0x80)
+                scan_add_entry(scan, cluster_pos, tnum, cluster_tc + time, 0);
+            break;
+        }
+
+        case MATROSKA_ID_BLOCKGROUP: {
+            uint64_t length = ebml_read_length(s);
+            if (length == EBML_UINT_INVALID || stream_tell(s) + length > end)
+                return false;
+            int64_t group_end = stream_tell(s) + length;
+            bool have_block = false, keyframe = true;
+            uint64_t tnum = 0, duration = 0;
+            int16_t time = 0;
+            uint8_t flags;
+            while (stream_tell(s) < group_end) {
+                switch (ebml_read_id(s)) {
+                case MATROSKA_ID_BLOCK:
+                    length = ebml_read_length(s);
+                    if (length == EBML_UINT_INVALID ||
+                        stream_tell(s) + length > group_end ||
+                        !scan_block_header(s, length, &tnum, &time, &flags))
+                        return false;
+                    have_block = true;
+                    break;
+                case MATROSKA_ID_BLOCKDURATION:
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        return false;
+                    break;
+                case MATROSKA_ID_REFERENCEBLOCK: {
+                    int64_t num = ebml_read_int(s);
+                    if (num == EBML_INT_INVALID)
+                        return false;
+                    if (num)
+                        keyframe = false;
+                    break;
+                }
+                case EBML_ID_INVALID:
+                    return false;
+                default:
+                    if (ebml_read_skip(scan->log, group_end, s) != 0)
+                        return false;
+                }
+            }
+            if (have_block && keyframe)
+                scan_add_entry(scan, cluster_pos, tnum, cluster_tc + time,
+                               duration);
+            break;
+        }
+
+        case EBML_ID_INVALID:
+            return false;
+
+        default:
+            if (ebml_read_skip(scan->log, end, s) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Returns true if the end of the segment was reached.
+static bool scan_clusters(struct mkv_index_scan *scan, struct stream *s)
+{
+    if (!stream_seek(s, scan->first_cluster))
+        return false;
+    while (1) {
+        if (mp_cancel_test(scan->cancel))
+            return false;
+        int64_t pos = stream_tell(s);
+        if (pos >= scan->segment_end)
+            return true;
+        uint32_t id = ebml_read_id(s);
+        if (s->eof)
+            return true;
+        if (id == MATROSKA_ID_CLUSTER) {
+            uint64_t length = ebml_read_length(s);
+            // Unknown-size clusters (live streams) would require resyncing.
+            if (length == EBML_UINT_INVALID)
+                return false;
+            int64_t end = stream_tell(s) + length;
+            if (!scan_cluster(scan, s, pos, end))
+                return false;
+            stream_seek(s, end);
+        } else {
+            if (!ebml_is_mkv_level1_id(id) ||
+                ebml_read_skip(scan->log, -1, s) != 0)
+                return false;
+        }
+    }
+}
+
+static void *index_scan_thread(void *p)
+{
+    struct mkv_index_scan *scan = p;
+    mpthread_set_name("mkv index");
+
+    double start = mp_time_sec();
+    struct stream *s = stream_create(scan->url, STREAM_READ, scan->cancel,
+                                     scan->global);
+    bool complete = s && scan_clusters(scan, s);
+    free_stream(s);
+
+    MP_VERBOSE(scan, "Index scan %s after %.3f seconds, %zu entries.\n",
+               complete ? "finished" : "stopped", mp_time_sec() - start,
+               scan->num_entries);
+
+    if (complete && scan->index_file)
+        write_index_file(scan);
+
+    pthread_mutex_lock(&scan->lock);
+    scan->done = true;
+    scan->complete = complete;
+    pthread_mutex_unlock(&scan->lock);
+    return NULL;
+}
+
+static void start_index_scan(struct demuxer *demuxer, int64_t first_cluster,
+                             int64_t file_size)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct stream *s = demuxer->stream;
+
+    if (!s->url || s->is_network || !demuxer->seekable)
+        return;
+
+    struct mkv_index_scan *scan = talloc_ptrtype(NULL, scan);
+    *scan = (struct mkv_index_scan){
+        .log = mp_log_new(scan, demuxer->log, "index"),
+        .global = demuxer->global,
+        .cancel = mp_cancel_new(scan),
+        .url = talloc_strdup(scan, s->url),
+        .index_file = index_file_path(scan, demuxer),
+        .file_size = file_size,
+        .segment_start = mkv_d->segment_start,
+        .segment_end = mkv_d->segment_end,
+        .first_cluster = first_cluster,
+        .tc_scale = mkv_d->tc_scale,
+    };
+    memcpy(scan->segment_uid, demuxer->matroska_data.uid.segment, 16);
+    for (int n = 0; n < mkv_d->num_tracks; n++) {
+        struct mkv_index_scan_track t = {
+            .tnum = mkv_d->tracks[n]->tnum,
+            .type = mkv_d->tracks[n]->type,
+        };
+        MP_TARRAY_APPEND(scan, scan->tracks, scan->num_tracks, t);
+    }
+    pthread_mutex_init(&scan->lock, NULL);
+
+    if (pthread_create(&scan->thread, NULL, index_scan_thread, scan)) {
+        pthread_mutex_destroy(&scan->lock);
+        talloc_free(scan);
+        return;
+    }
+    MP_VERBOSE(demuxer, "No Cues, building index in the background.\n");
+    mkv_d->index_scan = scan;
+}
+
+static void stop_index_scan(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct mkv_index_scan *scan = mkv_d->index_scan;
+    if (!scan)
+        return;
+    mp_cancel_trigger(scan->cancel);
+    pthread_join(scan->thread, NULL);
+    pthread_mutex_destroy(&scan->lock);
+    talloc_free(scan);
+    mkv_d->index_scan = NULL;
+}
+
+static bool has_cues(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (demuxer->opts->index_mode != 1)
+        return false;
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return true;
+    }
+    return false;
+}
+
 static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 {
     stream_t *s = demuxer->stream;
@@ -1855,6 +2276,23 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     add_coverart(demuxer);
     demuxer->allow_refresh_seeks = true;
 
+    // With --index=recreate, a saved index is not loaded, only replaced.
+    bool recreate = opts->index_mode != 1;
+    if (!has_cues(demuxer) && (recreate || !read_index_file(demuxer, end)) &&
+        opts->demux_mkv->index_scan)
+        start_index_scan(demuxer, start_pos, end);
+
+    if (opts->demux_mkv->parse_threads > 0) {
+        pthread_mutex_init(&mkv_d->parse_lock, NULL);
+        pthread_cond_init(&mkv_d->parse_wakeup, NULL);
+        mkv_d->parse_pool =
+            mp_thread_pool_create(mkv_d, opts->demux_mkv->parse_threads);
+        if (!mkv_d->parse_pool) {
+            pthread_cond_destroy(&mkv_d->parse_wakeup);
+            pthread_mutex_destroy(&mkv_d->parse_lock);
+        }
+    }
+
     if (opts->demux_mkv->probe_duration)
         probe_last_timestamp(demuxer);
 
@@ -2250,14 +2688,41 @@ struct block_info {
     mkv_track_t *track;
     bstr data;
     void *alloc;
+    // If set, data points into memory borrowed from this stream with
+    // stream_borrow(), and no other stream calls are allowed until free_block().
+    stream_t *borrowed;
+    int borrowed_len;
     int64_t filepos;
+    // Set if the laces were already decoded by parse_block() (the data is
+    // then not used anymore). num_laces is -1 on lacing errors.
+    bool parsed;
+    int num_laces;
+    struct demux_packet **laces;
 };
 
 static void free_block(struct block_info *block)
 {
+    if (block->borrowed)
+        stream_release(block->borrowed, block->borrowed_len);
+    block->borrowed = NULL;
     free(block->alloc);
     block->alloc = NULL;
     block->data = (bstr){0};
+    for (int n = 0; n < block->num_laces; n++)
+        talloc_free(block->laces[n]);
+    talloc_free(block->laces);
+    block->laces = NULL;
+    block->num_laces = 0;
+    block->parsed = false;
+}
+
+// Free blocks that were read ahead by read_block_batch(), but not used yet.
+static void drop_block_batch(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    for (int n = mkv_d->batch_pos; n < mkv_d->num_batch; n++)
+        free_block(&mkv_d->batch[n]);
+    mkv_d->num_batch = mkv_d->batch_pos = 0;
 }
 
 static void index_block(demuxer_t *demuxer, struct block_info *block)
@@ -2283,13 +2748,24 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     length = ebml_read_length(s);
     if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
     block->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
-        goto exit;
+    // Avoid copying the data if it's going to be turned into packets right
+    // away (they still need their own copy).
+    bstr span = {0};
+    if (block->simple && mkv_d->borrow_blocks)
+        span = stream_borrow(s, length);
+    if (span.start) {
+        block->borrowed = s;
+        block->borrowed_len = length;
+        block->data = span;
+    } else {
+        block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
+        if (!block->alloc)
+            goto exit;
+        block->data = (bstr){block->alloc, length};
+        if (stream_read(s, block->data.start, block->data.len) != block->data.len)
+            goto exit;
+    }
 
     // Parse header of the Block element
     /* first byte(s): track num */
@@ -2316,6 +2792,17 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
         goto exit;
     }
 
+    // Decoders for content encodings (LZO) need input padding.
+    if (block->borrowed && block->track->num_encodings) {
+        block->alloc = malloc(block->data.len + AV_LZO_INPUT_PADDING);
+        if (!block->alloc)
+            goto exit;
+        memcpy(block->alloc, block->data.start, block->data.len);
+        block->data.start = block->alloc;
+        stream_release(block->borrowed, block->borrowed_len);
+        block->borrowed = NULL;
+    }
+
     res = 1;
 exit:
     if (res <= 0)
@@ -2336,6 +2823,41 @@ static double fix_timestamp(demuxer_t *demuxer, mkv_track_t *track, double ts)
     return ts;
 }
 
+// Turn the laces of the block into packets, which are stored in block->laces.
+// This accesses only the block and track->parser_tmp, so different tracks can
+// be handled concurrently.
+static void decode_laces(struct mp_log *log, struct block_info *block,
+                         bstr data, int laces, uint32_t *lace_size)
+{
+    mkv_track_t *track = block->track;
+    block->laces = talloc_zero_array(NULL, struct demux_packet *, laces);
+    for (int i = 0; i < laces; i++) {
+        bstr lace = bstr_splice(data, 0, lace_size[i]);
+        data = bstr_cut(data, lace_size[i]);
+
+        lace = demux_mkv_decode(log, track, lace, 1);
+
+        demux_packet_t *dp = new_demux_packet_from(lace.start, lace.len);
+        talloc_free_children(track->parser_tmp);
+        if (!dp)
+            break;
+        block->laces[block->num_laces++] = dp;
+    }
+}
+
+static void parse_block(struct mp_log *log, struct block_info *block)
+{
+    uint32_t lace_size[MAX_NUM_LACES];
+    int laces;
+    bstr data = block->data;
+    block->parsed = true;
+    if (demux_mkv_read_block_lacing(&data, &laces, lace_size)) {
+        block->num_laces = -1;
+        return;
+    }
+    decode_laces(log, block, data, laces, lace_size);
+}
+
 static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
@@ -2353,7 +2875,14 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
     if (!demux_stream_is_selected(stream))
         return 0;
 
-    if (demux_mkv_read_block_lacing(&data, &laces, lace_size)) {
+    if (block_info->parsed) {
+        laces = block_info->num_laces;
+        if (laces < 0) {
+            block_info->num_laces = 0;
+            MP_ERR(demuxer, "Bad input [lacing]\n");
+            return 0;
+        }
+    } else if (demux_mkv_read_block_lacing(&data, &laces, lace_size)) {
         MP_ERR(demuxer, "Bad input [lacing]\n");
         return 0;
     }
@@ -2391,15 +2920,12 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
         uint64_t filepos = block_info->filepos;
         mkv_d->last_pts = current_pts;
 
-        for (int i = 0; i < laces; i++) {
-            bstr block = bstr_splice(data, 0, lace_size[i]);
-            data = bstr_cut(data, lace_size[i]);
-
-            block = demux_mkv_decode(demuxer->log, track, block, 1);
+        if (!block_info->parsed)
+            decode_laces(demuxer->log, block_info, data, laces, lace_size);
 
-            demux_packet_t *dp = new_demux_packet_from(block.start, block.len);
-            if (!dp)
-                break;
+        for (int i = 0; i < block_info->num_laces; i++) {
+            demux_packet_t *dp = block_info->laces[i];
+            block_info->laces[i] = NULL;
             dp->keyframe = keyframe;
             dp->pos = filepos;
             /* If default_duration is 0, assume no pts value is known
@@ -2420,9 +2946,9 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
                 mkv_d->a_skip_preroll = 0;
             }
 
+            filepos += dp->len;
             mkv_parse_and_add_packet(demuxer, track, dp);
             talloc_free_children(track->parser_tmp);
-            filepos += block.len;
         }
 
         if (stream->type == STREAM_VIDEO) {
@@ -2578,12 +3104,120 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
     }
 }
 
+// Tracks beyond this are parsed on the demuxer thread when their blocks are used.
+#define MAX_PARSE_JOBS 64
+
+struct parse_job {
+    struct demuxer *demuxer;
+    mkv_track_t *track;
+};
+
+// Parse all blocks of the batch that belong to job->track.
+static void run_parse_job(struct parse_job *job)
+{
+    mkv_demuxer_t *mkv_d = job->demuxer->priv;
+    for (int n = 0; n < mkv_d->num_batch; n++) {
+        struct block_info *block = &mkv_d->batch[n];
+        if (block->track == job->track)
+            parse_block(job->demuxer->log, block);
+    }
+}
+
+static void parse_job_worker(void *ctx)
+{
+    struct parse_job *job = ctx;
+    mkv_demuxer_t *mkv_d = job->demuxer->priv;
+    run_parse_job(job);
+    pthread_mutex_lock(&mkv_d->parse_lock);
+    mkv_d->parse_pending--;
+    pthread_cond_signal(&mkv_d->parse_wakeup);
+    pthread_mutex_unlock(&mkv_d->parse_lock);
+}
+
+// Read the rest of the current cluster (at least one block) into mkv_d->batch,
+// and decode the blocks of the selected tracks in parallel, one job per track.
+// Returns false on EOF.
+static bool read_block_batch(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    drop_block_batch(demuxer);
+
+    double start = mp_time_sec();
+    int64_t cluster = -1;
+    while (1) {
+        struct block_info block;
+        int res = read_next_block(demuxer, &block);
+        if (res < 0)
+            break;
+        if (res > 0) {
+            index_block(demuxer, &block);
+            mkv_d->parse_bytes += block.data.len;
+            MP_TARRAY_APPEND(mkv_d, mkv_d->batch, mkv_d->num_batch, block);
+            if (cluster >= 0 && cluster != mkv_d->cluster_start)
+                break;
+            cluster = mkv_d->cluster_start;
+        }
+    }
+
+    struct parse_job jobs[MAX_PARSE_JOBS];
+    int num_jobs = 0;
+    for (int n = 0; n < mkv_d->num_batch; n++) {
+        mkv_track_t *track = mkv_d->batch[n].track;
+        if (!demux_stream_is_selected(track->stream))
+            continue;
+        bool found = false;
+        for (int i = 0; i < num_jobs; i++)
+            found |= jobs[i].track == track;
+        if (!found && num_jobs < MP_ARRAY_SIZE(jobs))
+            jobs[num_jobs++] = (struct parse_job){demuxer, track};
+    }
+
+    // The first job runs on this thread.
+    pthread_mutex_lock(&mkv_d->parse_lock);
+    mkv_d->parse_pending = MPMAX(num_jobs - 1, 0);
+    pthread_mutex_unlock(&mkv_d->parse_lock);
+    for (int i = 1; i < num_jobs; i++)
+        mp_thread_pool_queue(mkv_d->parse_pool, parse_job_worker, &jobs[i]);
+    if (num_jobs)
+        run_parse_job(&jobs[0]);
+    pthread_mutex_lock(&mkv_d->parse_lock);
+    while (mkv_d->parse_pending)
+        pthread_cond_wait(&mkv_d->parse_wakeup, &mkv_d->parse_lock);
+    pthread_mutex_unlock(&mkv_d->parse_lock);
+
+    mkv_d->parse_time += mp_time_sec() - start;
+    return mkv_d->num_batch > 0;
+}
+
+static int fill_buffer_parallel(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    for (;;) {
+        while (mkv_d->batch_pos < mkv_d->num_batch) {
+            struct block_info *block = &mkv_d->batch[mkv_d->batch_pos++];
+            int res = handle_block(demuxer, block);
+            free_block(block);
+            if (res > 0)
+                return 1;
+        }
+        if (!read_block_batch(demuxer))
+            return 0;
+    }
+}
+
 static int demux_mkv_fill_buffer(demuxer_t *demuxer)
 {
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (mkv_d->parse_pool)
+        return fill_buffer_parallel(demuxer);
+
     for (;;) {
         int res;
         struct block_info block;
+        mkv_d->borrow_blocks = true;
         res = read_next_block(demuxer, &block);
+        mkv_d->borrow_blocks = false;
         if (res < 0)
             return 0;
         if (res > 0) {
@@ -2613,12 +3247,50 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
     return index;
 }
 
+// Take over the index built by the background scan, if it covers more of the
+// file than the index created during playback.
+static void update_index_from_scan(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_index_scan *scan = mkv_d->index_scan;
+    if (!scan || mkv_d->index_complete)
+        return;
+
+    pthread_mutex_lock(&scan->lock);
+    mkv_index_t *cur = get_highest_index_entry(demuxer);
+    size_t num = scan->num_entries;
+    if (num && (scan->complete ||
+                !cur || scan->entries[num - 1].filepos > cur->filepos))
+    {
+        talloc_free(mkv_d->indexes);
+        mkv_d->indexes = talloc_memdup(mkv_d, scan->entries,
+                                       num * sizeof(mkv_index_t));
+        mkv_d->num_indexes = num;
+        mkv_d->index_has_durations = true;
+        for (int n = 0; n < mkv_d->num_tracks; n++) {
+            struct mkv_track *track = mkv_d->tracks[n];
+            track->last_index_entry = (size_t)-1;
+            for (size_t i = 0; i < num; i++) {
+                if (mkv_d->indexes[i].tnum == track->tnum)
+                    track->last_index_entry = i;
+            }
+        }
+        mkv_d->index_complete = scan->complete;
+    }
+    bool done = scan->done;
+    pthread_mutex_unlock(&scan->lock);
+
+    if (done)
+        stop_index_scan(demuxer);
+}
+
 static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
     struct stream *s = demuxer->stream;
 
     read_deferred_cues(demuxer);
+    update_index_from_scan(demuxer);
 
     if (mkv_d->index_complete)
         return 0;
@@ -2734,6 +3406,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
     uint64_t a_tnum = -1;
     bool st_active[STREAM_TYPE_COUNT] = {0};
     mkv_seek_reset(demuxer);
+    drop_block_batch(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++) {
         mkv_track_t *track = mkv_d->tracks[i];
         if (demux_stream_is_selected(track->stream)) {
@@ -2784,6 +3457,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
         stream_t *s = demuxer->stream;
 
         read_deferred_cues(demuxer);
+        update_index_from_scan(demuxer);
 
         int64_t size = 0;
         stream_control(s, STREAM_CTRL_GET_SIZE, &size);
@@ -2906,7 +3580,22 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    stop_index_scan(demuxer);
     mkv_seek_reset(demuxer);
+    drop_block_batch(demuxer);
+    if (mkv_d->parse_pool) {
+        if (mkv_d->parse_time > 0) {
+            MP_VERBOSE(demuxer, "Demuxed %.1f MB in %.3f seconds (%.1f MB/s) "
+                       "using %d parse threads.\n", mkv_d->parse_bytes / 1e6,
+                       mkv_d->parse_time,
+                       mkv_d->parse_bytes / 1e6 / mkv_d->parse_time,
+                       demuxer->opts->demux_mkv->parse_threads);
+        }
+        talloc_free(mkv_d->parse_pool);
+        mkv_d->parse_pool = NULL;
+        pthread_cond_destroy(&mkv_d->parse_wakeup);
+        pthread_mutex_destroy(&mkv_d->parse_lock);
+    }
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
 }
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -29,12 +30,189 @@
 
 #include "packet.h"
 
+// Packet payloads are recycled through a pool with size classes of 4 steps
+// per power of 2 (wasting at most 25%). Larger packets are allocated normally.
+// The pool is shared by all demuxers in the process. It keeps unused buffers
+// only while at least one demuxer is open, and is drained when the last one
+// is closed.
+#define POOL_MIN_SHIFT 8            // 256 bytes
+#define POOL_MAX_SHIFT 23           // 8 MB
+#define POOL_STEPS 4
+#define POOL_NUM_CLASSES ((POOL_MAX_SHIFT - POOL_MIN_SHIFT) * POOL_STEPS)
+
+struct pool_class {
+    size_t size;
+    void **free;
+    int num_free;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_class pool_classes[POOL_NUM_CLASSES];
+static struct demux_packet_pool_stats pool_stats;
+static int64_t *pool_users;         // max_held of each open demuxer
+static int pool_num_users;
+static int64_t pool_max_held;       // max. size of all unused buffers kept
+
+// Return the smallest class that fits size, or NULL if none.
+static struct pool_class *pool_get_class(size_t size)
+{
+    for (int shift = POOL_MIN_SHIFT; shift < POOL_MAX_SHIFT; shift++) {
+        size_t base = (size_t)1 << shift;
+        if (size > base * 2)
+            continue;
+        for (int step = 1; step <= POOL_STEPS; step++) {
+            size_t csize = base + base / POOL_STEPS * step;
+            if (size <= csize) {
+                int index = (shift - POOL_MIN_SHIFT) * POOL_STEPS + step - 1;
+                struct pool_class *c = &pool_classes[index];
+                c->size = csize;
+                return c;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void pool_free_buffer(void *opaque, uint8_t *data)
+{
+    struct pool_class *c = opaque;
+    pthread_mutex_lock(&pool_lock);
+    pool_stats.used_bytes -= c->size;
+    if (pool_stats.held_bytes + c->size <= pool_max_held) {
+        MP_TARRAY_APPEND(NULL, c->free, c->num_free, data);
+        pool_stats.held_bytes += c->size;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    av_free(data);
+}
+
+// Allocate a buffer of at least the given size, preferably from the pool.
+static AVBufferRef *pool_alloc_buffer(size_t size)
+{
+    struct pool_class *c = NULL;
+    void *data = NULL;
+    pthread_mutex_lock(&pool_lock);
+    c = pool_get_class(size);
+    if (c) {
+        if (c->num_free) {
+            data = c->free[--c->num_free];
+            pool_stats.held_bytes -= c->size;
+            pool_stats.hits++;
+        } else {
+            pool_stats.misses++;
+        }
+        pool_stats.used_bytes += c->size;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (!c)
+        return av_buffer_alloc(size);
+    if (!data)
+        data = av_malloc(c->size);
+    AVBufferRef *buf = data ? av_buffer_create(data, c->size, pool_free_buffer,
+                                               c, 0) : NULL;
+    if (!buf) {
+        if (data)
+            pool_free_buffer(c, data);
+        return NULL;
+    }
+    return buf;
+}
+
+// Free unused buffers until at most pool_max_held bytes are kept. Called
+// locked.
+static void pool_trim(void)
+{
+    for (int n = POOL_NUM_CLASSES - 1; n >= 0; n--) {
+        struct pool_class *c = &pool_classes[n];
+        while (c->num_free && pool_stats.held_bytes > pool_max_held) {
+            av_free(c->free[--c->num_free]);
+            pool_stats.held_bytes -= c->size;
+        }
+        if (!c->num_free) {
+            talloc_free(c->free);
+            c->free = NULL;
+        }
+    }
+}
+
+// Set pool_max_held to the largest value requested by the open demuxers, and
+// free buffers exceeding it. Called locked.
+static void pool_update_max_held(void)
+{
+    pool_max_held = 0;
+    for (int n = 0; n < pool_num_users; n++)
+        pool_max_held = MPMAX(pool_max_held, pool_users[n]);
+    pool_trim();
+    if (!pool_num_users) {
+        talloc_free(pool_users);
+        pool_users = NULL;
+    }
+}
+
+// Called when a demuxer is opened. max_held is the maximum size of unused
+// buffers kept for reuse (--demuxer-packet-pool-size). The pool is shared by
+// the whole process (e.g. several libmpv instances), so the largest value of
+// all open demuxers is used.
+void demux_packet_pool_ref(int64_t max_held)
+{
+    pthread_mutex_lock(&pool_lock);
+    MP_TARRAY_APPEND(NULL, pool_users, pool_num_users, max_held);
+    pool_update_max_held();
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Called when a demuxer is closed, with the same max_held value as passed to
+// demux_packet_pool_ref(). Closing the last demuxer frees all unused buffers;
+// packets still in use are freed normally when they're released.
+void demux_packet_pool_unref(int64_t max_held)
+{
+    pthread_mutex_lock(&pool_lock);
+    int found = -1;
+    for (int n = 0; n < pool_num_users; n++) {
+        if (pool_users[n] == max_held)
+            found = n;
+    }
+    assert(found >= 0);
+    MP_TARRAY_REMOVE_AT(pool_users, pool_num_users, found);
+    pool_update_max_held();
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool_lock);
+    *stats = pool_stats;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// The AVPacket is part of the same allocation as the demux_packet.
+struct packet_alloc {
+    struct demux_packet dp;
+    AVPacket avpkt;
+};
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
     av_packet_unref(dp->avpacket);
 }
 
+// Like av_new_packet(), but with a pooled buffer. Copies the data if not NULL.
+static int new_pooled_packet(AVPacket *pkt, void *data, int size)
+{
+    AVBufferRef *buf = pool_alloc_buffer(size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return -1;
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    if (data)
+        memcpy(pkt->data, data, size);
+    memset(pkt->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    return 0;
+}
+
 // This actually preserves only data and side data, not PTS/DTS/pos/etc.
 // It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
 // does not allow it, but we do it to simplify new_demux_packet().
@@ -42,7 +220,8 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
+    struct packet_alloc *alloc = talloc(NULL, struct packet_alloc);
+    struct demux_packet *dp = &alloc->dp;
     talloc_set_destructor(dp, packet_destroy);
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
@@ -50,16 +229,17 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .duration = -1,
         .pos = -1,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = &alloc->avpkt,
     };
     av_init_packet(dp->avpacket);
     int r = -1;
-    if (avpkt->data) {
+    if (avpkt->buf || avpkt->side_data_elems) {
+        // Reference counted, or needs side data copied.
         // We hope that this function won't need/access AVPacket input padding,
         // because otherwise new_demux_packet_from() wouldn't work.
         r = av_packet_ref(dp->avpacket, avpkt);
     } else {
-        r = av_new_packet(dp->avpacket, avpkt->size);
+        r = new_pooled_packet(dp->avpacket, avpkt->data, avpkt->size);
     }
     if (r < 0) {
         *dp->avpacket = (AVPacket){0};
@@ -45,6 +45,17 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
+struct demux_packet_pool_stats {
+    int64_t hits;           // allocations served from the pool
+    int64_t misses;         // allocations that had to allocate a new buffer
+    int64_t held_bytes;     // unused memory kept in the pool
+    int64_t used_bytes;     // memory of pooled buffers currently in use
+};
+
+void demux_packet_pool_ref(int64_t max_held);
+void demux_packet_pool_unref(int64_t max_held);
+void demux_packet_pool_get_stats(struct demux_packet_pool_stats *stats);
+
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end);
 
 #endif /* MPLAYER_DEMUX_PACKET_H */
@@ -145,6 +145,10 @@ const m_option_t mp_opts[] = {
     OPT_INTRANGE("cache-seek-min", stream_cache.seek_min, 0, 0, 0x7fffffff),
     OPT_STRING("cache-file", stream_cache.file, M_OPT_FILE),
     OPT_INTRANGE("cache-file-size", stream_cache.file_max, 0, 0, 0x7fffffff),
+    OPT_STRING("cache-dir", stream_cache.dir, M_OPT_FILE),
+    OPT_INTRANGE("cache-dir-size", stream_cache.dir_max, 0, 0, 0x7fffffff),
+    OPT_DOUBLE("cache-readahead-secs", stream_cache.readahead_secs,
+               M_OPT_MIN, .min = 0),
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_STRING("dvd-device", dvd_device, M_OPT_FILE),
@@ -229,6 +233,11 @@ const m_option_t mp_opts[] = {
     OPT_DOUBLE("demuxer-readahead-secs", demuxer_min_secs, M_OPT_MIN, .min = 0),
     OPT_INTRANGE("demuxer-readahead-packets", demuxer_min_packs, 0, 0, MAX_PACKS),
     OPT_INTRANGE("demuxer-readahead-bytes", demuxer_min_bytes, 0, 0, MAX_PACK_BYTES),
+    OPT_INTRANGE("demuxer-back-bytes", demuxer_back_bytes, 0, 0, MAX_PACK_BYTES),
+    OPT_DOUBLE("demuxer-back-secs", demuxer_back_secs, M_OPT_MIN, .min = 0),
+    OPT_FLAG("demuxer-probe-cache", demuxer_probe_cache, 0),
+    OPT_INTRANGE("demuxer-packet-pool-size", demuxer_packet_pool_size,
+                 0, 0, MAX_PACK_BYTES),
 
     OPT_DOUBLE("cache-secs", demuxer_min_secs_cache, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
@@ -260,6 +269,10 @@ const m_option_t mp_opts[] = {
                .min = 0.01, .max = 100.0),
 
     OPT_FLAG("audio-pitch-correction", pitch_correction, 0),
+    OPT_DOUBLE("audio-decode-ahead", audio_decode_ahead, M_OPT_RANGE,
+               .min = 0, .max = 10),
+    OPT_DOUBLE("audio-seek-cache", audio_seek_cache, M_OPT_RANGE,
+               .min = 0, .max = 3600),
 
     // set a-v distance
     OPT_FLOATRANGE("audio-delay", audio_delay, 0, -100.0, 100.0),
@@ -270,6 +283,9 @@ const m_option_t mp_opts[] = {
     OPT_SETTINGSLIST("af*", af_settings, 0, &af_obj_list),
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list),
     OPT_SETTINGSLIST("vf*", vf_settings, 0, &vf_obj_list),
+    OPT_INTRANGE("vf-pipeline", vf_pipeline, 0, 0, 100),
+    OPT_CHOICE_OR_INT("video-slice-threads", video_slice_threads, 0, 1, 64,
+                      ({"auto", 0})),
 
     OPT_CHOICE("deinterlace", deinterlace, 0,
                ({"auto", -1},
@@ -278,6 +294,7 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("ad", audio_decoders, 0),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("video-decode-queue", video_decode_queue, 0, 0, 100),
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
@@ -474,6 +491,9 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("stream-capture", stream_capture, M_OPT_FILE),
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
+    OPT_CHOICE_OR_INT("stream-file-queue-depth", stream_file_queue_depth,
+                      0, 0, 32, ({"auto", -1})),
+    OPT_INTRANGE("rar-parallel-volumes", rar_parallel_volumes, 0, 1, 32),
 
     OPT_FLAG("stop-playback-on-init-failure", stop_playback_on_init_failure, 0),
 
@@ -501,6 +521,8 @@ const m_option_t mp_opts[] = {
 
     OPT_FLAG("load-unsafe-playlists", load_unsafe_playlists, 0),
     OPT_FLAG("merge-files", merge_files, 0),
+    OPT_DOUBLE("prefetch-playlist", prefetch_playlist, M_OPT_MIN, .min = 0),
+    OPT_DOUBLE("prefetch-audio", prefetch_audio, M_OPT_RANGE, .min = 0, .max = 10),
 
     // a-v sync stuff:
     OPT_FLAG("correct-pts", correct_pts, 0),
@@ -643,12 +665,14 @@ const struct MPOpts mp_default_opts = {
     .audio_driver_list = NULL,
     .audio_decoders = "lavc:libdcadec,-spdif:*", // never select spdif by default
     .video_decoders = NULL,
+    .video_slice_threads = 1,
     .deinterlace = -1,
     .softvol = SOFTVOL_AUTO,
     .softvol_max = 130,
     .mixer_init_volume = -1,
     .mixer_init_mute = -1,
     .gapless_audio = -1,
+    .prefetch_audio = 1,
     .audio_buffer = 0.2,
     .audio_device = "auto",
     .audio_client_name = "mpv",
@@ -707,11 +731,17 @@ const struct MPOpts mp_default_opts = {
         .initial = 0,
         .seek_min = 500,
         .file_max = 1024 * 1024,
+        .dir_max = 4 * 1024 * 1024,
     },
     .demuxer_thread = 1,
     .demuxer_min_packs = 0,
     .demuxer_min_bytes = 0,
     .demuxer_min_secs = 1.0,
+    .demuxer_back_secs = 60.0,
+    .demuxer_probe_cache = 1,
+    .demuxer_packet_pool_size = 64 * 1024 * 1024,
+    .stream_file_queue_depth = -1,
+    .rar_parallel_volumes = 1,
     .network_rtsp_transport = 2,
     .network_timeout = 0.0,
     .hls_bitrate = 2,
@@ -52,6 +52,9 @@ struct mp_cache_opts {
     int seek_min;
     char *file;
     int file_max;
+    char *dir;
+    int dir_max;
+    double readahead_secs;
 };
 
 typedef struct MPOpts {
@@ -109,6 +112,7 @@ typedef struct MPOpts {
 
     char *audio_decoders;
     char *video_decoders;
+    int video_decode_queue;
     char *audio_spdif;
 
     int osd_level;
@@ -117,6 +121,8 @@ typedef struct MPOpts {
     int untimed;
     char *stream_capture;
     char *stream_dump;
+    int stream_file_queue_depth;
+    int rar_parallel_volumes;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
@@ -128,6 +134,8 @@ typedef struct MPOpts {
     char *chapter_file;
     int load_unsafe_playlists;
     int merge_files;
+    double prefetch_playlist;
+    double prefetch_audio;
     int quiet;
     int load_config;
     char *force_configdir;
@@ -194,6 +202,10 @@ typedef struct MPOpts {
     int demuxer_min_packs;
     int demuxer_min_bytes;
     double demuxer_min_secs;
+    int demuxer_back_bytes;
+    double demuxer_back_secs;
+    int demuxer_probe_cache;
+    int demuxer_packet_pool_size;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -212,8 +224,12 @@ typedef struct MPOpts {
     int force_srate;
     int dtshd;
     double playback_speed;
+    double audio_decode_ahead;
+    double audio_seek_cache;
     int pitch_correction;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_pipeline;
+    int video_slice_threads;
     struct m_obj_settings *af_settings, *af_defs;
     int deinterlace;
     float movie_aspect;
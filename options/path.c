@@ -32,6 +32,8 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <libavutil/md5.h>
+
 #include "config.h"
 
 #include "common/common.h"
@@ -333,3 +335,36 @@ void mp_mk_config_dir(struct mpv_global *global, char *subdir)
         mp_mkdirp(dir);
     talloc_free(dir);
 }
+
+char *mp_hex_string(void *talloc_ctx, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    char *r = talloc_array(talloc_ctx, char, size * 2 + 1);
+    for (size_t n = 0; n < size; n++)
+        snprintf(r + n * 2, 3, "%02x", p[n]);
+    r[size * 2] = '\0';
+    return r;
+}
+
+char *mp_hash_filename(void *talloc_ctx, const char *s)
+{
+    uint8_t md5[16];
+    av_md5_sum(md5, s, strlen(s));
+    return mp_hex_string(talloc_ctx, md5, sizeof(md5));
+}
+
+bool mp_save_file_atomic(const char *path, struct bstr data)
+{
+    char *tmp = talloc_asprintf(NULL, "%s.tmp", path);
+    bool ok = false;
+    FILE *f = fopen(tmp, "wb");
+    if (f) {
+        ok = fwrite(data.start, data.len, 1, f) == 1 || !data.len;
+        ok &= fclose(f) == 0;
+        ok = ok && rename(tmp, path) == 0;
+        if (!ok)
+            unlink(tmp);
+    }
+    talloc_free(tmp);
+    return ok;
+}
@@ -84,4 +84,18 @@ bstr mp_split_proto(bstr path, bstr *out_url);
 void mp_mkdirp(const char *dir);
 void mp_mk_config_dir(struct mpv_global *global, char *subdir);
 
+/* Return the data as lower case hex string.
+ */
+char *mp_hex_string(void *talloc_ctx, const void *data, size_t size);
+
+/* Return a name for files that belong to s, e.g. an URL: the hex MD5 sum of s.
+ */
+char *mp_hash_filename(void *talloc_ctx, const char *s);
+
+/* Replace the file at path with data. The data is written to a temporary
+ * file, which is then renamed, so that readers never see a partial file.
+ * Returns success.
+ */
+bool mp_save_file_atomic(const char *path, struct bstr data);
+
 #endif /* MPLAYER_PATH_H */
@@ -27,8 +27,10 @@
 
 #include "common/msg.h"
 #include "common/encode.h"
+#include "common/global.h"
 #include "options/options.h"
 #include "common/common.h"
+#include "osdep/timer.h"
 
 #include "audio/mixer.h"
 #include "audio/audio.h"
@@ -108,13 +110,15 @@ int reinit_audio_filters(struct MPContext *mpctx)
     if (!d_audio)
         return 0;
 
+    audio_pause_thread(d_audio);
+    int r = 1;
     af_uninit(mpctx->d_audio->afilter);
-    if (af_init(mpctx->d_audio->afilter) < 0)
-        return -1;
-    if (recreate_audio_filters(mpctx) < 0)
-        return -1;
+    if (af_init(mpctx->d_audio->afilter) < 0 ||
+        recreate_audio_filters(mpctx) < 0)
+        r = -1;
+    audio_unpause_thread(d_audio);
 
-    return 1;
+    return r;
 }
 
 void set_playback_speed(struct MPContext *mpctx, double new_speed)
@@ -129,26 +133,55 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
     if (!mpctx->d_audio || mpctx->d_audio->afilter->initialized < 1)
         return;
 
+    audio_pause_thread(mpctx->d_audio);
     recreate_audio_filters(mpctx);
+    audio_unpause_thread(mpctx->d_audio);
 }
 
 void reset_audio_state(struct MPContext *mpctx)
 {
-    if (mpctx->d_audio)
-        audio_reset_decoding(mpctx->d_audio);
+    double cache_pts = mpctx->audio_cache_seek_pts;
+    mpctx->audio_cache_seek_pts = MP_NOPTS_VALUE;
+    if (mpctx->d_audio) {
+        if (cache_pts == MP_NOPTS_VALUE ||
+            !audio_replay_cached(mpctx->d_audio, cache_pts))
+            audio_reset_decoding(mpctx->d_audio);
+    }
     if (mpctx->ao_buffer)
         mp_audio_buffer_clear(mpctx->ao_buffer);
     mpctx->audio_status = mpctx->d_audio ? STATUS_SYNCING : STATUS_EOF;
     mpctx->delay = 0;
 }
 
+// If a seek to pts can restart audio from the decoded audio cache, make the
+// next reset_audio_state() call do this, and return true. The caller must not
+// seek the demuxer then. This requires that audio is the only stream read
+// from the demuxer.
+bool queue_audio_cache_seek(struct MPContext *mpctx, double pts)
+{
+    struct track *track = mpctx->current_track[0][STREAM_AUDIO];
+    struct track *vtrack = mpctx->current_track[0][STREAM_VIDEO];
+    if (!mpctx->d_audio || !track || track->demuxer != mpctx->demuxer ||
+        mpctx->timeline || (vtrack && !vtrack->attached_picture) ||
+        mpctx->current_track[0][STREAM_SUB] ||
+        mpctx->current_track[1][STREAM_SUB])
+        return false;
+    pts -= get_track_video_offset(mpctx, track);
+    if (!audio_cache_contains(mpctx->d_audio, pts))
+        return false;
+    mpctx->audio_cache_seek_pts = pts;
+    return true;
+}
+
 void uninit_audio_out(struct MPContext *mpctx)
 {
     if (mpctx->ao) {
         // Note: with gapless_audio, stop_play is not correctly set
         if (mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE)
             ao_drain(mpctx->ao);
+        audio_pause_thread(mpctx->d_audio);
         mixer_uninit_audio(mpctx->mixer);
+        audio_unpause_thread(mpctx->d_audio);
         ao_uninit(mpctx->ao);
 
         mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
@@ -161,8 +194,9 @@ void uninit_audio_out(struct MPContext *mpctx)
 void uninit_audio_chain(struct MPContext *mpctx)
 {
     if (mpctx->d_audio) {
+        audio_pause_thread(mpctx->d_audio);
         mixer_uninit_audio(mpctx->mixer);
-        audio_uninit(mpctx->d_audio);
+        audio_uninit(mpctx->d_audio); // also stops the thread
         mpctx->d_audio = NULL;
         talloc_free(mpctx->ao_buffer);
         mpctx->ao_buffer = NULL;
@@ -173,7 +207,47 @@ void uninit_audio_chain(struct MPContext *mpctx)
     }
 }
 
-void reinit_audio_chain(struct MPContext *mpctx)
+// Create the decoder and filter chain for sh. The decoder is not opened yet.
+// Also used by the playlist prefetch thread, so don't touch the player here.
+struct dec_audio *audio_decoder_create(struct mpv_global *global,
+                                       struct mp_log *log, struct sh_stream *sh)
+{
+    struct dec_audio *d_audio = talloc_zero(NULL, struct dec_audio);
+    d_audio->log = mp_log_new(d_audio, log, "!ad");
+    d_audio->global = global;
+    d_audio->opts = global->opts;
+    d_audio->header = sh;
+    d_audio->pool = mp_audio_pool_create(d_audio);
+    d_audio->afilter = af_new(global);
+    d_audio->afilter->replaygain_data = sh->audio->replaygain_data;
+    d_audio->spdif_passthrough = true;
+    return d_audio;
+}
+
+// Take over the audio decoder the playlist prefetch opened for sh, if any.
+static bool use_prefetched_audio(struct MPContext *mpctx, struct sh_stream *sh)
+{
+    struct dec_audio *d_audio = mpctx->prefetched_audio;
+    if (!d_audio || d_audio->header != sh)
+        return false;
+    mpctx->prefetched_audio = NULL;
+    // It was created with the prefetch's copy of the options.
+    d_audio->global = mpctx->global;
+    d_audio->opts = mpctx->opts;
+    d_audio->afilter->opts = mpctx->opts;
+    mpctx->d_audio = d_audio;
+    MP_VERBOSE(mpctx, "Using prefetched audio decoder (%d frames decoded).\n",
+               d_audio->num_prefill + !!d_audio->waiting);
+    return true;
+}
+
+void uninit_prefetched_audio(struct MPContext *mpctx)
+{
+    audio_uninit(mpctx->prefetched_audio);
+    mpctx->prefetched_audio = NULL;
+}
+
+static void init_audio_chain(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
     struct track *track = mpctx->current_track[0][STREAM_AUDIO];
@@ -186,19 +260,19 @@ void reinit_audio_chain(struct MPContext *mpctx)
     mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
 
     if (!mpctx->d_audio) {
-        mpctx->d_audio = talloc_zero(NULL, struct dec_audio);
-        mpctx->d_audio->log = mp_log_new(mpctx->d_audio, mpctx->log, "!ad");
-        mpctx->d_audio->global = mpctx->global;
-        mpctx->d_audio->opts = opts;
-        mpctx->d_audio->header = sh;
-        mpctx->d_audio->pool = mp_audio_pool_create(mpctx->d_audio);
-        mpctx->d_audio->afilter = af_new(mpctx->global);
-        mpctx->d_audio->afilter->replaygain_data = sh->audio->replaygain_data;
-        mpctx->d_audio->spdif_passthrough = true;
+        bool prefetched = use_prefetched_audio(mpctx, sh);
+        if (!prefetched)
+            mpctx->d_audio = audio_decoder_create(mpctx->global, mpctx->log, sh);
         mpctx->ao_buffer = mp_audio_buffer_create(NULL);
-        if (!audio_init_best_codec(mpctx->d_audio))
-            goto init_error;
-        reset_audio_state(mpctx);
+        if (prefetched) {
+            // Keep the frames the prefetch decoded ahead.
+            mpctx->audio_status = STATUS_SYNCING;
+            mpctx->delay = 0;
+        } else {
+            if (!audio_init_best_codec(mpctx->d_audio))
+                goto init_error;
+            reset_audio_state(mpctx);
+        }
 
         if (mpctx->ao) {
             struct mp_audio fmt;
@@ -277,7 +351,7 @@ void reinit_audio_chain(struct MPContext *mpctx)
                 if (!audio_init_best_codec(mpctx->d_audio))
                     goto init_error;
                 reset_audio_state(mpctx);
-                reinit_audio_chain(mpctx);
+                init_audio_chain(mpctx);
                 return;
             }
 
@@ -315,6 +389,26 @@ no_audio:
         error_on_track(mpctx, track);
 }
 
+void reinit_audio_chain(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    // The decoder thread must not run while the chain is reconfigured.
+    struct dec_audio *d_audio = mpctx->d_audio;
+    audio_pause_thread(d_audio);
+    init_audio_chain(mpctx);
+    if (d_audio && d_audio == mpctx->d_audio) // not destroyed on errors
+        audio_unpause_thread(d_audio);
+
+    d_audio = mpctx->d_audio;
+    struct track *track = mpctx->current_track[0][STREAM_AUDIO];
+    if (opts->audio_decode_ahead > 0 && d_audio && !d_audio->thread &&
+        mpctx->ao && d_audio->afilter->initialized >= 1 && track &&
+        demux_is_threaded(track->demuxer))
+        audio_start_thread(d_audio, opts->audio_decode_ahead, wakeup_playloop,
+                           mpctx);
+}
+
 // Return pts value corresponding to the end point of audio written to the
 // ao so far.
 double written_audio_pts(struct MPContext *mpctx)
@@ -323,38 +417,17 @@ double written_audio_pts(struct MPContext *mpctx)
     if (!d_audio)
         return MP_NOPTS_VALUE;
 
-    struct mp_audio in_format = d_audio->decode_format;
-
-    if (!mp_audio_config_valid(&in_format) || d_audio->afilter->initialized < 1)
-        return MP_NOPTS_VALUE;
-
-    // first calculate the end pts of audio that has been output by decoder
-    double a_pts = d_audio->pts;
+    // End of the audio the decoder and the filters have output.
+    double a_pts = audio_get_pts(d_audio);
     if (a_pts == MP_NOPTS_VALUE)
         return MP_NOPTS_VALUE;
 
-    // d_audio->pts is the timestamp of the latest input packet with
-    // known pts that the decoder has decoded. d_audio->pts_bytes is
-    // the amount of bytes the decoder has written after that timestamp.
-    a_pts += d_audio->pts_offset / (double)in_format.rate;
-
-    // Now a_pts hopefully holds the pts for end of audio from decoder.
-    // Subtract data in buffers between decoder and audio out.
-
-    // Decoded but not filtered
-    if (d_audio->waiting)
-        a_pts -= d_audio->waiting->samples / (double)in_format.rate;
-
-    // Data buffered in audio filters, measured in seconds of "missing" output
-    double buffered_output = af_calc_delay(d_audio->afilter);
-
-    // Data that was ready for ao but was buffered because ao didn't fully
-    // accept everything to internal buffers yet
-    buffered_output += mp_audio_buffer_seconds(mpctx->ao_buffer);
-
-    // Filters divide audio length by playback_speed, so multiply by it
-    // to get the length in original units without speedup or slowdown
-    a_pts -= buffered_output * mpctx->opts->playback_speed;
+    // Subtract data that was ready for ao but was buffered because ao didn't
+    // fully accept everything to internal buffers yet. Filters divide audio
+    // length by playback_speed, so multiply by it to get the length in
+    // original units without speedup or slowdown.
+    a_pts -= mp_audio_buffer_seconds(mpctx->ao_buffer) *
+             mpctx->opts->playback_speed;
 
     return a_pts +
         get_track_video_offset(mpctx, mpctx->current_track[0][STREAM_AUDIO]);
@@ -608,6 +681,15 @@ void fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
     assert(played >= 0 && played <= data.samples);
     mp_audio_buffer_skip(mpctx->ao_buffer, played);
 
+    if (played > 0 && mpctx->audio_restart_start > 0) {
+        double latency = mp_time_sec() - mpctx->audio_restart_start;
+        MP_VERBOSE(mpctx, "Audio restarted %.1f ms after seek%s.\n",
+                   latency * 1e3,
+                   mpctx->audio_restart_cached ? " (from cache)" : "");
+        mpctx->audio_restart_latency = latency;
+        mpctx->audio_restart_start = 0;
+    }
+
     mpctx->audio_status = STATUS_PLAYING;
     if (audio_eof && !mpctx->paused) {
         mpctx->audio_status = STATUS_DRAINING;
@@ -1018,6 +1018,7 @@ static int mp_property_angle(void *ctx, struct m_property *prop,
         if (angle < 0 || angle > angles)
             return M_PROPERTY_ERROR;
 
+        audio_pause_thread(mpctx->d_audio);
         demux_pause(demuxer);
         demux_flush(demuxer);
         ris = demux_stream_control(demuxer, STREAM_CTRL_SET_ANGLE, &angle);
@@ -1026,6 +1027,7 @@ static int mp_property_angle(void *ctx, struct m_property *prop,
 
         reset_audio_state(mpctx);
         reset_video_state(mpctx);
+        audio_unpause_thread(mpctx->d_audio);
 
         return ris == STREAM_OK ? M_PROPERTY_OK : M_PROPERTY_ERROR;
     case M_PROPERTY_GET_TYPE: {
@@ -1366,6 +1368,38 @@ static int mp_property_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, !!idle);
 }
 
+static int mp_property_cache_speed(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    double speed = -1;
+    if (mpctx->demuxer)
+        demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_SPEED, &speed);
+    if (speed < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    if (action == M_PROPERTY_PRINT) {
+        char *size = format_file_size(speed);
+        *(char **)arg = talloc_asprintf(NULL, "%s/s", size);
+        talloc_free(size);
+        return M_PROPERTY_OK;
+    }
+    return m_property_int64_ro(action, arg, speed);
+}
+
+static int mp_property_cache_underrun_time(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    double t = -1;
+    if (mpctx->demuxer) {
+        demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_UNDERRUN_TIME,
+                             &t);
+    }
+    if (t < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, t);
+}
+
 static int mp_property_demuxer_cache_duration(void *ctx, struct m_property *prop,
                                               int action, void *arg)
 {
@@ -1415,6 +1449,45 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, s.idle);
 }
 
+static int mp_property_demuxer_lock_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct demux_ctrl_lock_stats s;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_LOCK_STATS, &s) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"locks",       SUB_PROP_INT64(s.locks)},
+        {"waits",       SUB_PROP_INT64(s.waits)},
+        {"wait-time",   SUB_PROP_DOUBLE(s.wait_time)},
+        {"lockless",    SUB_PROP_INT64(s.lockless)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_demuxer_packet_pool(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    struct demux_packet_pool_stats s;
+    demux_packet_pool_get_stats(&s);
+
+    struct m_sub_property props[] = {
+        {"hits",        SUB_PROP_INT64(s.hits)},
+        {"misses",      SUB_PROP_INT64(s.misses)},
+        {"held-bytes",  SUB_PROP_INT64(s.held_bytes)},
+        {"used-bytes",  SUB_PROP_INT64(s.used_bytes)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_paused_for_cache(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
@@ -1464,9 +1537,23 @@ static int mp_property_partially_seekable(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, mpctx->demuxer->partially_seekable);
 }
 
+// The mixer uses the audio filter chain, which the audio decoder thread
+// (--audio-decode-ahead) might be using at the same time.
+static int mixer_property(void *ctx, struct m_property *prop, int action,
+                          void *arg,
+                          int (*handler)(void *ctx, struct m_property *prop,
+                                         int action, void *arg))
+{
+    MPContext *mpctx = ctx;
+    audio_pause_thread(mpctx->d_audio);
+    int r = handler(ctx, prop, action, arg);
+    audio_unpause_thread(mpctx->d_audio);
+    return r;
+}
+
 /// Volume (RW)
-static int mp_property_volume(void *ctx, struct m_property *prop,
-                              int action, void *arg)
+static int volume_property(void *ctx, struct m_property *prop,
+                           int action, void *arg)
 {
     MPContext *mpctx = ctx;
     if (!mixer_audio_initialized(mpctx->mixer))
@@ -1505,8 +1592,8 @@ static int mp_property_volume(void *ctx, struct m_property *prop,
 }
 
 /// Mute (RW)
-static int mp_property_mute(void *ctx, struct m_property *prop,
-                            int action, void *arg)
+static int mute_property(void *ctx, struct m_property *prop,
+                         int action, void *arg)
 {
     MPContext *mpctx = ctx;
     if (!mixer_audio_initialized(mpctx->mixer))
@@ -1617,6 +1704,24 @@ static int mp_property_ao_detected_device(void *ctx,struct m_property *prop,
     return m_property_strdup_ro(action, arg, d);
 }
 
+static int mp_property_audio_underruns(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int64_ro(action, arg, ao_get_underruns(mpctx->ao));
+}
+
+static int mp_property_audio_restart_latency(void *ctx, struct m_property *prop,
+                                             int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (mpctx->audio_restart_latency < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->audio_restart_latency);
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -1676,8 +1781,11 @@ static int mp_property_audio_params(void *ctx, struct m_property *prop,
 {
     MPContext *mpctx = ctx;
     struct mp_audio fmt = {0};
-    if (mpctx->d_audio)
+    if (mpctx->d_audio) {
+        audio_pause_thread(mpctx->d_audio);
         fmt = mpctx->d_audio->decode_format;
+        audio_unpause_thread(mpctx->d_audio);
+    }
     return property_audiofmt(fmt, action, arg);
 }
 
@@ -1692,8 +1800,8 @@ static int mp_property_audio_out_params(void *ctx, struct m_property *prop,
 }
 
 /// Balance (RW)
-static int mp_property_balance(void *ctx, struct m_property *prop,
-                               int action, void *arg)
+static int balance_property(void *ctx, struct m_property *prop,
+                            int action, void *arg)
 {
     MPContext *mpctx = ctx;
     float bal;
@@ -1733,6 +1841,24 @@ static int mp_property_balance(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_volume(void *ctx, struct m_property *prop,
+                              int action, void *arg)
+{
+    return mixer_property(ctx, prop, action, arg, volume_property);
+}
+
+static int mp_property_mute(void *ctx, struct m_property *prop,
+                            int action, void *arg)
+{
+    return mixer_property(ctx, prop, action, arg, mute_property);
+}
+
+static int mp_property_balance(void *ctx, struct m_property *prop,
+                               int action, void *arg)
+{
+    return mixer_property(ctx, prop, action, arg, balance_property);
+}
+
 static struct track* track_next(struct MPContext *mpctx, int order,
                                 enum stream_type type, int direction,
                                 struct track *track)
@@ -2621,6 +2747,61 @@ static int mp_property_vf_fps(void *ctx, struct m_property *prop,
     return m_property_double_ro(action, arg, num / duration);
 }
 
+#define MAX_VF_STATS 32
+
+static int get_vf_stats_entry(int item, int action, void *arg, void *ctx)
+{
+    struct vf_stage_stats *st = &((struct vf_stage_stats *)ctx)[item];
+
+    struct m_sub_property props[] = {
+        {"name",        SUB_PROP_STR(st->name)},
+        {"label",       SUB_PROP_STR(st->label), .unavailable = !st->label},
+        {"latency",     SUB_PROP_DOUBLE(st->latency)},
+        {"queued",      SUB_PROP_INT(st->queued)},
+        {"frames",      SUB_PROP_INT64(st->frames)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_vf_pipeline_stats(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_video)
+        return M_PROPERTY_UNAVAILABLE;
+    struct vf_stage_stats stats[MAX_VF_STATS];
+    int num = vf_get_pipeline_stats(mpctx->d_video->vfilter, stats,
+                                     MAX_VF_STATS);
+    if (num < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_read_list(action, arg, num, get_vf_stats_entry, stats);
+}
+
+static int mp_property_video_decode_queue_depth(void *ctx,
+                                                struct m_property *prop,
+                                                int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_video || !mpctx->d_video->thread)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int_ro(action, arg,
+                             video_thread_queue_depth(mpctx->d_video));
+}
+
+static int mp_property_video_decode_time(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_video)
+        return M_PROPERTY_UNAVAILABLE;
+    double t = video_get_decode_time(mpctx->d_video);
+    if (t <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, t);
+}
+
 /// Video aspect (RO)
 static int mp_property_aspect(void *ctx, struct m_property *prop,
                               int action, void *arg)
@@ -3339,9 +3520,13 @@ static const struct m_property mp_properties[] = {
     {"cache-used", mp_property_cache_used},
     {"cache-size", mp_property_cache_size},
     {"cache-idle", mp_property_cache_idle},
+    {"cache-speed", mp_property_cache_speed},
+    {"cache-underrun-time", mp_property_cache_underrun_time},
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
+    {"demuxer-lock-stats", mp_property_demuxer_lock_stats},
+    {"demuxer-packet-pool", mp_property_demuxer_packet_pool},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"pts-association-mode", mp_property_generic_option},
@@ -3377,6 +3562,8 @@ static const struct m_property mp_properties[] = {
     {"audio-device-list", mp_property_audio_devices},
     {"current-ao", mp_property_ao},
     {"audio-out-detected-device", mp_property_ao_detected_device},
+    {"audio-underruns", mp_property_audio_underruns},
+    {"audio-restart-latency", mp_property_audio_restart_latency},
 
     // Video
     {"fullscreen", mp_property_fullscreen},
@@ -3411,6 +3598,9 @@ static const struct m_property mp_properties[] = {
     {"current-vo", mp_property_vo},
     {"fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
+    {"video-decode-queue-depth", mp_property_video_decode_queue_depth},
+    {"video-decode-time", mp_property_video_decode_time},
+    {"vf-pipeline-stats", mp_property_vf_pipeline_stats},
     {"video-aspect", mp_property_aspect},
     {"vid", mp_property_video},
     {"program", mp_property_program},
@@ -3541,6 +3731,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_METADATA_UPDATE, "metadata", "filtered-metadata", "media-title"),
     E(MPV_EVENT_CHAPTER_CHANGE, "chapter", "chapter-metadata"),
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
+      "cache-speed", "cache-underrun-time",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time"),
     E(MP_EVENT_WIN_RESIZE, "window-scale"),
@@ -4700,11 +4891,13 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
     }
 
     case MP_CMD_DROP_BUFFERS: {
+        audio_pause_thread(mpctx->d_audio);
         reset_audio_state(mpctx);
         reset_video_state(mpctx);
 
         if (mpctx->demuxer)
             demux_flush(mpctx->demuxer);
+        audio_unpause_thread(mpctx->d_audio);
 
         break;
     }
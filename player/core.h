@@ -169,6 +169,9 @@ typedef struct MPContext {
     struct playlist_entry *playing; // currently playing file
     char *filename; // immutable copy of playing->filename (or NULL)
     char *stream_open_filename;
+    struct mp_prefetch *prefetch; // next playlist entry opened in background
+    // Audio decoder the prefetch opened for the current file (if not used yet)
+    struct dec_audio *prefetched_audio;
     enum stop_play_reason stop_play;
     bool playback_initialized; // playloop can be run/is running
     int error_playing;
@@ -239,6 +242,13 @@ typedef struct MPContext {
     bool hrseek_framedrop;  // allow decoder to drop frames before hrseek_pts
     bool hrseek_lastframe;  // drop everything until last frame reached
     double hrseek_pts;
+    // If set, reset_audio_state() restarts decoding at this position from
+    // the decoded audio cache (--audio-seek-cache).
+    double audio_cache_seek_pts;
+    // Time of the last seek, until audio output restarts (0 if none).
+    double audio_restart_start;
+    bool audio_restart_cached;
+    double audio_restart_latency;   // last measured value, or -1
     // AV sync: the next frame should be shown when the audio out has this
     // much (in seconds) buffered data left. Increased when more data is
     // written to the ao, decreased when moving to the next video frame.
@@ -358,6 +368,10 @@ void clear_audio_output_buffers(struct MPContext *mpctx);
 void set_playback_speed(struct MPContext *mpctx, double new_speed);
 void uninit_audio_out(struct MPContext *mpctx);
 void uninit_audio_chain(struct MPContext *mpctx);
+struct dec_audio *audio_decoder_create(struct mpv_global *global,
+                                       struct mp_log *log, struct sh_stream *sh);
+void uninit_prefetched_audio(struct MPContext *mpctx);
+bool queue_audio_cache_seek(struct MPContext *mpctx, double pts);
 
 // configfiles.c
 void mp_parse_cfgfiles(struct MPContext *mpctx);
@@ -396,6 +410,8 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
                                     bool force);
 void mp_set_playlist_entry(struct MPContext *mpctx, struct playlist_entry *e);
 void mp_play_files(struct MPContext *mpctx);
+void handle_playlist_prefetch(struct MPContext *mpctx);
+void cancel_playlist_prefetch(struct MPContext *mpctx);
 void update_demuxer_properties(struct MPContext *mpctx);
 void print_track_list(struct MPContext *mpctx, const char *msg);
 void reselect_demux_streams(struct MPContext *mpctx);
@@ -20,6 +20,7 @@
 #include <strings.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/avutil.h>
 
@@ -29,6 +30,7 @@
 #include "osdep/io.h"
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
+#include "osdep/threads.h"
 
 #include "common/msg.h"
 #include "common/global.h"
@@ -1004,6 +1006,236 @@ static void load_timeline(struct MPContext *mpctx)
     print_timeline(mpctx);
 }
 
+// Background opening of the next playlist entry (--prefetch-playlist).
+struct mp_prefetch {
+    struct playlist_entry *entry;   // referenced with entry->reserved
+    char *filename;
+    int stream_flags;
+    double audio_secs;              // --prefetch-audio
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct input_ctx *input;        // for waking up the playloop when done
+    struct mp_cancel *cancel;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    bool done;
+
+    // results, owned by the prefetch thread until done is set
+    struct stream *stream;
+    struct demuxer *demux;
+    struct timeline *tl;
+    struct dec_audio *d_audio;
+};
+
+// Open the audio decoder and decode the start of the file, so that the
+// transition to it doesn't have to wait for this (for gapless audio). Reading
+// packets discards those of unselected streams, so this is done only if the
+// file has a single audio stream and nothing else that could be selected.
+static void prefetch_audio(struct mp_prefetch *pf)
+{
+    struct MPOpts *opts = pf->global->opts;
+    int aid = opts->stream_id[0][STREAM_AUDIO];
+    if (pf->audio_secs <= 0 || pf->tl || (aid != -1 && aid != 1))
+        return;
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < pf->demux->num_streams; n++) {
+        struct sh_stream *s = pf->demux->streams[n];
+        if (s->type == STREAM_AUDIO && !sh) {
+            sh = s;
+        } else if (!s->attached_picture) {
+            return;
+        }
+    }
+    if (!sh)
+        return;
+
+    struct dec_audio *d_audio = audio_decoder_create(pf->global, pf->log, sh);
+    if (!audio_init_best_codec(d_audio)) {
+        audio_uninit(d_audio);
+        return;
+    }
+    demuxer_select_track(pf->demux, sh, true);
+    audio_prefill(d_audio, pf->audio_secs);
+    pf->d_audio = d_audio;
+}
+
+static void *prefetch_thread(void *p)
+{
+    struct mp_prefetch *pf = p;
+    mpthread_set_name("prefetch");
+
+    pf->stream = stream_create(pf->filename, pf->stream_flags, pf->cancel,
+                               pf->global);
+    if (pf->stream) {
+        // Interactive disc navigation must be initialized before the cache is
+        // enabled, which requires the player. Open these normally.
+        int type = pf->stream->uncached_type;
+        if (type == STREAMTYPE_DVD || type == STREAMTYPE_BLURAY ||
+            type == STREAMTYPE_DVB)
+        {
+            free_stream(pf->stream);
+            pf->stream = NULL;
+        }
+    }
+    if (pf->stream) {
+        stream_enable_cache(&pf->stream, &pf->global->opts->stream_cache);
+        struct demux_open_args args = {
+            .stream = pf->stream,
+            .global = pf->global,
+            .log = pf->log,
+        };
+        open_demux_thread(&args);
+        pf->demux = args.demux;
+        pf->tl = args.tl;
+        if (pf->demux)
+            prefetch_audio(pf);
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    pf->done = true;
+    pthread_mutex_unlock(&pf->lock);
+    mp_input_wakeup(pf->input); // this interrupts mp_idle()
+    return NULL;
+}
+
+static bool prefetch_is_done(struct mp_prefetch *pf)
+{
+    pthread_mutex_lock(&pf->lock);
+    bool done = pf->done;
+    pthread_mutex_unlock(&pf->lock);
+    return done;
+}
+
+// Abort and free a running or finished prefetch, if any.
+void cancel_playlist_prefetch(struct MPContext *mpctx)
+{
+    struct mp_prefetch *pf = mpctx->prefetch;
+    if (!pf)
+        return;
+    mpctx->prefetch = NULL;
+
+    mp_cancel_trigger(pf->cancel);
+    pthread_join(pf->thread, NULL);
+    pthread_mutex_destroy(&pf->lock);
+
+    audio_uninit(pf->d_audio);
+    timeline_destroy(pf->tl);
+    free_demuxer(pf->demux);
+    free_stream(pf->stream);
+    playlist_entry_unref(pf->entry);
+    MP_VERBOSE(mpctx, "Discarded prefetched file %s\n", pf->filename);
+    talloc_free(pf);
+}
+
+// Called by the playloop. Start opening the next playlist entry if the current
+// file is within --prefetch-playlist seconds of its end.
+void handle_playlist_prefetch(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (opts->prefetch_playlist <= 0 || mpctx->prefetch || opts->loop_file ||
+        !mpctx->playback_initialized || !mpctx->playing ||
+        (opts->stream_dump && opts->stream_dump[0]))
+        return;
+
+    double len = get_time_length(mpctx);
+    double pos = get_current_time(mpctx);
+    if (len <= 0 || pos == MP_NOPTS_VALUE ||
+        len - pos > opts->prefetch_playlist * opts->playback_speed)
+        return;
+
+    // Don't use mp_next_file(), which has side-effects. If the loop/shuffle
+    // logic picks a different entry, the prefetched file is simply discarded.
+    struct playlist_entry *e = playlist_get_next(mpctx->playlist, +1);
+    if (!e || !e->filename || e->num_params || e->init_failed)
+        return;
+
+    struct mp_prefetch *pf = talloc_ptrtype(NULL, pf);
+    *pf = (struct mp_prefetch){
+        .entry = e,
+        .filename = talloc_strdup(pf, e->filename),
+        .stream_flags = STREAM_READ,
+        .audio_secs = opts->prefetch_audio,
+        .global = create_sub_global(mpctx),
+        .log = mpctx->log,
+        .input = mpctx->input,
+        .cancel = mp_cancel_new(NULL),
+    };
+    if (!opts->load_unsafe_playlists)
+        pf->stream_flags |= e->stream_flags;
+    pthread_mutex_init(&pf->lock, NULL);
+
+    if (pthread_create(&pf->thread, NULL, prefetch_thread, pf)) {
+        pthread_mutex_destroy(&pf->lock);
+        talloc_free(pf->global);
+        talloc_free(pf->cancel);
+        talloc_free(pf);
+        return;
+    }
+    talloc_steal(pf, pf->global);
+    talloc_steal(pf, pf->cancel);
+    e->reserved += 1;
+    mpctx->prefetch = pf;
+    MP_VERBOSE(mpctx, "Prefetching %s\n", pf->filename);
+}
+
+// If the prefetched entry is what is about to be played, wait for it to finish
+// opening, and move the stream and demuxer to mpctx. Otherwise discard it.
+static void use_playlist_prefetch(struct MPContext *mpctx, int stream_flags)
+{
+    struct mp_prefetch *pf = mpctx->prefetch;
+    if (!pf)
+        return;
+
+    if (pf->entry != mpctx->playing ||
+        strcmp(pf->filename, mpctx->stream_open_filename) != 0 ||
+        pf->stream_flags != stream_flags)
+    {
+        cancel_playlist_prefetch(mpctx);
+        return;
+    }
+
+    // playback_abort was reset when this file started, so if it's triggered,
+    // an abort command (quit, stop, playlist-next...) was sent meanwhile.
+    while (!prefetch_is_done(pf)) {
+        mp_idle(mpctx);
+        if (mpctx->stop_play || mp_cancel_test(mpctx->playback_abort)) {
+            cancel_playlist_prefetch(mpctx);
+            return;
+        }
+    }
+
+    if (!pf->stream || !pf->demux) {
+        // Possibly a transient failure; let the normal code path retry.
+        cancel_playlist_prefetch(mpctx);
+        return;
+    }
+
+    MP_VERBOSE(mpctx, "Using prefetched file.\n");
+    mpctx->prefetch = NULL;
+    pthread_join(pf->thread, NULL);
+    pthread_mutex_destroy(&pf->lock);
+
+    mpctx->stream = pf->stream;
+    mpctx->master_demuxer = pf->demux;
+    mpctx->tl = pf->tl;
+    mpctx->prefetched_audio = pf->d_audio;
+    // The stream and demuxer keep pointers to these.
+    talloc_steal(mpctx->stream, pf->global);
+    talloc_steal(mpctx->stream, pf->cancel);
+    playlist_entry_unref(pf->entry);
+    talloc_free(pf);
+}
+
+// Add the time since *last to *stage, for the startup timing breakdown.
+static void mark_startup_time(double *stage, double *last)
+{
+    double now = mp_time_sec();
+    *stage += now - *last;
+    *last = now;
+}
+
 // Start playing the current playlist entry.
 // Handle initialization and deinitialization.
 static void play_current_file(struct MPContext *mpctx)
@@ -1011,6 +1243,9 @@ static void play_current_file(struct MPContext *mpctx)
     struct MPOpts *opts = mpctx->opts;
     void *tmp = talloc_new(NULL);
     double playback_start = -1e100;
+    double open_start = mp_time_sec(), time_last = open_start;
+    double time_hooks = 0, time_stream = 0, time_demux = 0, time_tracks = 0,
+           time_decoders = 0, time_seek = 0;
 
     mp_notify(mpctx, MPV_EVENT_START_FILE, NULL);
 
@@ -1078,11 +1313,21 @@ static void play_current_file(struct MPContext *mpctx)
     if (process_open_hooks(mpctx) < 0)
         goto terminate_playback;
 
+    mark_startup_time(&time_hooks, &time_last);
+
     int stream_flags = STREAM_READ;
     if (!opts->load_unsafe_playlists)
         stream_flags |= mpctx->playing->stream_flags;
-    mpctx->stream = open_stream_reentrant(mpctx, mpctx->stream_open_filename,
-                                          stream_flags);
+
+    // If the file was prefetched, the stream and demuxer are already open.
+    use_playlist_prefetch(mpctx, stream_flags);
+    bool prefetched = !!mpctx->master_demuxer;
+
+    if (!prefetched) {
+        mpctx->stream = open_stream_reentrant(mpctx,
+                                              mpctx->stream_open_filename,
+                                              stream_flags);
+    }
     if (!mpctx->stream)
         goto terminate_playback;
 
@@ -1095,7 +1340,10 @@ static void play_current_file(struct MPContext *mpctx)
     // Must be called before enabling cache.
     mp_nav_init(mpctx);
 
-    stream_enable_cache(&mpctx->stream, &opts->stream_cache);
+    if (!prefetched)
+        stream_enable_cache(&mpctx->stream, &opts->stream_cache);
+
+    mark_startup_time(&time_stream, &time_last);
 
     mp_notify(mpctx, MP_EVENT_CHANGE_ALL, NULL);
     mp_process_input(mpctx);
@@ -1108,14 +1356,18 @@ goto_reopen_demuxer: ;
 
     mp_nav_reset(mpctx);
 
-    open_demux_reentrant(mpctx);
+    if (!mpctx->master_demuxer)
+        open_demux_reentrant(mpctx);
     if (!mpctx->master_demuxer) {
         MP_ERR(mpctx, "Failed to recognize file format.\n");
         mpctx->error_playing = MPV_ERROR_UNKNOWN_FORMAT;
         goto terminate_playback;
     }
+
     mpctx->demuxer = mpctx->master_demuxer;
 
+    mark_startup_time(&time_demux, &time_last);
+
     load_timeline(mpctx);
 
     if (mpctx->demuxer->playlist) {
@@ -1204,11 +1456,16 @@ goto_reopen_demuxer: ;
         goto terminate_playback;
     }
 
+    mark_startup_time(&time_tracks, &time_last);
+
     reinit_video_chain(mpctx);
     reinit_audio_chain(mpctx);
+    uninit_prefetched_audio(mpctx); // if a different stream was selected
     reinit_subs(mpctx, 0);
     reinit_subs(mpctx, 1);
 
+    mark_startup_time(&time_decoders, &time_last);
+
     MP_VERBOSE(mpctx, "Starting playback...\n");
 
     if (mpctx->max_frames == 0) {
@@ -1235,6 +1492,13 @@ goto_reopen_demuxer: ;
     if (mpctx->opts->pause)
         pause_player(mpctx);
 
+    mark_startup_time(&time_seek, &time_last);
+    MP_VERBOSE(mpctx, "Startup timing: hooks %.3f, stream %.3f, demuxer %.3f, "
+               "tracks %.3f, decoders %.3f, seek %.3f, total %.3f seconds%s.\n",
+               time_hooks, time_stream, time_demux, time_tracks, time_decoders,
+               time_seek, time_last - open_start,
+               prefetched ? " (prefetched)" : "");
+
     mpctx->playback_initialized = true;
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
 
@@ -1250,10 +1514,14 @@ terminate_playback:
     if (mpctx->stop_play == PT_RELOAD_DEMUXER) {
         mpctx->stop_play = KEEP_PLAYING;
         mpctx->playback_initialized = false;
+        uninit_prefetched_audio(mpctx);
         uninit_audio_chain(mpctx);
         uninit_video_chain(mpctx);
         uninit_sub_all(mpctx);
         uninit_demuxer(mpctx);
+        open_start = time_last = mp_time_sec();
+        time_hooks = time_stream = time_demux = time_tracks = 0;
+        time_decoders = time_seek = 0;
         goto goto_reopen_demuxer;
     }
 
@@ -1271,10 +1539,20 @@ terminate_playback:
         opts->pause = 1;
 
     mp_cancel_trigger(mpctx->playback_abort);
+    // A prefetched stream uses its own mp_cancel instance.
+    if (mpctx->stream && mpctx->stream->cancel != mpctx->playback_abort)
+        mp_cancel_trigger(mpctx->stream->cancel);
+    // A prefetch that is still opening is useless unless the player continues
+    // with the next entry. Interrupt it now, so that e.g. a dead network
+    // source doesn't delay quitting.
+    if (mpctx->prefetch && mpctx->stop_play != AT_END_OF_FILE &&
+        mpctx->stop_play != PT_NEXT_ENTRY)
+        mp_cancel_trigger(mpctx->prefetch->cancel);
 
     MP_INFO(mpctx, "\n");
 
     // time to uninit all, except global stuff:
+    uninit_prefetched_audio(mpctx);
     uninit_audio_chain(mpctx);
     uninit_video_chain(mpctx);
     uninit_sub_all(mpctx);
@@ -1416,6 +1694,8 @@ void mp_play_files(struct MPContext *mpctx)
         if (!mpctx->playlist->current && mpctx->opts->player_idle_mode < 2)
             break;
     }
+
+    cancel_playlist_prefetch(mpctx);
 }
 
 // Abort current playback and set the given entry to play next.
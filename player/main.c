@@ -55,9 +55,11 @@
 #include "audio/mixer.h"
 #include "demux/demux.h"
 #include "stream/stream.h"
+#include "stream/rar.h"
 #include "sub/osd.h"
 #include "video/decode/dec_video.h"
 #include "video/out/vo.h"
+#include "video/slice_threads.h"
 
 #include "core.h"
 #include "client.h"
@@ -204,6 +206,9 @@ void mp_destroy(struct MPContext *mpctx)
 
     osd_free(mpctx->osd);
 
+    if (mpctx->initialized)
+        mp_slice_threads_uninit();
+
 #if HAVE_COCOA
     cocoa_set_input_context(NULL);
 #endif
@@ -322,6 +327,8 @@ struct MPContext *mp_create(void)
     struct MPContext *mpctx = talloc(NULL, MPContext);
     *mpctx = (struct MPContext){
         .last_chapter = -2,
+        .audio_cache_seek_pts = MP_NOPTS_VALUE,
+        .audio_restart_latency = -1,
         .term_osd_contents = talloc_strdup(mpctx, ""),
         .osd_progbar = { .type = -1 },
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
@@ -351,6 +358,8 @@ struct MPContext *mp_create(void)
     m_config_parse(mpctx->mconfig, "", bstr0(def_config), NULL, 0);
 
     mpctx->global->opts = mpctx->opts;
+    mpctx->global->rar_cache = RarCacheCreate(mpctx->global);
+    mpctx->global->demux_probe_cache = demux_probe_cache_create(mpctx->global);
 
     mpctx->input = mp_input_init(mpctx->global);
     screenshot_init(mpctx);
@@ -451,6 +460,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mpctx->osd = osd_create(mpctx->global);
 
+    mp_slice_threads_init(opts->video_slice_threads);
+
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
 
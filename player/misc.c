@@ -256,6 +256,8 @@ struct mpv_global *create_sub_global(struct MPContext *mpctx)
     *new = (struct mpv_global){
         .log = mpctx->global->log,
         .opts = new_config->optstruct,
+        .rar_cache = mpctx->global->rar_cache,
+        .demux_probe_cache = mpctx->global->demux_probe_cache,
     };
     return new;
 }
@@ -243,10 +243,18 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
 
     if (hr_seek)
         demuxer_amount -= hr_seek_offset;
-    demux_seek(mpctx->demuxer, demuxer_amount, demuxer_style);
+
+    // Don't let the audio decoder thread read packets from before the seek.
+    audio_pause_thread(mpctx->d_audio);
+
+    // Short seeks in audio-only files may be served from decoded audio.
+    bool audio_cached = seek.type == MPSEEK_ABSOLUTE &&
+                        queue_audio_cache_seek(mpctx, seek.amount);
+    if (!audio_cached)
+        demux_seek(mpctx->demuxer, demuxer_amount, demuxer_style);
 
     // Seek external, extra files too:
-    for (int t = 0; t < mpctx->num_tracks; t++) {
+    for (int t = 0; t < mpctx->num_tracks && !audio_cached; t++) {
         struct track *track = mpctx->tracks[t];
         if (track->selected && track->is_external && track->demuxer) {
             double main_new_pos = seek.amount;
@@ -261,6 +269,7 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
         clear_audio_output_buffers(mpctx);
 
     reset_playback_state(mpctx);
+    audio_unpause_thread(mpctx->d_audio);
 
     if (timeline_fallthrough) {
         // Important if video reinit happens.
@@ -290,6 +299,9 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
     }
 
     mpctx->start_timestamp = mp_time_sec();
+    mpctx->audio_restart_start =
+        mpctx->d_audio && !mpctx->paused ? mpctx->start_timestamp : 0;
+    mpctx->audio_restart_cached = audio_cached;
     mpctx->sleeptime = 0;
 
     mp_notify(mpctx, MPV_EVENT_SEEK, NULL);
@@ -1049,6 +1061,8 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_sstep(mpctx);
 
+    handle_playlist_prefetch(mpctx);
+
     if (mpctx->stop_play)
         return;
 
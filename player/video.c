@@ -301,6 +301,15 @@ int reinit_video_chain(struct MPContext *mpctx)
     if (!video_init_best_codec(d_video, opts->video_decoders))
         goto err_out;
 
+    // Hardware decoders are fast enough, and some of them need to be called
+    // from the thread that created them.
+    int hwdec = HWDEC_NONE;
+    video_vd_control(d_video, VDCTRL_GET_HWDEC, &hwdec);
+    if (opts->video_decode_queue > 0 && !sh->attached_picture &&
+        hwdec == HWDEC_NONE)
+        video_start_thread(d_video, opts->video_decode_queue, wakeup_playloop,
+                           mpctx);
+
     bool saver_state = opts->pause || !opts->stop_screensaver;
     vo_control(mpctx->video_out, saver_state ? VOCTRL_RESTORE_SCREENSAVER
                                              : VOCTRL_KILL_SCREENSAVER, NULL);
@@ -362,38 +371,78 @@ static int check_framedrop(struct MPContext *mpctx)
     return 0;
 }
 
-// Read a packet, store decoded image into d_video->waiting_decoded_mpi
-// returns VD_* code
-static int decode_image(struct MPContext *mpctx)
+// Read a packet for decoding. Returns false if no packet is available yet.
+// *pkt is set to NULL on EOF.
+static bool read_video_packet(struct MPContext *mpctx,
+                              struct demux_packet **out_pkt, int *framedrop)
 {
     struct dec_video *d_video = mpctx->d_video;
 
-    if (d_video->header->attached_picture) {
-        d_video->waiting_decoded_mpi =
-                    video_decode(d_video, d_video->header->attached_picture, 0);
-        return d_video->waiting_decoded_mpi ? VD_EOF : VD_PROGRESS;
-    }
-
     struct demux_packet *pkt;
     if (demux_read_packet_async(d_video->header, &pkt) == 0)
-        return VD_WAIT;
+        return false;
     if (pkt && pkt->pts != MP_NOPTS_VALUE)
         pkt->pts += mpctx->video_offset;
     if (pkt && pkt->dts != MP_NOPTS_VALUE)
         pkt->dts += mpctx->video_offset;
     if ((pkt && pkt->pts >= mpctx->hrseek_pts - .005) ||
-        d_video->has_broken_packet_pts ||
+        video_has_broken_packet_pts(d_video) ||
         !mpctx->opts->hr_seek_framedrop)
     {
         mpctx->hrseek_framedrop = false;
     }
     bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
-    int framedrop_type = hrseek && mpctx->hrseek_framedrop ?
-                         2 : check_framedrop(mpctx);
-    d_video->waiting_decoded_mpi =
-        video_decode(d_video, pkt, framedrop_type);
-    bool had_packet = !!pkt;
-    talloc_free(pkt);
+    *framedrop = hrseek && mpctx->hrseek_framedrop ? 2 : check_framedrop(mpctx);
+    *out_pkt = pkt;
+    return true;
+}
+
+// Feed the decoder thread, and take the next decoded image from its queue.
+static int decode_image_threaded(struct MPContext *mpctx, bool *had_packet)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    while (video_thread_wants_packet(d_video)) {
+        struct demux_packet *pkt;
+        int framedrop_type;
+        if (!read_video_packet(mpctx, &pkt, &framedrop_type))
+            break;
+        video_thread_add_packet(d_video, pkt, framedrop_type);
+    }
+
+    if (!video_thread_get_frame(d_video, &d_video->waiting_decoded_mpi,
+                                had_packet))
+        return VD_WAIT;
+    return *had_packet ? VD_PROGRESS : VD_EOF;
+}
+
+// Read a packet, store decoded image into d_video->waiting_decoded_mpi
+// returns VD_* code
+static int decode_image(struct MPContext *mpctx)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    if (d_video->header->attached_picture) {
+        d_video->waiting_decoded_mpi =
+                    video_decode(d_video, d_video->header->attached_picture, 0);
+        return d_video->waiting_decoded_mpi ? VD_EOF : VD_PROGRESS;
+    }
+
+    bool had_packet;
+    if (d_video->thread) {
+        int r = decode_image_threaded(mpctx, &had_packet);
+        if (r == VD_WAIT)
+            return r;
+    } else {
+        struct demux_packet *pkt;
+        int framedrop_type;
+        if (!read_video_packet(mpctx, &pkt, &framedrop_type))
+            return VD_WAIT;
+        d_video->waiting_decoded_mpi =
+            video_decode(d_video, pkt, framedrop_type);
+        had_packet = !!pkt;
+        talloc_free(pkt);
+    }
 
     if (had_packet && !d_video->waiting_decoded_mpi &&
         mpctx->video_status == STATUS_PLAYING &&
@@ -406,7 +455,6 @@ static int decode_image(struct MPContext *mpctx)
     return had_packet ? VD_PROGRESS : VD_EOF;
 }
 
-
 // Called after video reinit. This can be generally used to try to insert more
 // filters using the filter chain edit functionality in command.c.
 static void init_filter_params(struct MPContext *mpctx)
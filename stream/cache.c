@@ -32,6 +32,15 @@
 // the cache is active.
 #define CACHE_UPDATE_CONTROLS_TIME 2.0
 
+// Time in seconds over which input throughput and reader consumption are
+// sampled. Each sample is averaged into the running estimate.
+#define CACHE_RATE_WINDOW 1.0
+
+// If the measured input throughput is less than this factor times the reader
+// consumption rate, the link is considered slow, and --cache-readahead-secs
+// is ignored: the cache then reads as much as the buffer allows.
+#define CACHE_SLOW_LINK_FACTOR 2.0
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -73,6 +82,7 @@ struct priv {
     int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
+    double readahead_secs;  // readahead target in seconds (0: fill buffer)
 
     struct mp_log *log;
 
@@ -94,9 +104,19 @@ struct priv {
                             // buffer_size)
 
     bool idle;              // cache thread has stopped reading
+    bool limited;           // idle because the readahead target was reached
     int64_t reads;          // number of actual read attempts performed
 
     int64_t read_filepos;   // client read position (mirrors cache->pos)
+    bool rate_reset;        // client seeked; discard current consumption sample
+
+    // Throughput estimation (in bytes/second, -1 if unknown)
+    double speed;           // input throughput while reading
+    double consume_rate;    // rate at which the client reads
+    int64_t speed_bytes;    // bytes read in the current sample window
+    double speed_time;      // time spent in read calls in the current window
+    int64_t consume_pos;    // read_filepos at start of the current window
+    double rate_time;       // start time of the current window
 
     int64_t eof_pos;
 
@@ -149,6 +169,60 @@ static void cache_drop_contents(struct priv *s)
     s->start_pts = MP_NOPTS_VALUE;
 }
 
+static double average_rate(double old, double sample)
+{
+    return old < 0 ? sample : old * 0.7 + sample * 0.3;
+}
+
+// Runs in the cache thread
+static void update_rates(struct priv *s)
+{
+    double now = mp_time_sec();
+    double window = now - s->rate_time;
+    if (window < CACHE_RATE_WINDOW)
+        return;
+
+    if (s->speed_bytes > 0 && s->speed_time > 0)
+        s->speed = average_rate(s->speed, s->speed_bytes / s->speed_time);
+
+    // Windows without any consumption (e.g. while paused) are skipped, so that
+    // the estimate reflects the media bitrate rather than the pause state.
+    int64_t consumed = s->read_filepos - s->consume_pos;
+    if (!s->rate_reset && consumed > 0)
+        s->consume_rate = average_rate(s->consume_rate, consumed / window);
+
+    s->speed_bytes = 0;
+    s->speed_time = 0;
+    s->consume_pos = s->read_filepos;
+    s->rate_reset = false;
+    s->rate_time = now;
+}
+
+// Maximum number of bytes to read ahead of the client read position.
+static int64_t readahead_limit(struct priv *s)
+{
+    if (s->readahead_secs <= 0 || s->consume_rate <= 0)
+        return s->buffer_size;
+    if (s->speed < s->consume_rate * CACHE_SLOW_LINK_FACTOR)
+        return s->buffer_size;
+    int64_t limit = s->readahead_secs * s->consume_rate;
+    return MPCLAMP(limit, FILL_LIMIT * 4, s->buffer_size);
+}
+
+// Estimated time until the client runs out of cached data, or -1 if no
+// underrun is expected (or nothing is known).
+static double get_underrun_time(struct priv *s)
+{
+    if (s->consume_rate <= 0)
+        return -1;
+    double drain = s->consume_rate;
+    if (!s->eof && s->speed > 0)
+        drain -= s->speed;
+    if (drain <= 0)
+        return -1;
+    return MPMAX(s->max_filepos - s->read_filepos, 0) / drain;
+}
+
 // Copy at most dst_size from the cache at the given absolute file position pos.
 // Return number of bytes that could actually be read.
 // Does not advance the file position, or change anything else.
@@ -232,6 +306,18 @@ static bool cache_fill(struct priv *s)
     if (pos >= s->buffer_size)
         pos -= s->buffer_size; // wrap-around
 
+    // Stop reading once the readahead target is reached, and resume only
+    // after a quarter of it has been consumed, to avoid tiny reads.
+    int64_t limit = readahead_limit(s);
+    if (newb >= limit || (s->limited && newb > limit - limit / 4)) {
+        s->limited = true;
+        s->idle = true;
+        s->reads++;
+        return false;
+    }
+    s->limited = false;
+    space = MPMIN(space, limit - newb);
+
     if (space < FILL_LIMIT) {
         s->idle = true;
         s->reads++; // don't stuck main thread
@@ -252,9 +338,16 @@ static bool cache_fill(struct priv *s)
 
     // The read call might take a long time and block, so drop the lock.
     pthread_mutex_unlock(&s->mutex);
+    double read_start = mp_time_sec();
     len = stream_read_partial(s->stream, &s->buffer[pos], space);
+    double read_time = mp_time_sec() - read_start;
     pthread_mutex_lock(&s->mutex);
 
+    if (len > 0) {
+        s->speed_bytes += len;
+        s->speed_time += read_time;
+    }
+
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
     if (s->start_pts == MP_NOPTS_VALUE) {
@@ -368,6 +461,18 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_GET_CACHE_IDLE:
         *(int *)arg = s->idle;
         return STREAM_OK;
+    case STREAM_CTRL_GET_CACHE_SPEED:
+        if (s->speed < 0)
+            return STREAM_UNSUPPORTED;
+        *(double *)arg = s->speed;
+        return STREAM_OK;
+    case STREAM_CTRL_GET_CACHE_UNDERRUN_TIME: {
+        double t = get_underrun_time(s);
+        if (t < 0)
+            return STREAM_UNSUPPORTED;
+        *(double *)arg = t;
+        return STREAM_OK;
+    }
     case STREAM_CTRL_GET_TIME_LENGTH:
         *(double *)arg = s->stream_time_length;
         return s->stream_time_length ? STREAM_OK : STREAM_UNSUPPORTED;
@@ -442,6 +547,7 @@ static void cache_execute_control(struct priv *s)
     } else if (pos_changed || (ok && control_needs_flush(s->control))) {
         MP_VERBOSE(s, "Dropping cache due to control()\n");
         s->read_filepos = stream_tell(s->stream);
+        s->rate_reset = true;
         s->control_flush = true;
         cache_drop_contents(s);
     }
@@ -463,6 +569,7 @@ static void *cache_thread(void *arg)
             update_cached_controls(s);
             last = mp_time_sec();
         }
+        update_rates(s);
         if (s->control > 0) {
             cache_execute_control(s);
         } else {
@@ -517,6 +624,48 @@ static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
     return readb;
 }
 
+// Return a pointer into the ring buffer if [pos, pos + len) is cached and does
+// not wrap around. The read position is set to pos, which guarantees that the
+// cache thread won't overwrite the data (it only writes to parts of the
+// buffer before read_filepos or after max_filepos). Since the client does not
+// call any other stream functions until cache_release(), read_filepos and the
+// buffer stay unchanged meanwhile.
+static void *cache_borrow(stream_t *cache, int64_t pos, int len)
+{
+    struct priv *s = cache->priv;
+    assert(s->cache_thread_running);
+    void *res = NULL;
+
+    pthread_mutex_lock(&s->mutex);
+
+    if (pos >= s->min_filepos && pos + len <= s->max_filepos) {
+        int64_t bpos = pos - s->offset;
+        if (bpos < 0) {
+            bpos += s->buffer_size;
+        } else if (bpos >= s->buffer_size) {
+            bpos -= s->buffer_size;
+        }
+        if (bpos + len <= s->buffer_size) {
+            s->read_filepos = pos;
+            res = &s->buffer[bpos];
+        }
+    }
+
+    pthread_mutex_unlock(&s->mutex);
+    return res;
+}
+
+static void cache_release(stream_t *cache, int64_t pos)
+{
+    struct priv *s = cache->priv;
+
+    pthread_mutex_lock(&s->mutex);
+    s->read_filepos = pos;
+    // wakeup the cache thread, possibly make it read more data ahead
+    pthread_cond_signal(&s->wakeup);
+    pthread_mutex_unlock(&s->mutex);
+}
+
 static int cache_seek(stream_t *cache, int64_t pos)
 {
     struct priv *s = cache->priv;
@@ -536,6 +685,8 @@ static int cache_seek(stream_t *cache, int64_t pos)
         MP_ERR(s, "Attempting to seek before cached data in unseekable stream.\n");
         r = 0;
     } else {
+        if (pos != s->read_filepos)
+            s->rate_reset = true;
         cache->pos = s->read_filepos = pos;
         s->eof = false; // so that cache_read() will actually wait for new data
         pthread_cond_signal(&s->wakeup);
@@ -611,6 +762,10 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     struct priv *s = talloc_zero(NULL, struct priv);
     s->log = cache->log;
     s->eof_pos = -1;
+    s->speed = s->consume_rate = -1;
+    s->readahead_secs = opts->readahead_secs;
+    s->rate_time = mp_time_sec();
+    s->rate_reset = true; // skip reads done while probing
 
     cache_drop_contents(s);
 
@@ -643,6 +798,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     cache->fill_buffer = cache_fill_buffer;
     cache->control = cache_control;
     cache->close = cache_uninit;
+    cache->borrow = cache_borrow;
+    cache->release = cache_release;
 
     int64_t min = opts->initial * 1024ULL;
     if (min > s->buffer_size - FILL_LIMIT)
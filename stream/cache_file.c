@@ -15,7 +15,20 @@
  * with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#include <sys/file.h>
+#endif
 
 #include "osdep/io.h"
 
@@ -23,35 +36,141 @@
 #include "common/msg.h"
 
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// Minimum amount of data read from the source stream at once.
+#define READ_SIZE (64 * 1024)
+
+// A range of the file that was read from the source stream.
+struct range {
+    int64_t start, end;     // end is exclusive
+};
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
-    uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
+    uint8_t *map;           // whole cache file mapped (if not NULL)
+    // Sorted by start; ranges never overlap or touch each other.
+    struct range *ranges;
+    int num_ranges;
     int64_t size;           // currently known size
-    int64_t max_size;       // max. size for block_bits and cache_file
+    int64_t max_size;       // max. size for the cache file
+    bool write_failed;      // a write failed (warned once)
+
+    // For --cache-dir only.
+    char *index_file;       // if set, write ranges to this file on close
+    char *data_file;
+    char *url;
+    char *mime_type;
+    int64_t valid_size;     // stream size the cached data belongs to
+    bool size_changed;
 };
 
-static bool test_bit(struct priv *p, int64_t pos)
+#define INDEX_HEADER "mpv-cache-index 1"
+
+// Return the index of the last range with start <= pos, or -1 if none.
+static int find_range(struct priv *p, int64_t pos)
 {
-    if (pos < 0 || pos >= p->size)
-        return false;
-    size_t block = pos / BLOCK_SIZE;
-    return p->block_bits[block / 8] & (1 << (block % 8));
+    int lo = 0, hi = p->num_ranges;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (p->ranges[mid].start <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo - 1;
 }
 
-static void set_bit(struct priv *p, int64_t pos, bool bit)
+// Mark [start, end) as valid, merging it with overlapping/adjacent ranges.
+static void add_range(struct priv *p, int64_t start, int64_t end)
 {
-    if (pos < 0 || pos >= p->size)
+    if (start >= end)
         return;
-    size_t block = pos / BLOCK_SIZE;
-    unsigned int m = (1 << (block % 8));
-    p->block_bits[block / 8] = (p->block_bits[block / 8] & ~m) | (bit ? m : 0);
+    int i = find_range(p, start);
+    if (i < 0 || p->ranges[i].end < start) {
+        i += 1;
+        MP_TARRAY_INSERT_AT(p, p->ranges, p->num_ranges, i,
+                            (struct range){start, end});
+    } else {
+        p->ranges[i].end = MPMAX(p->ranges[i].end, end);
+    }
+    // Merge following ranges swallowed by the new one.
+    while (i + 1 < p->num_ranges && p->ranges[i + 1].start <= p->ranges[i].end) {
+        p->ranges[i].end = MPMAX(p->ranges[i].end, p->ranges[i + 1].end);
+        MP_TARRAY_REMOVE_AT(p->ranges, p->num_ranges, i + 1);
+    }
+}
+
+// Forget everything at or after pos.
+static void cut_ranges(struct priv *p, int64_t pos)
+{
+    while (p->num_ranges && p->ranges[p->num_ranges - 1].start >= pos)
+        p->num_ranges--;
+    if (p->num_ranges) {
+        struct range *r = &p->ranges[p->num_ranges - 1];
+        r->end = MPMIN(r->end, pos);
+    }
+}
+
+// Write through the file descriptor even if the file is mapped: unlike a write
+// to the mapping, this fails normally if the disk is full.
+static bool write_data(struct priv *p, int64_t pos, char *data, int len)
+{
+#if HAVE_POSIX
+    int fd = fileno(p->cache_file);
+    while (len > 0) {
+        ssize_t r = pwrite(fd, data, len, pos);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        data += r;
+        pos += r;
+        len -= r;
+    }
+    return true;
+#else
+    return fseeko(p->cache_file, pos, SEEK_SET) == 0 &&
+           fwrite(data, len, 1, p->cache_file) == 1;
+#endif
+}
+
+static int read_data(struct priv *p, int64_t pos, char *buffer, int len)
+{
+    if (p->map) {
+        memcpy(buffer, p->map + pos, len);
+        return len;
+    }
+#if HAVE_POSIX
+    ssize_t r;
+    do {
+        r = pread(fileno(p->cache_file), buffer, len, pos);
+    } while (r < 0 && errno == EINTR);
+    return r;
+#else
+    if (fseeko(p->cache_file, pos, SEEK_SET))
+        return -1;
+    return fread(buffer, 1, len, p->cache_file);
+#endif
+}
+
+// Allocate disk space for [pos, pos + len) of the mapped file, so that writing
+// this range through the mapping can't raise SIGBUS (e.g. if the disk is
+// full). The rest of the file stays sparse.
+static bool reserve_space(struct priv *p, int64_t pos, int64_t len)
+{
+#if HAVE_POSIX_FALLOCATE
+    return posix_fallocate(fileno(p->cache_file), pos, len) == 0;
+#else
+    return false;
+#endif
 }
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -69,36 +188,60 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
         int64_t new_size = -1;
         stream_control(s, STREAM_CTRL_GET_SIZE, &new_size);
         if (p->size >= 0 && new_size != p->size)
-            set_bit(p, BLOCK_ALIGN(p->size), 0);
+            cut_ranges(p, BLOCK_ALIGN(p->size));
+        p->size_changed |= new_size != p->valid_size;
         p->size = MPMIN(p->max_size, new_size);
     }
-    int64_t aligned = BLOCK_ALIGN(s->pos);
-    if (!test_bit(p, aligned)) {
-        char tmp[BLOCK_SIZE];
-        stream_seek(p->original, aligned);
-        int r = stream_read(p->original, tmp, BLOCK_SIZE);
-        if (r < BLOCK_SIZE) {
-            if (p->size < 0) {
-                MP_WARN(s, "suspected EOF\n");
-            } else if (aligned + r < p->size) {
-                MP_ERR(s, "unexpected EOF\n");
-                return -1;
-            }
-        }
-        if (fseeko(p->cache_file, aligned, SEEK_SET))
-            return -1;
-        if (fwrite(tmp, r, 1, p->cache_file) != 1)
-            return -1;
-        set_bit(p, aligned, 1);
-    }
-    if (fseeko(p->cache_file, s->pos, SEEK_SET))
-        return -1;
-    // align/limit to blocks
-    max_len = MPMIN(max_len, BLOCK_SIZE - (s->pos % BLOCK_SIZE));
+    max_len = MPMIN(max_len, p->max_size - s->pos);
     // Limit to max. known file size
     if (p->size >= 0)
         max_len = MPMIN(max_len, p->size - s->pos);
-    return fread(buffer, 1, max_len, p->cache_file);
+    if (max_len <= 0)
+        return 0;
+
+    int i = find_range(p, s->pos);
+    if (i >= 0 && s->pos < p->ranges[i].end) {
+        max_len = MPMIN(max_len, p->ranges[i].end - s->pos);
+        return read_data(p, s->pos, buffer, max_len);
+    }
+
+    // Not cached: read from the source. If possible, read directly into the
+    // mapping, and up to the next cached range.
+    int64_t end = p->max_size;
+    if (i + 1 < p->num_ranges)
+        end = p->ranges[i + 1].start;
+    if (p->size >= 0)
+        end = MPMIN(end, p->size);
+    int len = MPMIN(MPMAX(max_len, READ_SIZE), end - s->pos);
+    bool direct = p->map && reserve_space(p, s->pos, len);
+    if (!direct)
+        len = max_len;
+    char *dst = direct ? (char *)p->map + s->pos : buffer;
+    if (stream_seek(p->original, s->pos) < 1)
+        return -1;
+    int r = stream_read(p->original, dst, len);
+    if (r < len) {
+        if (p->size < 0) {
+            MP_WARN(s, "suspected EOF\n");
+        } else if (s->pos + r < p->size) {
+            MP_ERR(s, "unexpected EOF\n");
+            return -1;
+        }
+    }
+    if (r <= 0)
+        return r;
+    if (!direct && !write_data(p, s->pos, buffer, r)) {
+        // E.g. disk full. Return the data, but don't cache it.
+        if (!p->write_failed)
+            MP_WARN(s, "can't write to cache file, not caching new data\n");
+        p->write_failed = true;
+        return r;
+    }
+    add_range(p, s->pos, s->pos + r);
+    r = MPMIN(r, max_len);
+    if (direct)
+        memcpy(buffer, dst, r);
+    return r;
 }
 
 static int seek(stream_t *s, int64_t newpos)
@@ -112,19 +255,267 @@ static int control(stream_t *s, int cmd, void *arg)
     return stream_control(p->original, cmd, arg);
 }
 
+// Write the list of cached ranges and the data they belong to.
+static void write_index(stream_t *s, struct priv *p)
+{
+    if (p->size_changed) {
+        MP_VERBOSE(s, "stream size changed, discarding cache file\n");
+        unlink(p->index_file);
+        unlink(p->data_file);
+        return;
+    }
+    bstr data = {0};
+    bstr_xappend_asprintf(p, &data, "%s\n", INDEX_HEADER);
+    bstr_xappend_asprintf(p, &data, "url %s\n", p->url);
+    bstr_xappend_asprintf(p, &data, "size %"PRId64"\n", p->valid_size);
+    bstr_xappend_asprintf(p, &data, "mime %s\n",
+                          p->mime_type ? p->mime_type : "");
+    for (int n = 0; n < p->num_ranges; n++) {
+        bstr_xappend_asprintf(p, &data, "range %"PRId64" %"PRId64"\n",
+                              p->ranges[n].start, p->ranges[n].end);
+    }
+    if (!mp_save_file_atomic(p->index_file, data))
+        MP_ERR(s, "can't write cache index '%s'\n", p->index_file);
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#if HAVE_POSIX
+    if (p->map)
+        munmap(p->map, p->max_size);
+#endif
+    // Write the index while the data file is still locked.
+    if (p->index_file)
+        write_index(s, p);
     if (p->cache_file)
         fclose(p->cache_file);
     talloc_free(p);
 }
 
+// Map the whole cache file, so that cached data is read from memory, and new
+// data is read from the source directly into the file. The file is sparse;
+// only the ranges that are written are allocated (see reserve_space()).
+// Fails gracefully.
+static void map_file(stream_t *cache, struct priv *p)
+{
+#if HAVE_POSIX
+    int fd = fileno(p->cache_file);
+    if (p->max_size > (size_t)-1 || ftruncate(fd, p->max_size))
+        return;
+    void *map = mmap(NULL, p->max_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if (map == MAP_FAILED) {
+        MP_VERBOSE(cache, "can't map cache file, using normal I/O\n");
+        return;
+    }
+    p->map = map;
+#endif
+}
+
+// Read the index written by a previous session, and restore the cached ranges
+// if they belong to the same data. Return false if the data file is invalid.
+static bool read_index(stream_t *cache, struct priv *p)
+{
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+    bstr data = stream_read_file(p->index_file, tmp, cache->global, 16 << 20);
+    bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+    if (!bstr_equals0(line, INDEX_HEADER))
+        goto done;
+    bool url_ok = false, size_ok = false, mime_ok = false;
+    while (data.len) {
+        line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        bstr key, val;
+        bstr_split_tok(line, " ", &key, &val);
+        if (bstr_equals0(key, "url")) {
+            url_ok = bstr_equals0(val, p->url);
+        } else if (bstr_equals0(key, "size")) {
+            size_ok = bstrtoll(val, NULL, 10) == p->valid_size;
+        } else if (bstr_equals0(key, "mime")) {
+            mime_ok = bstr_equals0(val, p->mime_type ? p->mime_type : "");
+        } else if (bstr_equals0(key, "range")) {
+            bstr rest;
+            long long start = bstrtoll(val, &rest, 10);
+            long long end = bstrtoll(bstr_strip(rest), NULL, 10);
+            if (start >= 0 && end <= p->max_size)
+                add_range(p, start, end);
+        }
+    }
+    ok = url_ok && size_ok && mime_ok;
+    if (!ok)
+        p->num_ranges = 0;
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
+struct cache_entry {
+    char *key;
+    char *data_file;
+    int64_t size;
+    time_t mtime;
+};
+
+static int compare_entry_mtime(const void *a, const void *b)
+{
+    const struct cache_entry *e1 = a, *e2 = b;
+    return e1->mtime > e2->mtime ? 1 : (e1->mtime < e2->mtime ? -1 : 0);
+}
+
+// Open the file for reading and writing, and lock it for exclusive use by this
+// process. The file is created if create is set; it is never truncated. On
+// failure, *busy is set if the file is locked by another process.
+static FILE *open_locked(const char *filename, bool create, bool *busy)
+{
+    *busy = false;
+    int flags = O_RDWR | O_BINARY | O_CLOEXEC | (create ? O_CREAT : 0);
+    int fd = open(filename, flags, 0666);
+    if (fd < 0)
+        return NULL;
+#if HAVE_POSIX
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        *busy = errno == EWOULDBLOCK;
+        close(fd);
+        return NULL;
+    }
+#endif
+    FILE *f = fdopen(fd, "rb+");
+    if (!f)
+        close(fd);
+    return f;
+}
+
+// Delete the least recently used cache files until the total size of all
+// data files is below the limit. The entry for "keep" is never deleted.
+static void trim_cache_dir(stream_t *cache, const char *dir, int64_t max_size,
+                           const char *keep)
+{
+    void *tmp = talloc_new(NULL);
+    struct cache_entry *entries = NULL;
+    int num_entries = 0;
+    int64_t total = 0;
+
+    DIR *d = opendir(dir);
+    if (!d)
+        goto done;
+    struct dirent *ep;
+    while ((ep = readdir(d))) {
+        bstr name = bstr0(ep->d_name);
+        if (!bstr_endswith0(name, ".data"))
+            continue;
+        char *key = bstrdup0(tmp, bstr_splice(name, 0, -5));
+        char *data_file = mp_path_join(tmp, dir, ep->d_name);
+        char *index_file =
+            mp_path_join(tmp, dir, talloc_asprintf(tmp, "%s.idx", key));
+        struct stat st;
+        if (stat(data_file, &st))
+            continue;
+        struct cache_entry e = {
+            .key = key,
+            .mtime = st.st_mtime,
+#if HAVE_POSIX
+            .size = st.st_blocks * 512LL, // sparse files
+#else
+            .size = st.st_size,
+#endif
+        };
+        if (!stat(index_file, &st))
+            e.mtime = st.st_mtime;
+        e.data_file = data_file;
+        total += e.size;
+        if (strcmp(key, keep) != 0)
+            MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+    }
+    closedir(d);
+
+    qsort(entries, num_entries, sizeof(entries[0]), compare_entry_mtime);
+    for (int n = 0; n < num_entries && total > max_size; n++) {
+        struct cache_entry *e = &entries[n];
+        // Skip entries used by other processes (or that can't be opened).
+        bool busy;
+        FILE *f = open_locked(e->data_file, false, &busy);
+        if (!f)
+            continue;
+        MP_VERBOSE(cache, "removing old cache entry %s\n", e->key);
+        unlink(mp_path_join(tmp, dir, talloc_asprintf(tmp, "%s.idx", e->key)));
+        unlink(e->data_file);
+        fclose(f);
+        total -= e->size;
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Open the per-URL data file in --cache-dir, reusing its contents if the
+// index says they belong to the same stream. The data file stays locked while
+// it's open; the lock also covers the index, which is only read and written
+// by the lock holder. If another process uses the cache entry, a temporary
+// file is used instead.
+static FILE *open_persistent(stream_t *cache, struct priv *p,
+                             struct mp_cache_opts *opts)
+{
+    stream_t *stream = p->original;
+    if (!stream->url || p->valid_size <= 0) {
+        MP_VERBOSE(cache, "stream size unknown, not using --cache-dir\n");
+        return NULL;
+    }
+
+    char *dir = mp_get_user_path(p, cache->global, opts->dir);
+    mp_mkdirp(dir);
+
+    char *key = mp_hash_filename(p, stream->url);
+
+    p->url = talloc_strdup(p, stream->url);
+    p->mime_type = talloc_strdup(p, stream->mime_type);
+    p->index_file = mp_path_join(p, dir, talloc_asprintf(p, "%s.idx", key));
+    p->data_file = mp_path_join(p, dir, talloc_asprintf(p, "%s.data", key));
+
+    trim_cache_dir(cache, dir, opts->dir_max * 1024LL, key);
+
+    bool busy;
+    FILE *file = open_locked(p->data_file, true, &busy);
+    if (!file) {
+        p->index_file = NULL;
+        if (!busy) {
+            MP_ERR(cache, "can't open cache file '%s'\n", p->data_file);
+            return NULL;
+        }
+        MP_VERBOSE(cache, "cache file '%s' is in use, using a temporary "
+                   "file\n", p->data_file);
+        file = tmpfile();
+        if (!file)
+            MP_ERR(cache, "can't create temporary cache file\n");
+        return file;
+    }
+    if (read_index(cache, p)) {
+        int64_t bytes = 0;
+        for (int n = 0; n < p->num_ranges; n++)
+            bytes += p->ranges[n].end - p->ranges[n].start;
+        MP_VERBOSE(cache, "reusing %"PRId64" cached bytes from %s\n",
+                   bytes, p->data_file);
+    } else {
+        p->num_ranges = 0;
+        // Make sure a stale index is never used with the new data.
+        unlink(p->index_file);
+        if (ftruncate(fileno(file), 0)) {
+            MP_ERR(cache, "can't truncate cache file '%s'\n", p->data_file);
+            fclose(file);
+            p->index_file = NULL;
+            return NULL;
+        }
+    }
+    return file;
+}
+
 // return 1 on success, 0 if disabled, -1 on error
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts)
 {
-    if (!opts->file || !opts->file[0] || opts->file_max < 1)
+    bool use_file = opts->file && opts->file[0];
+    bool use_dir = !use_file && opts->dir && opts->dir[0];
+    if ((!use_file && !use_dir) || opts->file_max < 1)
         return 0;
 
     if (!stream->seekable) {
@@ -132,22 +523,36 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
         return -1;
     }
 
-    bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->original = stream;
+    p->max_size = opts->file_max * 1024LL;
+    p->size = -1;
+
+    // Don't make the file larger than necessary.
+    int64_t size = -1;
+    if (stream_control(stream, STREAM_CTRL_GET_SIZE, &size) == STREAM_OK &&
+        size > 0)
+        p->max_size = MPMIN(p->max_size, size);
+    p->valid_size = size;
+
+    FILE *file = NULL;
+    if (use_dir) {
+        file = open_persistent(cache, p, opts);
+    } else {
+        bool use_anon_file = strcmp(opts->file, "TMP") == 0;
+        file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+        if (!file)
+            MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+    }
     if (!file) {
-        MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
-        return -1;
+        talloc_free(p);
+        return use_dir ? 0 : -1;
     }
 
-    struct priv *p = talloc_zero(NULL, struct priv);
-
     cache->priv = p;
-    p->original = stream;
     p->cache_file = file;
-    p->max_size = opts->file_max * 1024LL;
 
-    // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
+    map_file(cache, p);
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
@@ -28,11 +28,15 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include <libavutil/intreadwrite.h>
 
 #include "talloc.h"
 #include "common/common.h"
+#include "common/global.h"
+#include "misc/thread_pool.h"
+#include "options/options.h"
 #include "stream.h"
 #include "rar.h"
 
@@ -158,8 +162,34 @@ static int SkipEnd(struct stream *s, const rar_block_t *hdr)
     return 0;
 }
 
-static int SkipFile(struct stream *s, int *count, rar_file_t ***file,
-                    const rar_block_t *hdr, const char *volume_mrl)
+typedef struct {
+    char     *name;
+    uint64_t file_size;
+    uint16_t flags;
+    uint64_t offset;    /* Start of the file data in the volume */
+    uint64_t size;      /* Size of the file data in the volume */
+} rar_entry_t;
+
+typedef struct {
+    char        *mrl;
+    rar_entry_t *entries;
+    int         entry_count;
+    int         has_next;   /* -1 if unknown */
+    bool        opened;
+    bool        ok;
+} rar_volume_t;
+
+static void VolumeDelete(rar_volume_t *vol)
+{
+    for (int i = 0; i < vol->entry_count; i++)
+        free(vol->entries[i].name);
+    talloc_free(vol->entries);
+    free(vol->mrl);
+    *vol = (rar_volume_t){0};
+}
+
+static int ReadFileBlock(struct stream *s, rar_volume_t *vol,
+                         const rar_block_t *hdr)
 {
     int min_size = 7+21;
     if (hdr->flags & RAR_BLOCK_FILE_HAS_HIGH)
@@ -196,46 +226,69 @@ static int SkipFile(struct stream *s, int *count, rar_file_t ***file,
         memcpy(name, &namedata.start[name_offset], name_size);
     }
 
-    rar_file_t *current = NULL;
     if (method != 0x30) {
         MP_WARN(s, "Ignoring compressed file %s (method=0x%2.2x)\n", name, method);
-        goto exit;
+        free(name);
+    } else {
+        rar_entry_t entry = {
+            .name = name,
+            .file_size = file_size,
+            .flags = hdr->flags,
+            .offset = stream_tell(s) + hdr->size,
+            .size = hdr->add_size,
+        };
+        MP_TARRAY_APPEND(NULL, vol->entries, vol->entry_count, entry);
+
+        /* We stop on the first non empty file if we cannot seek */
+        if (!s->seekable && file_size > 0)
+            return -1;
     }
 
-    /* */
+    if (SkipBlock(s, hdr))
+        return -1;
+    return 0;
+}
+
+/* Add the entry as chunk to the file list, starting a new file if needed. */
+static void AddChunk(int *count, rar_file_t ***file, const rar_entry_t *entry,
+                     const char *volume_mrl)
+{
+    rar_file_t *current = NULL;
     if( *count > 0 )
         current = (*file)[*count - 1];
 
     if (current &&
         (current->is_complete ||
-          strcmp(current->name, name) ||
-          (hdr->flags & RAR_BLOCK_FILE_HAS_PREVIOUS) == 0))
+          strcmp(current->name, entry->name) ||
+          (entry->flags & RAR_BLOCK_FILE_HAS_PREVIOUS) == 0))
         current = NULL;
 
     if (!current) {
-        if (hdr->flags & RAR_BLOCK_FILE_HAS_PREVIOUS)
-            goto exit;
+        if (entry->flags & RAR_BLOCK_FILE_HAS_PREVIOUS)
+            return;
         current = calloc(1, sizeof(*current));
         if (!current)
-            goto exit;
+            return;
+        current->name = strdup(entry->name);
+        if (!current->name) {
+            free(current);
+            return;
+        }
         MP_TARRAY_APPEND(NULL, *file, *count, current);
 
-        current->name = name;
-        current->size = file_size;
+        current->size = entry->file_size;
         current->is_complete = false;
         current->real_size = 0;
         current->chunk_count = 0;
         current->chunk = NULL;
-
-        name = NULL;
     }
 
     /* Append chunks */
     rar_file_chunk_t *chunk = malloc(sizeof(*chunk));
     if (chunk) {
         chunk->mrl = strdup(volume_mrl);
-        chunk->offset = stream_tell(s) + hdr->size;
-        chunk->size = hdr->add_size;
+        chunk->offset = entry->offset;
+        chunk->size = entry->size;
         chunk->cummulated_size = 0;
         if (current->chunk_count > 0) {
             rar_file_chunk_t *previous = current->chunk[current->chunk_count-1];
@@ -246,23 +299,46 @@ static int SkipFile(struct stream *s, int *count, rar_file_t ***file,
 
         MP_TARRAY_APPEND(NULL, current->chunk, current->chunk_count, chunk);
 
-        current->real_size += hdr->add_size;
+        current->real_size += entry->size;
     }
-    if ((hdr->flags & RAR_BLOCK_FILE_HAS_NEXT) == 0)
+    if ((entry->flags & RAR_BLOCK_FILE_HAS_NEXT) == 0)
         current->is_complete = true;
+}
+
+/* Read the file headers of a single volume. */
+static int ParseVolume(struct stream *s, rar_volume_t *vol)
+{
+    /* Skip marker & archive */
+    if (IgnoreBlock(s, RAR_BLOCK_MARKER) ||
+        IgnoreBlock(s, RAR_BLOCK_ARCHIVE))
+        return -1;
 
-exit:
     /* */
-    free(name);
+    int has_next = -1;
+    for (;;) {
+        rar_block_t bk;
+        int ret;
 
-    /* We stop on the first non empty file if we cannot seek */
-    if (current) {
-        if (!s->seekable && current->size > 0)
-            return -1;
-    }
+        if (PeekBlock(s, &bk))
+            break;
 
-    if (SkipBlock(s, hdr))
-        return -1;
+        switch(bk.type) {
+        case RAR_BLOCK_END:
+            ret = SkipEnd(s, &bk);
+            has_next = ret && (bk.flags & RAR_BLOCK_END_HAS_NEXT);
+            break;
+        case RAR_BLOCK_FILE:
+            ret = ReadFileBlock(s, vol, &bk);
+            break;
+        default:
+            ret = SkipBlock(s, &bk);
+            break;
+        }
+        if (ret)
+            break;
+    }
+    vol->has_next = has_next;
+    vol->ok = true;
     return 0;
 }
 
@@ -305,98 +381,293 @@ static const rar_pattern_t *FindVolumePattern(const char *location)
     return NULL;
 }
 
-int RarParse(struct stream *s, int *count, rar_file_t ***file)
+static char *VolumeName(const char *location, const rar_pattern_t *pattern,
+                        int index)
 {
-    *count = 0;
+    char *volume_base;
+    if (asprintf(&volume_base, "%.*s",
+                 (int)(strlen(location) - strlen(pattern->match)), location) < 0)
+        return NULL;
+
+    char *volume_mrl;
+    if (pattern->start) {
+        if (asprintf(&volume_mrl, pattern->format, volume_base, index) < 0)
+            volume_mrl = NULL;
+    } else {
+        if (asprintf(&volume_mrl, pattern->format, volume_base,
+                     'r' + index / 100, index % 100) < 0)
+            volume_mrl = NULL;
+    }
+    free(volume_base);
+    return volume_mrl;
+}
+
+/* Maximum number of volumes opened and parsed concurrently. The actual number
+ * is set with --rar-parallel-volumes (default: 1, one after the other). The
+ * headers don't say how many volumes there are, so with more than 1, volumes
+ * past the end of the set are opened speculatively, and simply fail to open. */
+#define RAR_MAX_PARALLEL_VOLUMES 32
+
+struct volume_batch {
+    struct stream *s;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;
+};
+
+struct volume_job {
+    struct volume_batch *batch;
+    rar_volume_t *vol;
+};
+
+static void ParseVolumeJob(void *ctx)
+{
+    struct volume_job *job = ctx;
+    struct volume_batch *batch = job->batch;
+    struct stream *s = batch->s;
+
+    struct stream *vol = stream_create(job->vol->mrl, STREAM_READ, s->cancel,
+                                       s->global);
+    if (vol) {
+        job->vol->opened = true;
+        ParseVolume(vol, job->vol);
+        free_stream(vol);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->pending--;
+    pthread_cond_signal(&batch->wakeup);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/* Add the files of a parsed volume, and return whether to continue with the
+ * next volume. */
+static int MergeVolume(int *count, rar_file_t ***file, const rar_volume_t *vol)
+{
+    for (int i = 0; i < vol->entry_count; i++)
+        AddChunk(count, file, &vol->entries[i], vol->mrl);
+
+    int has_next = vol->has_next;
+    if (has_next < 0 && *count > 0 && !(*file)[*count -1]->is_complete)
+        has_next = 1;
+    return has_next;
+}
+
+static void DeleteFiles(int *count, rar_file_t ***file)
+{
+    for (int i = 0; i < *count; i++)
+        RarFileDelete((*file)[i]);
+    talloc_free(*file);
     *file = NULL;
+    *count = 0;
+}
 
-    const rar_pattern_t *pattern = FindVolumePattern(s->url);
-    int volume_offset = 0;
+/* Parsed archives, so that opening a file from a volume set that was listed
+ * before (the normal case: demux_rar.c lists it, stream_rar.c opens an entry)
+ * does not read all volume headers again. There is one cache per player
+ * instance (mpv_global.rar_cache). */
+#define RAR_CACHE_SIZE 8
+
+struct rar_cache_entry {
+    char       *url;
+    int64_t    size;    /* Size of the first volume */
+    int        count;
+    rar_file_t **files;
+};
 
-    char *volume_mrl;
-    if (asprintf(&volume_mrl, "%s", s->url) < 0)
-        return -1;
+struct rar_cache {
+    pthread_mutex_t lock;
+    struct rar_cache_entry entries[RAR_CACHE_SIZE];
+    int next;   /* entry to replace next (round robin) */
+};
 
-    struct stream *vol = s;
-    for (;;) {
-        /* Skip marker & archive */
-        if (IgnoreBlock(vol, RAR_BLOCK_MARKER) ||
-            IgnoreBlock(vol, RAR_BLOCK_ARCHIVE)) {
-            if (vol != s)
-                free_stream(vol);
-            free(volume_mrl);
-            return -1;
+static rar_file_t *RarFileCopy(const rar_file_t *file)
+{
+    rar_file_t *copy = calloc(1, sizeof(*copy));
+    if (!copy)
+        return NULL;
+    copy->name = strdup(file->name);
+    copy->size = file->size;
+    copy->is_complete = file->is_complete;
+    copy->real_size = file->real_size;
+    for (int i = 0; i < file->chunk_count; i++) {
+        rar_file_chunk_t *chunk = malloc(sizeof(*chunk));
+        if (!chunk)
+            break;
+        *chunk = *file->chunk[i];
+        chunk->mrl = strdup(chunk->mrl);
+        MP_TARRAY_APPEND(NULL, copy->chunk, copy->chunk_count, chunk);
+    }
+    if (!copy->name || copy->chunk_count < file->chunk_count) {
+        RarFileDelete(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static bool RarFilesCopy(int count, rar_file_t **files, int *out_count,
+                      rar_file_t ***out_files)
+{
+    *out_count = 0;
+    *out_files = NULL;
+    for (int i = 0; i < count; i++) {
+        rar_file_t *copy = RarFileCopy(files[i]);
+        if (!copy) {
+            DeleteFiles(out_count, out_files);
+            return false;
         }
+        MP_TARRAY_APPEND(NULL, *out_files, *out_count, copy);
+    }
+    return true;
+}
 
-        /* */
-        int has_next = -1;
-        for (;;) {
-            rar_block_t bk;
-            int ret;
+static void CacheDestroy(void *ptr)
+{
+    struct rar_cache *cache = ptr;
+    for (int i = 0; i < RAR_CACHE_SIZE; i++) {
+        free(cache->entries[i].url);
+        DeleteFiles(&cache->entries[i].count, &cache->entries[i].files);
+    }
+    pthread_mutex_destroy(&cache->lock);
+}
 
-            if (PeekBlock(vol, &bk))
-                break;
+struct rar_cache *RarCacheCreate(void *talloc_ctx)
+{
+    struct rar_cache *cache = talloc_zero(talloc_ctx, struct rar_cache);
+    pthread_mutex_init(&cache->lock, NULL);
+    talloc_set_destructor(cache, CacheDestroy);
+    return cache;
+}
 
-            switch(bk.type) {
-            case RAR_BLOCK_END:
-                ret = SkipEnd(vol, &bk);
-                has_next = ret && (bk.flags & RAR_BLOCK_END_HAS_NEXT);
-                break;
-            case RAR_BLOCK_FILE:
-                ret = SkipFile(vol, count, file, &bk, volume_mrl);
-                break;
-            default:
-                ret = SkipBlock(vol, &bk);
-                break;
-            }
-            if (ret)
-                break;
-        }
-        if (has_next < 0 && *count > 0 && !(*file)[*count -1]->is_complete)
-            has_next = 1;
-        if (vol != s)
-            free_stream(vol);
-
-        if (!has_next || !pattern)
-            goto done;
-
-        /* Open next volume */
-        const int volume_index = pattern->start + volume_offset++;
-        if (volume_index > pattern->stop)
-            goto done;
-
-        char *volume_base;
-        if (asprintf(&volume_base, "%.*s",
-                     (int)(strlen(s->url) - strlen(pattern->match)), s->url) < 0) {
-            goto done;
+static bool CacheLookup(struct rar_cache *cache, const char *url, int64_t size,
+                        int *count, rar_file_t ***file)
+{
+    if (!cache)
+        return false;
+    bool found = false;
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < RAR_CACHE_SIZE; i++) {
+        struct rar_cache_entry *e = &cache->entries[i];
+        if (e->url && !strcmp(e->url, url) && e->size == size) {
+            found = RarFilesCopy(e->count, e->files, count, file);
+            break;
         }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
 
-        free(volume_mrl);
-        if (pattern->start) {
-            if (asprintf(&volume_mrl, pattern->format, volume_base, volume_index) < 0)
-                volume_mrl = NULL;
-        } else {
-            if (asprintf(&volume_mrl, pattern->format, volume_base,
-                         'r' + volume_index / 100, volume_index % 100) < 0)
-                volume_mrl = NULL;
-        }
-        free(volume_base);
+static void CacheStore(struct rar_cache *cache, const char *url, int64_t size,
+                       int count, rar_file_t **files)
+{
+    if (!cache)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    struct rar_cache_entry *e = NULL;
+    for (int i = 0; i < RAR_CACHE_SIZE; i++) {
+        if (cache->entries[i].url && !strcmp(cache->entries[i].url, url))
+            e = &cache->entries[i];
+    }
+    if (!e) {
+        e = &cache->entries[cache->next];
+        cache->next = (cache->next + 1) % RAR_CACHE_SIZE;
+    }
+    free(e->url);
+    DeleteFiles(&e->count, &e->files);
+    e->size = size;
+    e->url = RarFilesCopy(count, files, &e->count, &e->files) ? strdup(url) : NULL;
+    pthread_mutex_unlock(&cache->lock);
+}
 
-        if (!volume_mrl)
-            goto done;
+int RarParse(struct stream *s, int *count, rar_file_t ***file)
+{
+    *count = 0;
+    *file = NULL;
+
+    struct rar_cache *cache = s->global ? s->global->rar_cache : NULL;
+    int64_t size = -1;
+    stream_control(s, STREAM_CTRL_GET_SIZE, &size);
+    if (CacheLookup(cache, s->url, size, count, file))
+        return 0;
 
-        vol = stream_create(volume_mrl, STREAM_READ, s->cancel, s->global);
+    const rar_pattern_t *pattern = FindVolumePattern(s->url);
+    int volume_offset = 0;
+    int parallel = s->opts ? s->opts->rar_parallel_volumes : 1;
+    parallel = MPCLAMP(parallel, 1, RAR_MAX_PARALLEL_VOLUMES);
+    struct mp_thread_pool *pool = NULL;
+    rar_volume_t volumes[RAR_MAX_PARALLEL_VOLUMES] = {{0}};
+    int num_volumes = 0;
+    int res = 0;
+
+    rar_volume_t first = { .mrl = strdup(s->url) };
+    if (!first.mrl || ParseVolume(s, &first)) {
+        VolumeDelete(&first);
+        return -1;
+    }
+    int has_next = MergeVolume(count, file, &first);
+    VolumeDelete(&first);
+
+    struct volume_batch batch = { .s = s };
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.wakeup, NULL);
+
+    while (has_next && pattern && !mp_cancel_test(s->cancel)) {
+        /* Open the next volumes */
+        num_volumes = 0;
+        while (num_volumes < parallel) {
+            const int volume_index = pattern->start + volume_offset;
+            if (volume_index > pattern->stop)
+                break;
+            char *mrl = VolumeName(s->url, pattern, volume_index);
+            if (!mrl)
+                break;
+            volumes[num_volumes++] = (rar_volume_t){ .mrl = mrl };
+            volume_offset++;
+        }
+        if (!num_volumes)
+            break;
 
-        if (!vol)
-            goto done;
+        if (!pool && parallel > 1)
+            pool = mp_thread_pool_create(NULL, parallel);
+        struct volume_job jobs[RAR_MAX_PARALLEL_VOLUMES];
+        batch.pending = num_volumes;
+        for (int i = 0; i < num_volumes; i++) {
+            jobs[i] = (struct volume_job){ .batch = &batch, .vol = &volumes[i] };
+            if (pool) {
+                mp_thread_pool_queue(pool, ParseVolumeJob, &jobs[i]);
+            } else {
+                ParseVolumeJob(&jobs[i]);
+            }
+        }
+        pthread_mutex_lock(&batch.lock);
+        while (batch.pending)
+            pthread_cond_wait(&batch.wakeup, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        for (int i = 0; i < num_volumes && has_next; i++) {
+            if (!volumes[i].opened) {
+                has_next = 0;
+            } else if (!volumes[i].ok) {
+                res = -1;
+                has_next = 0;
+            } else {
+                has_next = MergeVolume(count, file, &volumes[i]);
+            }
+        }
+        for (int i = 0; i < num_volumes; i++)
+            VolumeDelete(&volumes[i]);
     }
 
-done:
-    free(volume_mrl);
-    if (*count == 0) {
-        talloc_free(*file);
+    talloc_free(pool);
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.wakeup);
+
+    if (res < 0 || *count == 0) {
+        DeleteFiles(count, file);
         return -1;
     }
+    if (s->seekable && !mp_cancel_test(s->cancel))
+        CacheStore(cache, s->url, size, *count, *file);
     return 0;
 }
 
@@ -405,13 +676,22 @@ int  RarSeek(rar_file_t *file, uint64_t position)
     if (position > file->real_size)
         position = file->real_size;
 
-    /* Search the chunk */
+    if (file->chunk_count == 0)
+        return 0;
+
+    /* Search the chunk (the chunks are sorted by cummulated_size) */
     const rar_file_chunk_t *old_chunk = file->current_chunk;
-    for (int i = 0; i < file->chunk_count; i++) {
-        file->current_chunk = file->chunk[i];
-        if (position < file->current_chunk->cummulated_size + file->current_chunk->size)
-            break;
+    int lo = 0, hi = file->chunk_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const rar_file_chunk_t *chunk = file->chunk[mid];
+        if (position < chunk->cummulated_size + chunk->size) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
+    file->current_chunk = file->chunk[lo];
     file->i_pos = position;
 
     const uint64_t offset = file->current_chunk->offset +
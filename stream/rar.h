@@ -51,6 +51,9 @@ typedef struct {
     rar_file_chunk_t *current_chunk;
 } rar_file_t;
 
+struct rar_cache;
+struct rar_cache *RarCacheCreate(void *talloc_ctx);
+
 int  RarProbe(struct stream *);
 void RarFileDelete(rar_file_t *);
 int  RarParse(struct stream *, int *, rar_file_t ***);
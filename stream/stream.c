@@ -504,6 +504,7 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
 {
     assert(s->buf_pos <= s->buf_len);
     assert(buf_size >= 0);
+    assert(!s->borrowed);
     if (s->buf_pos == s->buf_len && buf_size > 0) {
         s->buf_pos = s->buf_len = 0;
         // Do a direct read, but only if there's no sector alignment requirement
@@ -570,6 +571,54 @@ struct bstr stream_peek(stream_t *s, int len)
                   .len = FFMIN(len, s->buf_len - s->buf_pos)};
 }
 
+// Return a pointer to exactly len bytes at the current read position, without
+// copying the data into the stream buffer or a caller-provided buffer. This
+// works only if the data is already available in contiguous memory, either in
+// the stream buffer, or in a buffer owned by the stream implementation (such
+// as the cache ring buffer). Otherwise, an empty bstr is returned, and the
+// caller has to fall back to stream_read().
+// If successful, the caller must call stream_release() before calling any other
+// stream function (except stream_tell()). The data must not be written to.
+struct bstr stream_borrow(stream_t *s, int len)
+{
+    assert(len >= 0);
+    assert(!s->borrowed);
+    if (s->buf_len - s->buf_pos >= len) {
+        s->borrowed = true;
+        return (bstr){&s->buffer[s->buf_pos], len};
+    }
+    if (!s->borrow || s->capture_file || len == 0)
+        return (bstr){0};
+    // Bytes still in the stream buffer are read again from the underlying
+    // buffer, so that the whole range is contiguous.
+    int64_t pos = stream_tell(s);
+    void *data = s->borrow(s, pos, len);
+    if (!data)
+        return (bstr){0};
+    s->pos = pos;
+    s->buf_pos = s->buf_len = 0;
+    s->borrowed = true;
+    return (bstr){data, len};
+}
+
+// End access to the data returned by stream_borrow(), and skip the first len
+// bytes of it (len can be 0 up to the borrowed length).
+void stream_release(stream_t *s, int len)
+{
+    assert(s->borrowed);
+    s->borrowed = false;
+    if (s->buf_pos < s->buf_len) {
+        assert(len <= s->buf_len - s->buf_pos);
+        s->buf_pos += len;
+    } else {
+        s->pos += len;
+        if (s->release)
+            s->release(s, s->pos);
+    }
+    if (len > 0)
+        s->eof = 0;
+}
+
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
 {
     int rd;
@@ -635,6 +684,7 @@ static bool stream_seek_unbuffered(stream_t *s, int64_t newpos)
 bool stream_seek(stream_t *s, int64_t pos)
 {
     MP_TRACE(s, "seek to %lld\n", (long long)pos);
+    assert(!s->borrowed);
 
     s->eof = 0; // eof should be set only on read; seeking always clears it
 
@@ -71,6 +71,8 @@ enum stream_ctrl {
     STREAM_CTRL_SET_CACHE_SIZE,
     STREAM_CTRL_GET_CACHE_FILL,
     STREAM_CTRL_GET_CACHE_IDLE,
+    STREAM_CTRL_GET_CACHE_SPEED,
+    STREAM_CTRL_GET_CACHE_UNDERRUN_TIME,
     STREAM_CTRL_RESUME_CACHE,
 
     // stream_memory.c
@@ -176,6 +178,13 @@ typedef struct stream {
     int (*control)(struct stream *s, int cmd, void *arg);
     // Close
     void (*close)(struct stream *s);
+    // Optional zero-copy read (see stream_borrow()). Return a pointer to len
+    // bytes starting at the absolute position pos if they are available in
+    // contiguous memory, or NULL. The stream position becomes pos. The data
+    // must stay valid until release() is called, which also sets the new
+    // stream position.
+    void *(*borrow)(struct stream *s, int64_t pos, int len);
+    void (*release)(struct stream *s, int64_t pos);
 
     enum streamtype type; // see STREAMTYPE_*
     enum streamtype uncached_type; // if stream is cache, type of wrapped str.
@@ -207,6 +216,8 @@ typedef struct stream {
 
     struct stream *uncached_stream; // underlying stream for cache wrapper
 
+    bool borrowed;  // between stream_borrow() and stream_release()
+
     // Includes additional padding in case sizes get rounded up by sector size.
     unsigned char buffer[];
 } stream_t;
@@ -252,6 +263,8 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, char *mem, int total);
 int stream_read_partial(stream_t *s, char *buf, int buf_size);
 struct bstr stream_peek(stream_t *s, int len);
+struct bstr stream_borrow(stream_t *s, int len);
+void stream_release(stream_t *s, int len);
 void stream_drop_buffers(stream_t *s);
 
 struct mpv_global;
@@ -25,6 +25,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <assert.h>
+#include <pthread.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
@@ -36,7 +38,10 @@
 #include "common/msg.h"
 #include "stream.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "options/path.h"
+#include "osdep/timer.h"
+#include "misc/thread_pool.h"
 
 #if HAVE_BSD_FSTATFS
 #include <sys/param.h>
@@ -57,12 +62,176 @@
 #endif
 #endif
 
+// Size of each read request if --stream-file-queue-depth is used.
+#define ASYNC_CHUNK (256 * 1024)
+
+// A read request executed on the thread pool.
+struct file_read {
+    struct priv *p;
+    int64_t pos;
+    char *buf;          // ASYNC_CHUNK bytes
+    int len;            // result of the read (valid if done)
+    int consumed;       // bytes returned by fill_buffer() so far
+    bool busy;          // owned by the queue or a worker thread
+    bool done;          // read has finished
+    bool stale;         // dropped from the queue while running
+};
+
 struct priv {
     int fd;
     bool close;
     bool regular;
+
+    // Asynchronous reads (only if pool is set)
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct file_read *reads;    // all requests, num_reads = queue depth
+    int num_reads;
+    struct file_read **queue;   // queued requests, in file order
+    int num_queued;
+    int64_t next_pos;           // file position of the next request
 };
 
+static void read_worker(void *ctx)
+{
+    struct file_read *r = ctx;
+    struct priv *p = r->p;
+    int len;
+    do {
+        len = pread(p->fd, r->buf, ASYNC_CHUNK, r->pos);
+    } while (len < 0 && errno == EINTR);
+
+    pthread_mutex_lock(&p->lock);
+    r->len = len;
+    r->done = true;
+    if (r->stale)
+        r->busy = false;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Drop all queued requests. Running reads can't be interrupted, but their
+// results are discarded. Must be called locked.
+static void drop_queue(struct priv *p, int64_t next_pos)
+{
+    for (int n = 0; n < p->num_queued; n++) {
+        struct file_read *r = p->queue[n];
+        if (r->done) {
+            r->busy = false;
+        } else {
+            r->stale = true;
+        }
+    }
+    p->num_queued = 0;
+    p->next_pos = next_pos;
+}
+
+// Queue new requests until all idle request slots are in use.
+static void issue_reads(struct priv *p)
+{
+    for (int n = 0; n < p->num_reads; n++) {
+        struct file_read *r = &p->reads[n];
+        if (r->busy)
+            continue;
+        *r = (struct file_read){
+            .p = p,
+            .pos = p->next_pos,
+            .buf = r->buf,
+            .busy = true,
+        };
+        p->next_pos += ASYNC_CHUNK;
+        p->queue[p->num_queued++] = r;
+        mp_thread_pool_queue(p->pool, read_worker, r);
+    }
+}
+
+static void remove_head(struct priv *p)
+{
+    p->queue[0]->busy = false;
+    p->num_queued--;
+    memmove(&p->queue[0], &p->queue[1], p->num_queued * sizeof(p->queue[0]));
+}
+
+static int fill_buffer_async(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int res = -1;
+
+    pthread_mutex_lock(&p->lock);
+
+    while (1) {
+        issue_reads(p);
+        if (p->num_queued && p->queue[0]->done)
+            break;
+        // Wait for the head request, or for a stale request to free its slot.
+        if (mp_cancel_test(s->cancel))
+            goto done;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+    }
+
+    struct file_read *r = p->queue[0];
+    assert(r->pos + r->consumed == s->pos);
+    if (r->len <= 0) {
+        // EOF or error; retry from this position on the next call, in case
+        // the file is growing.
+        drop_queue(p, s->pos);
+        goto done;
+    }
+
+    res = MPMIN(max_len, r->len - r->consumed);
+    memcpy(buffer, r->buf + r->consumed, res);
+    r->consumed += res;
+    if (r->consumed == r->len) {
+        int64_t end = r->pos + r->len;
+        bool short_read = r->len < ASYNC_CHUNK;
+        remove_head(p);
+        // A short read means EOF was hit, so the following requests are
+        // beyond the end of the file, or missing data if it's growing.
+        if (short_read)
+            drop_queue(p, end);
+        issue_reads(p);
+    }
+
+done:
+    pthread_mutex_unlock(&p->lock);
+    return res;
+}
+
+static int seek_async(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    pthread_mutex_lock(&p->lock);
+    drop_queue(p, newpos);
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+static void init_async(stream_t *s, int depth)
+{
+    struct priv *p = s->priv;
+    p->pool = mp_thread_pool_create(p, depth);
+    if (!p->pool) {
+        MP_WARN(s, "Could not create read threads.\n");
+        return;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    p->num_reads = depth;
+    p->reads = talloc_zero_array(p, struct file_read, depth);
+    p->queue = talloc_zero_array(p, struct file_read *, depth);
+    for (int n = 0; n < depth; n++)
+        p->reads[n].buf = talloc_size(p->reads, ASYNC_CHUNK);
+    p->next_pos = 0;
+
+    s->fill_buffer = fill_buffer_async;
+    s->seek = seek_async;
+    s->read_chunk = ASYNC_CHUNK;
+    MP_VERBOSE(s, "Using %d asynchronous reads of %d KB.\n", depth,
+               ASYNC_CHUNK / 1024);
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -123,6 +292,12 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->pool) {
+        // Waits until all running reads are finished.
+        talloc_free(p->pool);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->wakeup);
+    }
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
@@ -307,9 +482,18 @@ static int open_f(stream_t *stream)
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
 
-    if (check_stream_network(fd))
+    bool network = check_stream_network(fd);
+    if (network)
         stream->streaming = true;
 
+#ifndef __MINGW32__
+    int depth = stream->opts ? stream->opts->stream_file_queue_depth : 0;
+    if (depth < 0)
+        depth = network ? 4 : 0;
+    if (depth > 0 && priv->regular && !write && stream->seekable)
+        init_async(stream, depth);
+#endif
+
     return STREAM_OK;
 }
 
@@ -34,6 +34,14 @@ static int fill_buffer(stream_t *s, char* buffer, int len)
     return len;
 }
 
+static void *borrow(stream_t *s, int64_t pos, int len)
+{
+    struct priv *p = s->priv;
+    if (pos < 0 || pos + len > p->data.len)
+        return NULL;
+    return p->data.start + pos;
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     return 1;
@@ -59,6 +67,7 @@ static int open_f(stream_t *stream)
 {
     stream->fill_buffer = fill_buffer;
     stream->seek = seek;
+    stream->borrow = borrow;
     stream->seekable = true;
     stream->control = control;
     stream->read_chunk = 1024 * 1024;
@@ -0,0 +1,131 @@
+#include "test_helpers.h"
+#include "audio/audio_ring.h"
+#include "common/common.h"
+
+#define PLANES 2
+
+// Fill planes with a sequence starting at pos. Plane n gets n * 1000 + pos.
+static void gen(uint16_t data[PLANES][64], int pos, int samples)
+{
+    for (int n = 0; n < PLANES; n++) {
+        for (int i = 0; i < samples; i++)
+            data[n][i] = n * 1000 + pos + i;
+    }
+}
+
+static void check(void **planes, int pos, int samples)
+{
+    for (int n = 0; n < PLANES; n++) {
+        uint16_t *p = planes[n];
+        for (int i = 0; i < samples; i++)
+            assert_int_equal(p[i], n * 1000 + pos + i);
+    }
+}
+
+static int write_seq(struct mp_audio_ring *r, int pos, int samples)
+{
+    uint16_t data[PLANES][64];
+    gen(data, pos, samples);
+    return mp_audio_ring_write(r, (void *[]){data[0], data[1]}, samples);
+}
+
+static int read_seq(struct mp_audio_ring *r, int pos, int samples)
+{
+    uint16_t data[PLANES][64];
+    void *planes[] = {data[0], data[1]};
+    int got = mp_audio_ring_read(r, planes, samples);
+    check(planes, pos, got);
+    return got;
+}
+
+static void test_audio_ring_wraparound(void **state) {
+    struct mp_audio_ring *r = mp_audio_ring_create(NULL, PLANES, 2, 10);
+
+    assert_int_equal(mp_audio_ring_size(r), 10);
+    assert_int_equal(mp_audio_ring_buffered(r), 0);
+    assert_int_equal(mp_audio_ring_available(r), 10);
+
+    assert_int_equal(write_seq(r, 0, 7), 7);
+    assert_int_equal(read_seq(r, 0, 5), 5);
+    assert_int_equal(mp_audio_ring_buffered(r), 2);
+
+    // Wraps around the end of the ring; only 8 samples fit.
+    assert_int_equal(write_seq(r, 7, 9), 8);
+    assert_int_equal(mp_audio_ring_buffered(r), 10);
+    assert_int_equal(mp_audio_ring_available(r), 0);
+    assert_int_equal(write_seq(r, 15, 1), 0);
+
+    // Reads across the wrap point, and stops at the end of the data.
+    assert_int_equal(read_seq(r, 5, 20), 10);
+    assert_int_equal(mp_audio_ring_buffered(r), 0);
+    assert_int_equal(read_seq(r, 15, 1), 0);
+
+    // Many more cycles than the ring size, with odd amounts.
+    int wpos = 15, rpos = 15;
+    for (int n = 0; n < 100; n++) {
+        wpos += write_seq(r, wpos, n % 7 + 1);
+        rpos += read_seq(r, rpos, n % 5 + 1);
+        assert_int_equal(mp_audio_ring_buffered(r), wpos - rpos);
+    }
+
+    talloc_free(r);
+}
+
+static void test_audio_ring_peek(void **state) {
+    struct mp_audio_ring *r = mp_audio_ring_create(NULL, PLANES, 2, 8);
+    void *planes[PLANES];
+
+    assert_int_equal(mp_audio_ring_peek(r, planes, 4), 0);
+
+    // Contiguous data: points into the ring, and doesn't remove anything.
+    assert_int_equal(write_seq(r, 0, 6), 6);
+    assert_int_equal(mp_audio_ring_peek(r, planes, 4), 4);
+    check(planes, 0, 4);
+    assert_int_equal(mp_audio_ring_peek(r, planes, 10), 6);
+    check(planes, 0, 6);
+    assert_int_equal(mp_audio_ring_buffered(r), 6);
+
+    mp_audio_ring_skip(r, 5);
+    assert_int_equal(mp_audio_ring_buffered(r), 1);
+
+    // Data wrapping around the end is returned as one linear block.
+    assert_int_equal(write_seq(r, 6, 7), 7);
+    assert_int_equal(mp_audio_ring_peek(r, planes, 8), 8);
+    check(planes, 5, 8);
+
+    mp_audio_ring_skip(r, 3);
+    assert_int_equal(mp_audio_ring_peek(r, planes, 8), 5);
+    check(planes, 8, 5);
+
+    talloc_free(r);
+}
+
+static void test_audio_ring_drain(void **state) {
+    struct mp_audio_ring *r = mp_audio_ring_create(NULL, PLANES, 2, 8);
+
+    // Reading without a destination just removes the data.
+    assert_int_equal(write_seq(r, 0, 8), 8);
+    assert_int_equal(mp_audio_ring_read(r, NULL, 3), 3);
+    assert_int_equal(read_seq(r, 3, 2), 2);
+    mp_audio_ring_skip(r, 100);
+    assert_int_equal(mp_audio_ring_buffered(r), 0);
+    assert_int_equal(mp_audio_ring_available(r), 8);
+
+    // Reset drops everything, and writing starts at the front again.
+    assert_int_equal(write_seq(r, 0, 5), 5);
+    mp_audio_ring_reset(r);
+    assert_int_equal(mp_audio_ring_buffered(r), 0);
+    assert_int_equal(write_seq(r, 20, 8), 8);
+    assert_int_equal(read_seq(r, 20, 8), 8);
+
+    talloc_free(r);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_audio_ring_wraparound),
+        cmocka_unit_test(test_audio_ring_peek),
+        cmocka_unit_test(test_audio_ring_drain),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
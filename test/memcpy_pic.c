@@ -0,0 +1,189 @@
+#include <libavutil/cpu.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/memcpy_pic.h"
+#include "video/mp_image.h"
+#include "video/slice_threads.h"
+
+#define GUARD 64
+
+// Enough for all cases below, plus guard bytes before and after.
+#define BUF_SIZE (GUARD * 2 + 16 * 1024)
+
+static const int line_sizes[] = {1, 3, 15, 16, 17, 31, 33, 63, 64, 65, 127,
+                                 129, 255, 257, 1000};
+static const int heights[] = {1, 2, 7};
+static const int paddings[] = {0, 1, 32};
+
+static void fill_rand(uint8_t *buf, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 24;
+    }
+}
+
+// Run fn() once with the C code, and once with the code for this CPU.
+static void run_impls(void (*fn)(void))
+{
+    av_force_cpu_flags(0);
+    fn();
+    av_force_cpu_flags(-1);
+    fn();
+}
+
+static void check_copy(int line, int h, int pad, int dst_off, int src_off,
+                       bool stream)
+{
+    uint8_t src[BUF_SIZE], dst[BUF_SIZE], ref[BUF_SIZE];
+    ptrdiff_t stride = line + pad;
+    fill_rand(src, sizeof(src), line * 7 + h);
+    memset(dst, 0xAA, sizeof(dst));
+    memset(ref, 0xAA, sizeof(ref));
+
+    uint8_t *s = src + GUARD + src_off;
+    for (int y = 0; y < h; y++)
+        memcpy(ref + GUARD + dst_off + y * stride, s + y * stride, line);
+    mp_pic_copy(dst + GUARD + dst_off, s, line, h, stride, stride, stream);
+
+    assert_memory_equal(dst, ref, sizeof(dst));
+}
+
+static void copy_all(void)
+{
+    for (int l = 0; l < MP_ARRAY_SIZE(line_sizes); l++) {
+        for (int h = 0; h < MP_ARRAY_SIZE(heights); h++) {
+            for (int p = 0; p < MP_ARRAY_SIZE(paddings); p++) {
+                for (int off = 0; off < 4; off++) {
+                    check_copy(line_sizes[l], heights[h], paddings[p],
+                               off, 3 - off, false);
+                    check_copy(line_sizes[l], heights[h], paddings[p],
+                               off, 3 - off, true);
+                }
+            }
+        }
+    }
+}
+
+static void test_mp_pic_copy(void **state) {
+    run_impls(copy_all);
+}
+
+static void negative_stride(void)
+{
+    uint8_t src[BUF_SIZE], dst[BUF_SIZE], ref[BUF_SIZE];
+    const int line = 33, h = 5;
+    for (int pad = 0; pad < 2; pad++) {
+        ptrdiff_t stride = line + pad;
+        fill_rand(src, sizeof(src), pad);
+        memset(dst, 0xAA, sizeof(dst));
+        memset(ref, 0xAA, sizeof(ref));
+        // Start at the last line, as for a vertically flipped image.
+        uint8_t *s = src + GUARD + 1 + (h - 1) * stride;
+        uint8_t *d = dst + GUARD + 2 + (h - 1) * stride;
+        uint8_t *r = ref + GUARD + 2 + (h - 1) * stride;
+        for (int y = 0; y < h; y++)
+            memcpy(r - y * stride, s - y * stride, line);
+        mp_pic_copy(d, s, line, h, -stride, -stride, true);
+        assert_memory_equal(dst, ref, sizeof(dst));
+    }
+}
+
+static void test_mp_pic_copy_negative_stride(void **state) {
+    run_impls(negative_stride);
+}
+
+static void check_set16(int units, int h, int pad, int off, uint16_t fill,
+                        bool stream)
+{
+    uint8_t dst[BUF_SIZE], ref[BUF_SIZE];
+    ptrdiff_t stride = units * 2 + pad * 2;
+    memset(dst, 0xAA, sizeof(dst));
+    memset(ref, 0xAA, sizeof(ref));
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *line = ref + GUARD + off + y * stride;
+        for (int x = 0; x < units; x++)
+            memcpy(line + x * 2, &fill, 2);
+    }
+    mp_pic_set16(dst + GUARD + off, fill, units, h, stride, stream);
+
+    assert_memory_equal(dst, ref, sizeof(dst));
+}
+
+static void set_all(void)
+{
+    uint8_t dst[BUF_SIZE], ref[BUF_SIZE];
+    for (int l = 0; l < MP_ARRAY_SIZE(line_sizes); l++) {
+        int line = line_sizes[l];
+        for (int h = 0; h < MP_ARRAY_SIZE(heights); h++) {
+            for (int p = 0; p < MP_ARRAY_SIZE(paddings); p++) {
+                ptrdiff_t stride = line + paddings[p];
+                for (int off = 0; off < 4; off++) {
+                    for (int stream = 0; stream < 2; stream++) {
+                        memset(dst, 0xAA, sizeof(dst));
+                        memset(ref, 0xAA, sizeof(ref));
+                        for (int y = 0; y < heights[h]; y++)
+                            memset(ref + GUARD + off + y * stride, 0x12, line);
+                        mp_pic_set(dst + GUARD + off, 0x12, line, heights[h],
+                                   stride, stream);
+                        assert_memory_equal(dst, ref, sizeof(dst));
+                    }
+                }
+                // 16 bit writes need 2 byte alignment.
+                for (int off = 0; off < 4; off += 2) {
+                    for (int stream = 0; stream < 2; stream++) {
+                        check_set16(line, heights[h], paddings[p], off,
+                                    0x0123, stream);
+                        check_set16(line, heights[h], paddings[p], off,
+                                    0x8080, stream);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_mp_pic_set(void **state) {
+    run_impls(set_all);
+}
+
+// memcpy_pic() with an image large enough to be split into slices and to use
+// non-temporal stores.
+static void test_memcpy_pic_sliced(void **state) {
+    const int w = 2001, h = 1081 * 2, stride = 2048;
+    uint8_t *src = malloc(stride * h);
+    uint8_t *dst = malloc(stride * h);
+    uint8_t *ref = malloc(stride * h);
+    assert_true(src && dst && ref);
+    fill_rand(src, stride * h, 1);
+    memset(dst, 0xAA, stride * h);
+    memset(ref, 0xAA, stride * h);
+    for (int y = 0; y < h; y++)
+        memcpy(ref + y * stride, src + y * stride, w);
+
+    mp_slice_threads_init(4);
+    memcpy_pic(dst, src, w, h, stride, stride);
+    assert_memory_equal(dst, ref, stride * h);
+
+    for (int y = 0; y < h; y++)
+        memset(ref + y * stride, 0x34, w);
+    memset_pic(dst, 0x34, w, h, stride);
+    assert_memory_equal(dst, ref, stride * h);
+    mp_slice_threads_uninit();
+
+    free(src);
+    free(dst);
+    free(ref);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_mp_pic_copy),
+        cmocka_unit_test(test_mp_pic_copy_negative_stride),
+        cmocka_unit_test(test_mp_pic_set),
+        cmocka_unit_test(test_memcpy_pic_sliced),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "audio/sample_ops.h"
+#include "common/common.h"
+
+// Odd sizes, to exercise the C tail of the SIMD versions.
+static const int sizes[] = {0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 1000};
+
+#define MAX_N 1000
+
+static const char *const impls[] = {"sse2", "avx2"};
+
+static void fill_rand(int16_t *s16, int32_t *s32, float *flt, uint32_t seed)
+{
+    for (int i = 0; i < MAX_N; i++) {
+        seed = seed * 1103515245 + 12345;
+        s16[i] = seed >> 16;
+        s32[i] = seed;
+        // Slightly out of [-1, 1] to exercise clipping.
+        flt[i] = ((seed >> 8) / (float)(1 << 24) - 0.5f) * 2.2f;
+    }
+}
+
+static void check_impl(const struct mp_sample_ops *ref,
+                       const struct mp_sample_ops *ops)
+{
+    int16_t s16[MAX_N], s16_ref[MAX_N], s16_out[MAX_N];
+    int32_t s32[MAX_N];
+    float flt[MAX_N], flt_ref[MAX_N], flt_out[MAX_N];
+    fill_rand(s16, s32, flt, 1);
+
+    static const int vols_s16[] = {0, 1, 256, 300, 1000, 40000, -5};
+    static const float vols_float[] = {0.0f, 0.5f, 1.0f, 1.3f, -2.0f};
+
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        int n = sizes[s];
+
+        for (int v = 0; v < MP_ARRAY_SIZE(vols_s16); v++) {
+            memcpy(s16_ref, s16, sizeof(s16));
+            memcpy(s16_out, s16, sizeof(s16));
+            ref->volume_s16(s16_ref, n, vols_s16[v]);
+            ops->volume_s16(s16_out, n, vols_s16[v]);
+            assert_memory_equal(s16_out, s16_ref, sizeof(s16));
+        }
+
+        for (int v = 0; v < MP_ARRAY_SIZE(vols_float); v++) {
+            memcpy(flt_ref, flt, sizeof(flt));
+            memcpy(flt_out, flt, sizeof(flt));
+            ref->volume_float(flt_ref, n, vols_float[v]);
+            ops->volume_float(flt_out, n, vols_float[v]);
+            assert_memory_equal(flt_out, flt_ref, sizeof(flt));
+        }
+
+        assert_true(ops->dot_s32_s16(s32, s16, n) ==
+                    ref->dot_s32_s16(s32, s16, n));
+
+        // The summation order differs, so allow for rounding errors relative
+        // to the magnitude of the summed products.
+        double mag = 0;
+        for (int i = 0; i < n; i++)
+            mag += fabs((double)flt[i] * flt_ref[i]);
+        float dot_ref = ref->dot_float(flt, flt_ref, n);
+        float dot = ops->dot_float(flt, flt_ref, n);
+        assert_true(fabs(dot - dot_ref) <= 1e-5 * mag);
+    }
+}
+
+static void test_sample_ops_equivalence(void **state) {
+    const struct mp_sample_ops *ref = mp_get_sample_ops_by_name("c");
+    assert_true(ref);
+    for (int i = 0; i < MP_ARRAY_SIZE(impls); i++) {
+        const struct mp_sample_ops *ops = mp_get_sample_ops_by_name(impls[i]);
+        if (ops)
+            check_impl(ref, ops);
+    }
+}
+
+static void test_sample_ops_best(void **state) {
+    const struct mp_sample_ops *best = mp_get_sample_ops();
+    assert_true(best);
+    assert_true(mp_get_sample_ops_by_name(best->name) == best);
+    assert_true(mp_get_sample_ops_by_name("nonexistent") == NULL);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_sample_ops_equivalence),
+        cmocka_unit_test(test_sample_ops_best),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
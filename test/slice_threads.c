@@ -0,0 +1,115 @@
+#include <pthread.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/slice_threads.h"
+
+#define MAX_H 2000
+
+struct rows {
+    pthread_mutex_t lock;
+    int align;
+    int h;
+    int calls;
+    int count[MAX_H];
+};
+
+static void mark_rows(void *ctx, int y0, int y1)
+{
+    struct rows *r = ctx;
+    assert_true(y0 >= 0 && y0 < y1 && y1 <= r->h);
+    assert_int_equal(y0 % r->align, 0);
+    pthread_mutex_lock(&r->lock);
+    r->calls++;
+    for (int y = y0; y < y1; y++)
+        r->count[y]++;
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Return the number of slices used.
+static int run(int h, int align, size_t bytes)
+{
+    struct rows r = {.align = align, .h = h};
+    pthread_mutex_init(&r.lock, NULL);
+    mp_slice_run(h, align, bytes, mark_rows, &r);
+    for (int y = 0; y < h; y++)
+        assert_int_equal(r.count[y], 1);
+    pthread_mutex_destroy(&r.lock);
+    return r.calls;
+}
+
+static void test_slice_odd_heights(void **state) {
+    mp_slice_threads_init(4);
+    assert_int_equal(mp_slice_threads_count(), 4);
+
+    const size_t big = 64 * 1024 * 1024;
+    static const int heights[] = {1, 2, 3, 5, 7, 9, 17, 99, 1079, 1081, 1999};
+    for (int n = 0; n < MP_ARRAY_SIZE(heights); n++) {
+        int h = heights[n];
+        for (int align = 1; align <= 4; align *= 2) {
+            int slices = run(h, align, big);
+            assert_true(slices >= 1 && slices <= 4);
+            // Every slice start must be aligned, so the slice count is
+            // limited by the number of aligned units.
+            assert_true(slices <= MPMAX(h / align, 1));
+            if (h / align >= 4)
+                assert_int_equal(slices, 4);
+        }
+    }
+
+    mp_slice_threads_uninit();
+}
+
+static void test_slice_small(void **state) {
+    mp_slice_threads_init(4);
+    // Not worth splitting.
+    assert_int_equal(run(1080, 2, 1000), 1);
+    assert_int_equal(run(0, 1, 1000), 0);
+    mp_slice_threads_uninit();
+}
+
+static void test_slice_no_threads(void **state) {
+    // Without any user, everything runs on the calling thread.
+    assert_int_equal(mp_slice_threads_count(), 1);
+    assert_int_equal(run(1081, 2, 64 * 1024 * 1024), 1);
+}
+
+struct nested {
+    struct rows inner;
+    pthread_mutex_t lock;
+    int outer_calls;
+};
+
+static void nested_slice(void *ctx, int y0, int y1)
+{
+    struct nested *n = ctx;
+    // Runs on the calling thread, instead of waiting for the busy pool.
+    struct rows r = {.align = 1, .h = 100};
+    pthread_mutex_init(&r.lock, NULL);
+    mp_slice_run(100, 1, 64 * 1024 * 1024, mark_rows, &r);
+    assert_int_equal(r.calls, 1);
+    pthread_mutex_destroy(&r.lock);
+    pthread_mutex_lock(&n->lock);
+    n->outer_calls++;
+    pthread_mutex_unlock(&n->lock);
+}
+
+static void test_slice_nested(void **state) {
+    mp_slice_threads_init(4);
+    struct nested n = {0};
+    pthread_mutex_init(&n.lock, NULL);
+    mp_slice_run(1000, 1, 64 * 1024 * 1024, nested_slice, &n);
+    assert_int_equal(n.outer_calls, 4);
+    pthread_mutex_destroy(&n.lock);
+    mp_slice_threads_uninit();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_slice_odd_heights),
+        cmocka_unit_test(test_slice_small),
+        cmocka_unit_test(test_slice_no_threads),
+        cmocka_unit_test(test_slice_nested),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,86 @@
+#include <pthread.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/thread_pool.h"
+
+#define NUM_ITEMS 1000
+
+struct counter {
+    pthread_mutex_t lock;
+    int done;
+    int items[NUM_ITEMS];
+    struct mp_thread_pool *pool; // for work queued from work items
+};
+
+struct item {
+    struct counter *c;
+    int index;
+};
+
+static void work(void *arg)
+{
+    struct item *item = arg;
+    pthread_mutex_lock(&item->c->lock);
+    item->c->items[item->index]++;
+    item->c->done++;
+    pthread_mutex_unlock(&item->c->lock);
+}
+
+// Queues a second item for the next index.
+static void work_requeue(void *arg)
+{
+    struct item *item = arg;
+    work(item);
+    mp_thread_pool_queue(item->c->pool, work, item + 1);
+}
+
+static void test_thread_pool_all_run(void **state) {
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        struct counter c = {0};
+        pthread_mutex_init(&c.lock, NULL);
+        struct item items[NUM_ITEMS];
+
+        struct mp_thread_pool *pool = mp_thread_pool_create(NULL, threads);
+        assert_true(pool);
+        for (int n = 0; n < NUM_ITEMS; n++) {
+            items[n] = (struct item){&c, n};
+            mp_thread_pool_queue(pool, work, &items[n]);
+        }
+        // Waits until all items are done.
+        talloc_free(pool);
+
+        assert_int_equal(c.done, NUM_ITEMS);
+        for (int n = 0; n < NUM_ITEMS; n++)
+            assert_int_equal(c.items[n], 1);
+        pthread_mutex_destroy(&c.lock);
+    }
+}
+
+static void test_thread_pool_queue_from_worker(void **state) {
+    struct counter c = {0};
+    pthread_mutex_init(&c.lock, NULL);
+    struct item items[NUM_ITEMS];
+
+    c.pool = mp_thread_pool_create(NULL, 3);
+    assert_true(c.pool);
+    for (int n = 0; n < NUM_ITEMS; n += 2) {
+        items[n] = (struct item){&c, n};
+        items[n + 1] = (struct item){&c, n + 1};
+        mp_thread_pool_queue(c.pool, work_requeue, &items[n]);
+    }
+    talloc_free(c.pool);
+
+    assert_int_equal(c.done, NUM_ITEMS);
+    for (int n = 0; n < NUM_ITEMS; n++)
+        assert_int_equal(c.items[n], 1);
+    pthread_mutex_destroy(&c.lock);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_thread_pool_all_run),
+        cmocka_unit_test(test_thread_pool_queue_from_worker),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
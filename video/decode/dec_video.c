@@ -22,10 +22,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "common/msg.h"
 
 #include "osdep/timer.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/packet.h"
@@ -55,9 +57,80 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
+/* Decoder thread.
+ *
+ * The playloop still reads packets from the demuxer (it needs to apply the
+ * video offset and the framedrop decisions) and still owns the filter chain.
+ * It passes packets to the thread, which calls video_decode() on them and
+ * queues the results. The playloop then takes decoded images from the queue
+ * instead of decoding them itself.
+ *
+ * dec_lock is held while the decoder is used; lock protects the queues.
+ * If both are needed, dec_lock must be locked first.
+ */
+struct vd_queued_packet {
+    struct demux_packet *pkt;   // NULL means EOF (drain the decoder)
+    int drop_frame;
+};
+
+struct vd_queued_frame {
+    struct mp_image *mpi;       // NULL if the packet produced no image
+    bool had_packet;
+};
+
+struct dec_video_thread {
+    pthread_t thread;
+    pthread_mutex_t dec_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool quit;
+
+    struct vd_queued_packet *packets;
+    int num_packets;
+    struct vd_queued_frame *frames;
+    int num_frames;
+    int max_frames;
+    bool input_eof;             // EOF packet was added
+    bool eof_done;              // decoder was drained completely
+
+    // Copies of the d_video fields, which are owned by the thread.
+    double decode_time;
+    int has_broken_packet_pts;
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+};
+
+static void flush_thread_queues(struct dec_video_thread *t)
+{
+    for (int n = 0; n < t->num_packets; n++)
+        talloc_free(t->packets[n].pkt);
+    t->num_packets = 0;
+    for (int n = 0; n < t->num_frames; n++)
+        talloc_free(t->frames[n].mpi);
+    t->num_frames = 0;
+    t->input_eof = false;
+    t->eof_done = false;
+}
+
+static int vd_control(struct dec_video *d_video, int cmd, void *arg)
+{
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        return vd->control(d_video, cmd, arg);
+    return CONTROL_UNKNOWN;
+}
+
 void video_reset_decoding(struct dec_video *d_video)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
+    struct dec_video_thread *t = d_video->thread;
+    if (t) {
+        pthread_mutex_lock(&t->dec_lock);
+        pthread_mutex_lock(&t->lock);
+        flush_thread_queues(t);
+        pthread_mutex_unlock(&t->lock);
+    }
+    vd_control(d_video, VDCTRL_RESET, NULL);
     if (d_video->vfilter && d_video->vfilter->initialized == 1)
         vf_seek_reset(d_video->vfilter);
     mp_image_unrefp(&d_video->waiting_decoded_mpi);
@@ -69,14 +142,19 @@ void video_reset_decoding(struct dec_video *d_video)
     d_video->codec_dts = MP_NOPTS_VALUE;
     d_video->sorted_pts = MP_NOPTS_VALUE;
     d_video->unsorted_pts = MP_NOPTS_VALUE;
+    if (t)
+        pthread_mutex_unlock(&t->dec_lock);
 }
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    const struct vd_functions *vd = d_video->vd_driver;
-    if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+    struct dec_video_thread *t = d_video->thread;
+    if (t)
+        pthread_mutex_lock(&t->dec_lock);
+    int r = vd_control(d_video, cmd, arg);
+    if (t)
+        pthread_mutex_unlock(&t->dec_lock);
+    return r;
 }
 
 int video_set_colors(struct dec_video *d_video, const char *item, int value)
@@ -114,8 +192,11 @@ int video_get_colors(struct dec_video *d_video, const char *item, int *value)
     return 0;
 }
 
+static void stop_thread(struct dec_video *d_video);
+
 void video_uninit(struct dec_video *d_video)
 {
+    stop_thread(d_video);
     mp_image_unrefp(&d_video->waiting_decoded_mpi);
     if (d_video->vd_driver) {
         MP_VERBOSE(d_video, "Uninit video.\n");
@@ -213,7 +294,7 @@ static void add_pts_to_sort(struct dec_video *d_video, double pts)
 {
     if (pts != MP_NOPTS_VALUE) {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_QUERY_UNSEEN_FRAMES, &delay);
+        vd_control(d_video, VDCTRL_QUERY_UNSEEN_FRAMES, &delay);
         if (delay >= 0 && delay < d_video->num_buffered_pts)
             d_video->num_buffered_pts = delay;
         if (d_video->num_buffered_pts ==
@@ -316,7 +397,13 @@ struct mp_image *video_decode(struct dec_video *d_video,
 
     MP_STATS(d_video, "start decode video");
 
+    double start = mp_time_sec();
     struct mp_image *mpi = d_video->vd_driver->decode(d_video, packet, drop_frame);
+    double decode_time = mp_time_sec() - start;
+    if (mpi && !drop_frame) {
+        d_video->decode_time = d_video->decode_time > 0
+            ? d_video->decode_time * 0.9 + decode_time * 0.1 : decode_time;
+    }
 
     MP_STATS(d_video, "end decode video");
 
@@ -450,3 +537,194 @@ int video_vf_vo_control(struct dec_video *d_video, int vf_cmd, void *data)
     }
     return CONTROL_UNKNOWN;
 }
+
+static bool thread_can_decode(struct dec_video_thread *t)
+{
+    return t->num_packets && t->num_frames < t->max_frames && !t->eof_done;
+}
+
+static void *video_thread(void *arg)
+{
+    struct dec_video *d_video = arg;
+    struct dec_video_thread *t = d_video->thread;
+    mpthread_set_name("video decoder");
+
+    while (1) {
+        pthread_mutex_lock(&t->lock);
+        while (!t->quit && !thread_can_decode(t))
+            pthread_cond_wait(&t->wakeup, &t->lock);
+        bool quit = t->quit;
+        pthread_mutex_unlock(&t->lock);
+        if (quit)
+            break;
+
+        pthread_mutex_lock(&t->dec_lock);
+        pthread_mutex_lock(&t->lock);
+        // The queues might have been flushed while no lock was held.
+        if (!thread_can_decode(t)) {
+            pthread_mutex_unlock(&t->lock);
+            pthread_mutex_unlock(&t->dec_lock);
+            continue;
+        }
+        // The entry stays in the queue during decoding; removing it requires
+        // dec_lock, which is held until it's removed below.
+        struct vd_queued_packet p = t->packets[0];
+        pthread_mutex_unlock(&t->lock);
+
+        struct mp_image *mpi = video_decode(d_video, p.pkt, p.drop_frame);
+
+        pthread_mutex_lock(&t->lock);
+        // On EOF, keep draining until the decoder returns nothing.
+        if (p.pkt || !mpi) {
+            MP_TARRAY_REMOVE_AT(t->packets, t->num_packets, 0);
+            talloc_free(p.pkt);
+        }
+        if (!p.pkt && !mpi)
+            t->eof_done = true;
+        struct vd_queued_frame f = {mpi, !!p.pkt};
+        MP_TARRAY_APPEND(t, t->frames, t->num_frames, f);
+        t->decode_time = d_video->decode_time;
+        t->has_broken_packet_pts = d_video->has_broken_packet_pts;
+        pthread_mutex_unlock(&t->lock);
+        pthread_mutex_unlock(&t->dec_lock);
+
+        t->wakeup_cb(t->wakeup_ctx);
+    }
+    return NULL;
+}
+
+// Start decoding in a separate thread, queuing up to queue_frames decoded
+// images. wakeup_cb is called from the thread when a new image is available.
+// From now on, video_thread_add_packet() and video_thread_get_frame() must be
+// used instead of video_decode().
+void video_start_thread(struct dec_video *d_video, int queue_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_video->thread);
+    struct dec_video_thread *t = talloc_zero(NULL, struct dec_video_thread);
+    t->max_frames = MPMAX(queue_frames, 1);
+    t->has_broken_packet_pts = d_video->has_broken_packet_pts;
+    t->wakeup_cb = wakeup_cb;
+    t->wakeup_ctx = wakeup_ctx;
+    pthread_mutex_init(&t->dec_lock, NULL);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    d_video->thread = t;
+    if (pthread_create(&t->thread, NULL, video_thread, d_video)) {
+        MP_ERR(d_video, "Could not start video decoder thread.\n");
+        pthread_mutex_destroy(&t->dec_lock);
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->wakeup);
+        talloc_free(t);
+        d_video->thread = NULL;
+        return;
+    }
+    MP_VERBOSE(d_video, "Decoding in a separate thread, queue size %d.\n",
+               t->max_frames);
+}
+
+static void stop_thread(struct dec_video *d_video)
+{
+    struct dec_video_thread *t = d_video->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    flush_thread_queues(t);
+    pthread_mutex_destroy(&t->dec_lock);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->wakeup);
+    talloc_free(t);
+    d_video->thread = NULL;
+}
+
+// Whether the thread should be given another packet. Packets are queued only
+// as far as the decoded image queue can take the results.
+bool video_thread_wants_packet(struct dec_video *d_video)
+{
+    struct dec_video_thread *t = d_video->thread;
+    pthread_mutex_lock(&t->lock);
+    bool r = !t->input_eof && t->num_packets + t->num_frames < t->max_frames;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+// Queue a packet for decoding. Takes ownership of packet. packet==NULL
+// signals EOF, after which no packets must be added until the next reset.
+void video_thread_add_packet(struct dec_video *d_video,
+                             struct demux_packet *packet, int drop_frame)
+{
+    struct dec_video_thread *t = d_video->thread;
+    pthread_mutex_lock(&t->lock);
+    assert(!t->input_eof);
+    struct vd_queued_packet p = {packet, drop_frame};
+    MP_TARRAY_APPEND(t, t->packets, t->num_packets, p);
+    t->input_eof = !packet;
+    pthread_cond_signal(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Return the result of the oldest decoded packet, with the same semantics as
+// video_decode() (*out is set to NULL on errors, dropped frames and EOF).
+// *had_packet is false if the result was from draining the decoder.
+// Returns false if there is nothing yet (wakeup_cb will be called).
+bool video_thread_get_frame(struct dec_video *d_video, struct mp_image **out,
+                            bool *had_packet)
+{
+    struct dec_video_thread *t = d_video->thread;
+    bool r = true;
+    pthread_mutex_lock(&t->lock);
+    if (t->num_frames) {
+        *out = t->frames[0].mpi;
+        *had_packet = t->frames[0].had_packet;
+        MP_TARRAY_REMOVE_AT(t->frames, t->num_frames, 0);
+        pthread_cond_signal(&t->wakeup);
+    } else if (t->eof_done) {
+        *out = NULL;
+        *had_packet = false;
+    } else {
+        r = false;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+// Number of decoded images waiting in the queue, or -1 if there is no thread.
+int video_thread_queue_depth(struct dec_video *d_video)
+{
+    struct dec_video_thread *t = d_video->thread;
+    if (!t)
+        return -1;
+    pthread_mutex_lock(&t->lock);
+    int r = 0;
+    for (int n = 0; n < t->num_frames; n++)
+        r += !!t->frames[n].mpi;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+// Average time spent in the decoder per decoded image (seconds).
+double video_get_decode_time(struct dec_video *d_video)
+{
+    struct dec_video_thread *t = d_video->thread;
+    if (!t)
+        return d_video->decode_time;
+    pthread_mutex_lock(&t->lock);
+    double r = t->decode_time;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+bool video_has_broken_packet_pts(struct dec_video *d_video)
+{
+    struct dec_video_thread *t = d_video->thread;
+    if (!t)
+        return d_video->has_broken_packet_pts;
+    pthread_mutex_lock(&t->lock);
+    bool r = t->has_broken_packet_pts;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
@@ -26,6 +26,7 @@
 
 struct mp_decoder_list;
 struct vo;
+struct dec_video_thread;
 
 struct dec_video {
     struct mp_log *log;
@@ -74,6 +75,12 @@ struct dec_video {
     float fps;            // FPS from demuxer or from user override
     float initial_decoder_aspect;
 
+    // Average time a video_decode() call took (seconds)
+    double decode_time;
+
+    // Set if video_start_thread() was called
+    struct dec_video_thread *thread;
+
     // State used only by player/video.c
     double last_pts;
 };
@@ -98,4 +105,15 @@ int video_reconfig_filters(struct dec_video *d_video,
 
 int video_vf_vo_control(struct dec_video *d_video, int vf_cmd, void *data);
 
+void video_start_thread(struct dec_video *d_video, int queue_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx);
+bool video_thread_wants_packet(struct dec_video *d_video);
+void video_thread_add_packet(struct dec_video *d_video,
+                             struct demux_packet *packet, int drop_frame);
+bool video_thread_get_frame(struct dec_video *d_video, struct mp_image **out,
+                            bool *had_packet);
+int video_thread_queue_depth(struct dec_video *d_video);
+double video_get_decode_time(struct dec_video *d_video);
+bool video_has_broken_packet_pts(struct dec_video *d_video);
+
 #endif /* MPLAYER_DEC_VIDEO_H */
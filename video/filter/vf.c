@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -33,6 +34,9 @@
 
 #include "options/options.h"
 
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
@@ -111,6 +115,12 @@ static const vf_info_t *const filter_list[] = {
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static void pipeline_stop(struct vf_chain *c);
+static void pipeline_start(struct vf_chain *c);
+static int pipeline_output_frame(struct vf_chain *c, bool eof);
+static int pipeline_needs_input(struct vf_chain *c);
+static void pipeline_filter_frame(struct vf_chain *c, struct mp_image *img);
+static void pipeline_lock_filters(struct vf_chain *c, bool lock);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -135,13 +145,15 @@ const struct m_obj_list vf_obj_list = {
     .description = "video filters",
 };
 
+static int vf_control(struct vf_instance *vf, int cmd, void *arg);
+
 // Try the cmd on each filter (starting with the first), and stop at the first
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            int r = vf_control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
                 return r;
         }
@@ -155,7 +167,7 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        return cur->control ? vf_control(cur, cmd, arg) : CONTROL_NA;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -286,6 +298,7 @@ static vf_instance_t *vf_open_filter(struct vf_chain *c, const char *name,
 
 void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
 {
+    pipeline_stop(c);
     assert(vf != c->first && vf != c->last); // these are sentinels
     struct vf_instance *prev = c->first;
     while (prev && prev->next != vf)
@@ -298,6 +311,7 @@ void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
 struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
                                      char **args)
 {
+    pipeline_stop(c);
     struct vf_instance *vf = vf_open_filter(c, name, args);
     if (vf) {
         // Insert it before the last filter, which is the "out" pseudo-filter
@@ -396,6 +410,10 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
     vf_fix_img_params(img, &c->override_params);
+    if (c->pipeline) {
+        pipeline_filter_frame(c, img);
+        return 0;
+    }
     return vf_do_filter(c->first, img);
 }
 
@@ -440,6 +458,8 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
 //  returns: -1: error, 0: no output, 1: output available
 int vf_output_frame(struct vf_chain *c, bool eof)
 {
+    if (c->pipeline)
+        return pipeline_output_frame(c, eof);
     return vf_output_frame_until(c, c->last, eof);
 }
 
@@ -461,6 +481,8 @@ struct mp_image *vf_read_output_frame(struct vf_chain *c)
 // returns -1: error, 0: nothing needed, 1: add new frame with vf_filter_frame()
 int vf_needs_input(struct vf_chain *c)
 {
+    if (c->pipeline)
+        return pipeline_needs_input(c);
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         while (cur->needs_input && cur->needs_input(cur)) {
@@ -493,8 +515,10 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    pipeline_lock_filters(c, true);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
+    pipeline_lock_filters(c, false);
 }
 
 int vf_next_config(struct vf_instance *vf,
@@ -612,6 +636,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
                 const struct mp_image_params *override_params)
 {
     int r = 0;
+    pipeline_stop(c);
     vf_chain_forget_frames(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -645,6 +670,8 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
     if (r < 0) {
         c->input_params = c->override_params = c->output_params =
             (struct mp_image_params){0};
+    } else {
+        pipeline_start(c);
     }
     return r;
 }
@@ -713,6 +740,7 @@ void vf_destroy(struct vf_chain *c)
 {
     if (!c)
         return;
+    pipeline_stop(c);
     while (c->first) {
         vf_instance_t *vf = c->first;
         c->first = vf->next;
@@ -722,6 +750,364 @@ void vf_destroy(struct vf_chain *c)
     talloc_free(c);
 }
 
+/* Pipeline mode (--vf-pipeline).
+ *
+ * Each filter runs on its own thread, with a small queue of input frames in
+ * front of it. A filter takes a frame from its queue only if the queue of the
+ * next filter (or the chain output queue) isn't full. Frame order is kept,
+ * because every filter has exactly one thread. A NULL entry in a queue is an
+ * EOF marker, which makes the filter output its delayed frames.
+ *
+ * The player still uses the normal vf_chain API. vf_filter_frame() appends to
+ * the first queue, vf_output_frame() takes frames from the output queue, and
+ * vf_needs_input() returns 1 while the first queue has space, so the player
+ * keeps the pipeline filled (like with vf_vapoursynth). Like vf_vapoursynth,
+ * vf_output_frame() waits for the filters if the first queue is full.
+ *
+ * stage->filter_lock is held while a filter is used (by its thread, or by the
+ * player for controls and seek resets). pipeline->lock protects the queues.
+ * filter_locks must be taken before pipeline->lock, and in chain order.
+ */
+struct vf_stage {
+    struct vf_pipeline *pipeline;
+    struct vf_instance *vf;
+    int index;
+    pthread_t thread;
+    pthread_mutex_t filter_lock;
+
+    // Protected by pipeline->lock
+    struct mp_image **in;
+    int num_in;
+    double latency;
+    int64_t frames;
+};
+
+struct vf_pipeline {
+    struct vf_chain *chain;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool quit;
+    bool error;
+    bool eof_sent;              // EOF marker was queued
+    bool eof_done;              // EOF marker passed the last filter
+    int depth;
+
+    struct vf_stage **stages;
+    int num_stages;
+
+    struct mp_image **out;
+    int num_out;
+};
+
+static int vf_control(struct vf_instance *vf, int cmd, void *arg)
+{
+    struct vf_stage *s = vf->stage;
+    if (s)
+        pthread_mutex_lock(&s->filter_lock);
+    int r = vf->control(vf, cmd, arg);
+    if (s)
+        pthread_mutex_unlock(&s->filter_lock);
+    return r;
+}
+
+static void free_queue(struct mp_image **queue, int *num)
+{
+    for (int n = 0; n < *num; n++)
+        talloc_free(queue[n]);
+    *num = 0;
+}
+
+// Whether the stage has input, and the next queue has space for its output.
+static bool stage_can_run(struct vf_pipeline *p, struct vf_stage *s)
+{
+    int next = s->index + 1 < p->num_stages
+             ? p->stages[s->index + 1]->num_in : p->num_out;
+    return s->num_in > 0 && next < p->depth;
+}
+
+static void pipeline_wakeup_player(struct vf_pipeline *p)
+{
+    struct vf_chain *c = p->chain;
+    if (c->wakeup_callback)
+        c->wakeup_callback(c->wakeup_callback_ctx);
+}
+
+static void *stage_thread(void *arg)
+{
+    struct vf_stage *s = arg;
+    struct vf_pipeline *p = s->pipeline;
+    struct vf_instance *vf = s->vf;
+    mpthread_set_name("vf pipeline");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->quit) {
+        if (!stage_can_run(p, s)) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+        pthread_mutex_lock(&s->filter_lock);
+        pthread_mutex_lock(&p->lock);
+        // The queues might have been flushed while no lock was held.
+        if (p->quit || !stage_can_run(p, s)) {
+            pthread_mutex_unlock(&s->filter_lock);
+            continue;
+        }
+        struct mp_image *img = s->in[0];
+        MP_TARRAY_REMOVE_AT(s->in, s->num_in, 0);
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+
+        // Collect all output the filter has for this input.
+        struct mp_image **out = NULL;
+        int num_out = 0;
+        double start = mp_time_sec();
+        int r = 0;
+        if (img) {
+            r = vf_do_filter(vf, img);
+            while (r >= 0 && vf_has_output_frame(vf))
+                MP_TARRAY_APPEND(NULL, out, num_out, vf_dequeue_output_frame(vf));
+        } else {
+            // EOF: flush delayed frames until the filter has no more output.
+            while (1) {
+                r = vf_do_filter(vf, NULL);
+                if (r < 0 || !vf_has_output_frame(vf))
+                    break;
+                while (vf_has_output_frame(vf)) {
+                    MP_TARRAY_APPEND(NULL, out, num_out,
+                                     vf_dequeue_output_frame(vf));
+                }
+            }
+        }
+        double time = mp_time_sec() - start;
+
+        pthread_mutex_lock(&p->lock);
+        if (img) {
+            s->latency = s->frames ? s->latency * 0.9 + time * 0.1 : time;
+            s->frames++;
+        }
+        if (r < 0)
+            p->error = true;
+        bool last = s->index + 1 == p->num_stages;
+        struct vf_stage *next = last ? NULL : p->stages[s->index + 1];
+        bool wakeup = s->index == 0 || r < 0;
+        for (int n = 0; n < num_out; n++) {
+            if (last) {
+                MP_TARRAY_APPEND(p, p->out, p->num_out, out[n]);
+                wakeup = true;
+            } else {
+                MP_TARRAY_APPEND(next, next->in, next->num_in, out[n]);
+            }
+        }
+        talloc_free(out);
+        if (!img) {
+            if (last) {
+                p->eof_done = true;
+                wakeup = true;
+            } else {
+                MP_TARRAY_APPEND(next, next->in, next->num_in, NULL);
+            }
+        }
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        pthread_mutex_unlock(&s->filter_lock);
+
+        if (wakeup)
+            pipeline_wakeup_player(p);
+
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static bool pipeline_supported(struct vf_chain *c)
+{
+    if (c->first->next == c->last)
+        return false; // no filters
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next)
+    {
+        // Asynchronous filters already do their own threading, and hardware
+        // filters might be bound to the thread using the hwdec API.
+        if (vf->needs_input || IMGFMT_IS_HWACCEL(vf->fmt_in.imgfmt) ||
+            IMGFMT_IS_HWACCEL(vf->fmt_out.imgfmt))
+            return false;
+    }
+    return true;
+}
+
+static void pipeline_start(struct vf_chain *c)
+{
+    assert(!c->pipeline);
+    int depth = c->opts->vf_pipeline;
+    if (depth < 1 || !pipeline_supported(c))
+        return;
+
+    struct vf_pipeline *p = talloc_zero(NULL, struct vf_pipeline);
+    p->chain = c;
+    p->depth = depth;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next)
+    {
+        struct vf_stage *s = talloc_zero(p, struct vf_stage);
+        s->pipeline = p;
+        s->vf = vf;
+        s->index = p->num_stages;
+        pthread_mutex_init(&s->filter_lock, NULL);
+        MP_TARRAY_APPEND(p, p->stages, p->num_stages, s);
+    }
+    c->pipeline = p;
+
+    for (int n = 0; n < p->num_stages; n++) {
+        struct vf_stage *s = p->stages[n];
+        if (pthread_create(&s->thread, NULL, stage_thread, s)) {
+            MP_ERR(c, "Could not start video filter threads.\n");
+            p->num_stages = n; // stop only the started threads
+            pipeline_stop(c);
+            return;
+        }
+        s->vf->stage = s;
+    }
+
+    MP_VERBOSE(c, "Running %d filters on separate threads.\n", p->num_stages);
+}
+
+static void pipeline_stop(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->quit = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    for (int n = 0; n < p->num_stages; n++) {
+        struct vf_stage *s = p->stages[n];
+        pthread_join(s->thread, NULL);
+        pthread_mutex_destroy(&s->filter_lock);
+        free_queue(s->in, &s->num_in);
+        s->vf->stage = NULL;
+    }
+    free_queue(p->out, &p->num_out);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wakeup);
+    talloc_free(p);
+    c->pipeline = NULL;
+}
+
+// Lock or unlock all filters, and drop all queued frames when locking.
+static void pipeline_lock_filters(struct vf_chain *c, bool lock)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    for (int n = 0; n < p->num_stages; n++) {
+        struct vf_stage *s = p->stages[n];
+        if (lock) {
+            pthread_mutex_lock(&s->filter_lock);
+        } else {
+            pthread_mutex_unlock(&s->filter_lock);
+        }
+    }
+    if (lock) {
+        pthread_mutex_lock(&p->lock);
+        for (int n = 0; n < p->num_stages; n++)
+            free_queue(p->stages[n]->in, &p->stages[n]->num_in);
+        free_queue(p->out, &p->num_out);
+        p->eof_sent = p->eof_done = false;
+        p->error = false;
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void pipeline_filter_frame(struct vf_chain *c, struct mp_image *img)
+{
+    struct vf_pipeline *p = c->pipeline;
+    struct vf_stage *s = p->stages[0];
+    pthread_mutex_lock(&p->lock);
+    if (p->eof_done)
+        p->eof_sent = p->eof_done = false;
+    MP_TARRAY_APPEND(s, s->in, s->num_in, img);
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static int pipeline_output_frame(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (c->last->num_out_queued)
+        return 1;
+    if (c->initialized < 1)
+        return -1;
+    struct mp_image *img = NULL;
+    int r;
+    pthread_mutex_lock(&p->lock);
+    if (eof && !p->eof_sent) {
+        struct vf_stage *s = p->stages[0];
+        MP_TARRAY_APPEND(s, s->in, s->num_in, NULL);
+        p->eof_sent = true;
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    while (1) {
+        if (p->error) {
+            p->error = false;
+            r = -1;
+            break;
+        }
+        if (p->num_out) {
+            img = p->out[0];
+            MP_TARRAY_REMOVE_AT(p->out, p->num_out, 0);
+            pthread_cond_broadcast(&p->wakeup);
+            r = 1;
+            break;
+        }
+        // Without EOF, return only if new input can be added.
+        if (eof ? p->eof_done : p->stages[0]->num_in < p->depth) {
+            r = 0;
+            break;
+        }
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (img)
+        vf_add_output_frame(c->last, img);
+    return r;
+}
+
+static int pipeline_needs_input(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    pthread_mutex_lock(&p->lock);
+    int r = !p->eof_sent && p->stages[0]->num_in < p->depth;
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+// Fill stats[] with the state of each filter thread. Returns the number of
+// filters, or -1 if the pipeline is not active.
+int vf_get_pipeline_stats(struct vf_chain *c, struct vf_stage_stats *stats,
+                          int max_stats)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return -1;
+    pthread_mutex_lock(&p->lock);
+    int num = MPMIN(p->num_stages, max_stats);
+    for (int n = 0; n < num; n++) {
+        struct vf_stage *s = p->stages[n];
+        stats[n] = (struct vf_stage_stats){
+            .name = s->vf->info->name,
+            .label = s->vf->label,
+            .latency = s->latency,
+            .queued = s->num_in,
+            .frames = s->frames,
+        };
+    }
+    pthread_mutex_unlock(&p->lock);
+    return num;
+}
+
 // When changing the size of an image that had old_w/old_h with
 // DAR *d_width/*d_height to the new size new_w/new_h, adjust
 // *d_width/*d_height such that the new image has the same pixel aspect ratio.
@@ -27,6 +27,8 @@ struct MPOpts;
 struct mpv_global;
 struct vf_instance;
 struct vf_priv_s;
+struct vf_stage;
+struct vf_pipeline;
 struct m_obj_settings;
 
 typedef struct vf_info {
@@ -107,6 +109,9 @@ typedef struct vf_instance {
 
     struct vf_chain *chain;
     struct vf_instance *next;
+
+    // Set if the filter runs on its own thread (see vf_pipeline in vf.c)
+    struct vf_stage *stage;
 } vf_instance_t;
 
 // A chain of video filters
@@ -133,6 +138,9 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    // Set if the filters run on separate threads (--vf-pipeline)
+    struct vf_pipeline *pipeline;
 };
 
 typedef struct vf_seteq {
@@ -171,6 +179,17 @@ struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label);
 void vf_print_filter_chain(struct vf_chain *c, int msglevel,
                            struct vf_instance *vf);
 
+struct vf_stage_stats {
+    const char *name;
+    const char *label;      // can be NULL
+    double latency;         // average time spent per input frame (seconds)
+    int queued;             // frames waiting in the input queue
+    int64_t frames;         // input frames processed
+};
+
+int vf_get_pipeline_stats(struct vf_chain *c, struct vf_stage_stats *stats,
+                          int max_stats);
+
 // Filter internal API
 struct mp_image *vf_alloc_out_image(struct vf_instance *vf);
 bool vf_make_out_image_writeable(struct vf_instance *vf, struct mp_image *img);
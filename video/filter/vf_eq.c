@@ -34,6 +34,7 @@
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
+#include "video/slice_threads.h"
 #include "vf.h"
 
 #define LUT16
@@ -173,6 +174,30 @@ void apply_lut (eq2_param_t *par, unsigned char *dst, unsigned char *src,
   }
 }
 
+struct eq_slices {
+  vf_eq2_t *eq2;
+  struct mp_image *dst, *src;
+};
+
+static void eq_slice(void *ctx, int y0, int y1)
+{
+  struct eq_slices *c = ctx;
+  vf_eq2_t *eq2 = c->eq2;
+  struct mp_image *dst = c->dst, *src = c->src;
+
+  for (int i = 0; i < ((src->num_planes>1)?3:1); i++) {
+    if (eq2->param[i].adjust != NULL) {
+      int ys = i ? src->fmt.chroma_ys : 0;
+      int py0 = y0 >> ys;
+      int py1 = y1 >= src->h ? eq2->buf_h[i] : y1 >> ys;
+      eq2->param[i].adjust (&eq2->param[i],
+        dst->planes[i] + py0 * dst->stride[i],
+        src->planes[i] + py0 * src->stride[i],
+        eq2->buf_w[i], py1 - py0, dst->stride[i], src->stride[i]);
+    }
+  }
+}
+
 static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
 {
   vf_eq2_t      *eq2;
@@ -203,17 +228,23 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
   }
 
   struct mp_image dst = *src;
+  size_t bytes = 0;
 
   for (int i = 0; i < ((src->num_planes>1)?3:1); i++) {
     if (eq2->param[i].adjust != NULL) {
       dst.planes[i] = eq2->buf[i];
       dst.stride[i] = eq2->buf_w[i];
+      bytes += 2 * eq2->buf_w[i] * eq2->buf_h[i];
 
-      eq2->param[i].adjust (&eq2->param[i], dst.planes[i], src->planes[i],
-        eq2->buf_w[i], eq2->buf_h[i], dst.stride[i], src->stride[i]);
+      // Update the LUT here, not concurrently in the slices.
+      if (!eq2->param[i].lut_clean)
+        create_lut (&eq2->param[i]);
     }
   }
 
+  struct eq_slices slices = {eq2, &dst, src};
+  mp_slice_run(src->h, 1 << src->fmt.chroma_ys, bytes, eq_slice, &slices);
+
   struct mp_image *new = vf_alloc_out_image(vf);
   if (new) {
     mp_image_copy(new, &dst);
@@ -73,6 +73,11 @@ struct vf_priv_s {
 
     struct mp_tags* metadata;
 
+    // Statistics about passing input frames to libavfilter (see mp_to_av()).
+    int64_t frames_in;
+    int64_t frames_wrapped;     // not AVBuffer-backed, wrapped instead
+    int64_t frames_readonly;    // not writeable on hand-off
+
     // for the lw wrapper
     void *old_priv;
     int (*lw_reconfig_cb)(struct vf_instance *vf,
@@ -279,6 +284,14 @@ static AVFrame *mp_to_av(struct vf_instance *vf, struct mp_image *img)
         return NULL;
     uint64_t pts = img->pts == MP_NOPTS_VALUE ?
                    AV_NOPTS_VALUE : img->pts * av_q2d(av_inv_q(p->timebase_in));
+    // AVBuffer-backed images are passed as real references, so filters can
+    // process them in-place once we drop our references. Anything else has
+    // to be wrapped, and a filter that needs a writeable frame might copy it.
+    p->frames_in++;
+    if (!mp_image_is_av_buffer_backed(img))
+        p->frames_wrapped++;
+    if (!mp_image_is_writeable(img))
+        p->frames_readonly++;
     AVFrame *frame = mp_image_to_av_frame_and_unref(img);
     if (!frame)
         return NULL; // OOM is (coincidentally) handled as EOF
@@ -375,8 +388,15 @@ static int control(vf_instance_t *vf, int request, void *data)
 
 static void uninit(struct vf_instance *vf)
 {
-    if (!vf->priv)
+    struct vf_priv_s *p = vf->priv;
+    if (!p)
         return;
+    if (p->frames_in) {
+        MP_VERBOSE(vf, "lavfi: %"PRId64" frames passed, %"PRId64" without "
+                   "copy, %"PRId64" wrapped, %"PRId64" read-only.\n",
+                   p->frames_in, p->frames_in - p->frames_wrapped,
+                   p->frames_wrapped, p->frames_readonly);
+    }
     destroy_graph(vf);
 }
 
@@ -31,6 +31,7 @@
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
+#include "video/slice_threads.h"
 #include "vf.h"
 #include "options/m_option.h"
 
@@ -287,6 +288,42 @@ static int config(struct vf_instance *vf, int width, int height, int d_width,
                           d_width, d_height, flags, outfmt);
 }
 
+struct anaglyph_slices {
+    struct vf_priv_s *priv;
+    struct mp_image *dmpi, *mpi;
+    int in_off_left, in_off_right;
+};
+
+static void anaglyph_slice(void *ctx, int y0, int y1)
+{
+    struct anaglyph_slices *c = ctx;
+    int x,y,il,ir,o;
+    unsigned char *source     = c->mpi->planes[0];
+    unsigned char *dest       = c->dmpi->planes[0];
+    unsigned int   out_width  = c->priv->out.width;
+    int           *ana_matrix[3];
+
+    for(int i = 0; i < 3; i++)
+        ana_matrix[i] = c->priv->ana_matrix[i];
+
+    for (y = y0; y < y1; y++) {
+        o   = c->dmpi->stride[0] * y;
+        il  = c->in_off_left  + y * c->mpi->stride[0];
+        ir  = c->in_off_right + y * c->mpi->stride[0];
+        for (x = 0; x < out_width; x++) {
+            dest[o    ]  = ana_convert(
+                           ana_matrix[0], source + il, source + ir); //red out
+            dest[o + 1]  = ana_convert(
+                           ana_matrix[1], source + il, source + ir); //green out
+            dest[o + 2]  = ana_convert(
+                           ana_matrix[2], source + il, source + ir); //blue out
+            il += 3;
+            ir += 3;
+            o  += 3;
+        }
+    }
+}
+
 static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
 {
     if (vf->priv->in.fmt == vf->priv->out.fmt) { //nothing to do
@@ -353,31 +390,16 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
         case ANAGLYPH_YB_HALF:
         case ANAGLYPH_YB_COLOR:
         case ANAGLYPH_YB_DUBOIS: {
-            int x,y,il,ir,o;
-            unsigned char *source     = mpi->planes[0];
-            unsigned char *dest       = dmpi->planes[0];
-            unsigned int   out_width  = vf->priv->out.width;
-            int           *ana_matrix[3];
-
-            for(int i = 0; i < 3; i++)
-                ana_matrix[i] = vf->priv->ana_matrix[i];
-
-            for (y = 0; y < vf->priv->out.height; y++) {
-                o   = dmpi->stride[0] * y;
-                il  = in_off_left  + y * mpi->stride[0];
-                ir  = in_off_right + y * mpi->stride[0];
-                for (x = 0; x < out_width; x++) {
-                    dest[o    ]  = ana_convert(
-                                   ana_matrix[0], source + il, source + ir); //red out
-                    dest[o + 1]  = ana_convert(
-                                   ana_matrix[1], source + il, source + ir); //green out
-                    dest[o + 2]  = ana_convert(
-                                   ana_matrix[2], source + il, source + ir); //blue out
-                    il += 3;
-                    ir += 3;
-                    o  += 3;
-                }
-            }
+            struct anaglyph_slices ctx = {
+                .priv = vf->priv,
+                .dmpi = dmpi,
+                .mpi = mpi,
+                .in_off_left = in_off_left,
+                .in_off_right = in_off_right,
+            };
+            mp_slice_run(vf->priv->out.height, 1,
+                         (size_t)vf->priv->out.height * vf->priv->out.width * 9,
+                         anaglyph_slice, &ctx);
             break;
         }
         default:
@@ -0,0 +1,396 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "memcpy_pic.h"
+#include "mp_image.h"
+#include "slice_threads.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_MEMCPY_PIC_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HAVE_MEMCPY_PIC_X86 0
+#endif
+
+// Operations writing at least this many bytes use non-temporal stores. This
+// is roughly where the destination stops fitting into the caches of typical
+// CPUs; below it, regular stores are faster, because the data is likely
+// read again soon (e.g. by the next filter or the VO).
+#define STREAM_THRESHOLD (4 * 1024 * 1024)
+
+struct pic_ops {
+    const char *name;
+    // Like memcpy() and memset(), but with non-temporal stores. fence() must
+    // be called after a sequence of calls.
+    void (*copy_nt)(void *dst, const void *src, size_t size);
+    void (*set_nt)(void *dst, int fill, size_t size);
+    // Set n 16 bit words to fill, with non-temporal stores if stream is set.
+    void (*set16)(void *dst, uint16_t fill, size_t n, bool stream);
+    void (*fence)(void);
+};
+
+static void copy_nt_c(void *dst, const void *src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+static void set_nt_c(void *dst, int fill, size_t size)
+{
+    memset(dst, fill, size);
+}
+
+static void set16_c(void *dst, uint16_t fill, size_t n, bool stream)
+{
+    uint16_t *d = dst;
+    for (size_t i = 0; i < n; i++)
+        d[i] = fill;
+}
+
+static void fence_c(void)
+{
+}
+
+static const struct pic_ops ops_c = {
+    .name = "c",
+    .copy_nt = copy_nt_c,
+    .set_nt = set_nt_c,
+    .set16 = set16_c,
+    .fence = fence_c,
+};
+
+#if HAVE_MEMCPY_PIC_X86
+
+// The SIMD versions align the destination for the non-temporal stores, and
+// leave the unaligned head and the tail to the C versions.
+
+TARGET_SSE2
+static void copy_nt_sse2(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head = MPMIN(-(uintptr_t)d & 15, size);
+    memcpy(d, s, head);
+    d += head, s += head, size -= head;
+    for (; size >= 64; d += 64, s += 64, size -= 64) {
+        __m128i r0 = _mm_loadu_si128((const __m128i *)s + 0);
+        __m128i r1 = _mm_loadu_si128((const __m128i *)s + 1);
+        __m128i r2 = _mm_loadu_si128((const __m128i *)s + 2);
+        __m128i r3 = _mm_loadu_si128((const __m128i *)s + 3);
+        _mm_stream_si128((__m128i *)d + 0, r0);
+        _mm_stream_si128((__m128i *)d + 1, r1);
+        _mm_stream_si128((__m128i *)d + 2, r2);
+        _mm_stream_si128((__m128i *)d + 3, r3);
+    }
+    for (; size >= 16; d += 16, s += 16, size -= 16)
+        _mm_stream_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+    memcpy(d, s, size);
+}
+
+TARGET_SSE2
+static void set_nt_sse2(void *dst, int fill, size_t size)
+{
+    uint8_t *d = dst;
+    size_t head = MPMIN(-(uintptr_t)d & 15, size);
+    memset(d, fill, head);
+    d += head, size -= head;
+    __m128i v = _mm_set1_epi8(fill);
+    for (; size >= 16; d += 16, size -= 16)
+        _mm_stream_si128((__m128i *)d, v);
+    memset(d, fill, size);
+}
+
+TARGET_SSE2
+static void set16_sse2(void *dst, uint16_t fill, size_t n, bool stream)
+{
+    uint16_t *d = dst;
+    size_t i = 0;
+    __m128i v = _mm_set1_epi16(fill);
+    if (stream && !((uintptr_t)d & 1)) {
+        for (; i < n && ((uintptr_t)(d + i) & 15); i++)
+            d[i] = fill;
+        for (; i + 8 <= n; i += 8)
+            _mm_stream_si128((__m128i *)(d + i), v);
+    } else {
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *)(d + i), v);
+    }
+    set16_c(d + i, fill, n - i, false);
+}
+
+TARGET_SSE2
+static void fence_sse2(void)
+{
+    _mm_sfence();
+}
+
+static const struct pic_ops ops_sse2 = {
+    .name = "sse2",
+    .copy_nt = copy_nt_sse2,
+    .set_nt = set_nt_sse2,
+    .set16 = set16_sse2,
+    .fence = fence_sse2,
+};
+
+TARGET_AVX2
+static void copy_nt_avx2(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head = MPMIN(-(uintptr_t)d & 31, size);
+    memcpy(d, s, head);
+    d += head, s += head, size -= head;
+    for (; size >= 128; d += 128, s += 128, size -= 128) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i *)s + 0);
+        __m256i r1 = _mm256_loadu_si256((const __m256i *)s + 1);
+        __m256i r2 = _mm256_loadu_si256((const __m256i *)s + 2);
+        __m256i r3 = _mm256_loadu_si256((const __m256i *)s + 3);
+        _mm256_stream_si256((__m256i *)d + 0, r0);
+        _mm256_stream_si256((__m256i *)d + 1, r1);
+        _mm256_stream_si256((__m256i *)d + 2, r2);
+        _mm256_stream_si256((__m256i *)d + 3, r3);
+    }
+    for (; size >= 32; d += 32, s += 32, size -= 32)
+        _mm256_stream_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+    memcpy(d, s, size);
+}
+
+TARGET_AVX2
+static void set_nt_avx2(void *dst, int fill, size_t size)
+{
+    uint8_t *d = dst;
+    size_t head = MPMIN(-(uintptr_t)d & 31, size);
+    memset(d, fill, head);
+    d += head, size -= head;
+    __m256i v = _mm256_set1_epi8(fill);
+    for (; size >= 32; d += 32, size -= 32)
+        _mm256_stream_si256((__m256i *)d, v);
+    memset(d, fill, size);
+}
+
+TARGET_AVX2
+static void set16_avx2(void *dst, uint16_t fill, size_t n, bool stream)
+{
+    uint16_t *d = dst;
+    size_t i = 0;
+    __m256i v = _mm256_set1_epi16(fill);
+    if (stream && !((uintptr_t)d & 1)) {
+        for (; i < n && ((uintptr_t)(d + i) & 31); i++)
+            d[i] = fill;
+        for (; i + 16 <= n; i += 16)
+            _mm256_stream_si256((__m256i *)(d + i), v);
+    } else {
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i *)(d + i), v);
+    }
+    set16_c(d + i, fill, n - i, false);
+}
+
+static const struct pic_ops ops_avx2 = {
+    .name = "avx2",
+    .copy_nt = copy_nt_avx2,
+    .set_nt = set_nt_avx2,
+    .set16 = set16_avx2,
+    .fence = fence_sse2,
+};
+
+#endif /* HAVE_MEMCPY_PIC_X86 */
+
+// Best first.
+static const struct {
+    const struct pic_ops *ops;
+    int cpu_flags;
+} impls[] = {
+#if HAVE_MEMCPY_PIC_X86
+    {&ops_avx2, AV_CPU_FLAG_AVX2},
+    {&ops_sse2, AV_CPU_FLAG_SSE2},
+#endif
+    {&ops_c, 0},
+};
+
+// This respects av_force_cpu_flags(), so av_force_cpu_flags(0) selects the
+// C code.
+static const struct pic_ops *get_ops(void)
+{
+    int flags = av_get_cpu_flags();
+    for (int n = 0; n < MP_ARRAY_SIZE(impls); n++) {
+        if ((flags & impls[n].cpu_flags) == impls[n].cpu_flags)
+            return impls[n].ops;
+    }
+    abort(); // the C version is always supported
+}
+
+const char *mp_pic_impl_name(void)
+{
+    return get_ops()->name;
+}
+
+bool mp_pic_want_stream(size_t bytes)
+{
+    return bytes >= STREAM_THRESHOLD;
+}
+
+// Whether lines of the given size and stride follow each other without gap.
+static bool contiguous(size_t line_bytes, ptrdiff_t stride)
+{
+    return stride == (ptrdiff_t)line_bytes || -stride == (ptrdiff_t)line_bytes;
+}
+
+void mp_pic_copy(void *dst, const void *src, size_t line_bytes, int h,
+                 ptrdiff_t dst_stride, ptrdiff_t src_stride, bool stream)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if (h > 1 && dst_stride == src_stride && contiguous(line_bytes, dst_stride))
+    {
+        if (dst_stride < 0) {
+            d += (h - 1) * dst_stride;
+            s += (h - 1) * src_stride;
+        }
+        line_bytes *= h;
+        h = 1;
+    }
+    if (!stream) {
+        for (int y = 0; y < h; y++)
+            memcpy(d + y * dst_stride, s + y * src_stride, line_bytes);
+        return;
+    }
+    const struct pic_ops *ops = get_ops();
+    for (int y = 0; y < h; y++)
+        ops->copy_nt(d + y * dst_stride, s + y * src_stride, line_bytes);
+    ops->fence();
+}
+
+void mp_pic_set(void *dst, int fill, size_t line_bytes, int h,
+                ptrdiff_t stride, bool stream)
+{
+    uint8_t *d = dst;
+    if (h > 1 && contiguous(line_bytes, stride)) {
+        if (stride < 0)
+            d += (h - 1) * stride;
+        line_bytes *= h;
+        h = 1;
+    }
+    if (!stream) {
+        for (int y = 0; y < h; y++)
+            memset(d + y * stride, fill, line_bytes);
+        return;
+    }
+    const struct pic_ops *ops = get_ops();
+    for (int y = 0; y < h; y++)
+        ops->set_nt(d + y * stride, fill, line_bytes);
+    ops->fence();
+}
+
+void mp_pic_set16(void *dst, uint16_t fill, size_t units, int h,
+                  ptrdiff_t stride, bool stream)
+{
+    // E.g. 0 or 0x8080: same as a byte fill.
+    if ((fill >> 8) == (fill & 0xFF)) {
+        mp_pic_set(dst, fill & 0xFF, units * 2, h, stride, stream);
+        return;
+    }
+    uint8_t *d = dst;
+    if (h > 1 && contiguous(units * 2, stride)) {
+        if (stride < 0)
+            d += (h - 1) * stride;
+        units *= h;
+        h = 1;
+    }
+    const struct pic_ops *ops = get_ops();
+    for (int y = 0; y < h; y++)
+        ops->set16(d + y * stride, fill, units, stream);
+    if (stream)
+        ops->fence();
+}
+
+struct pic_slices {
+    uint8_t *dst;
+    const uint8_t *src;
+    int fill;
+    size_t line;
+    ptrdiff_t dst_stride, src_stride;
+    bool stream;
+};
+
+static void copy_slice(void *ctx, int y0, int y1)
+{
+    struct pic_slices *c = ctx;
+    mp_pic_copy(c->dst + y0 * c->dst_stride, c->src + y0 * c->src_stride,
+                c->line, y1 - y0, c->dst_stride, c->src_stride, c->stream);
+}
+
+static void set_slice(void *ctx, int y0, int y1)
+{
+    struct pic_slices *c = ctx;
+    mp_pic_set(c->dst + y0 * c->dst_stride, c->fill, c->line, y1 - y0,
+               c->dst_stride, c->stream);
+}
+
+static void set16_slice(void *ctx, int y0, int y1)
+{
+    struct pic_slices *c = ctx;
+    mp_pic_set16(c->dst + y0 * c->dst_stride, c->fill, c->line, y1 - y0,
+                 c->dst_stride, c->stream);
+}
+
+void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
+                int dstStride, int srcStride)
+{
+    if (height <= 0 || bytesPerLine <= 0)
+        return;
+    size_t bytes = (size_t)bytesPerLine * height;
+    struct pic_slices c = {
+        .dst = dst, .src = src, .line = bytesPerLine,
+        .dst_stride = dstStride, .src_stride = srcStride,
+        .stream = mp_pic_want_stream(bytes),
+    };
+    mp_slice_run(height, 1, bytes * 2, copy_slice, &c);
+}
+
+void memset_pic(void *dst, int fill, int bytesPerLine, int height, int stride)
+{
+    if (height <= 0 || bytesPerLine <= 0)
+        return;
+    size_t bytes = (size_t)bytesPerLine * height;
+    struct pic_slices c = {
+        .dst = dst, .fill = fill, .line = bytesPerLine, .dst_stride = stride,
+        .stream = mp_pic_want_stream(bytes),
+    };
+    mp_slice_run(height, 1, bytes, set_slice, &c);
+}
+
+void memset16_pic(void *dst, int fill, int unitsPerLine, int height, int stride)
+{
+    if (height <= 0 || unitsPerLine <= 0)
+        return;
+    size_t bytes = (size_t)unitsPerLine * 2 * height;
+    struct pic_slices c = {
+        .dst = dst, .fill = fill, .line = unitsPerLine, .dst_stride = stride,
+        .stream = mp_pic_want_stream(bytes),
+    };
+    mp_slice_run(height, 1, bytes, set16_slice, &c);
+}
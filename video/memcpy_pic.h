@@ -0,0 +1,49 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MEMCPY_PIC_H
+#define MP_MEMCPY_PIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Plane copy/fill functions. memcpy_pic(), memset_pic() and memset16_pic()
+// (declared in mp_image.h) use them, and split large operations into slices
+// with mp_slice_run().
+//
+// The functions here process h lines of line_bytes bytes (or units 16 bit
+// words) each, and don't slice. Lines with stride == line size are handled
+// as a single block. If stream is set, non-temporal stores are used if the
+// CPU supports them, which avoids evicting the cache for data that is not
+// read again soon; mp_pic_want_stream() returns whether this is a good idea
+// for an operation writing the given number of bytes in total.
+
+bool mp_pic_want_stream(size_t bytes);
+
+// Name of the implementation in use ("c", "sse2", "avx2"). This respects
+// av_force_cpu_flags(), so av_force_cpu_flags(0) selects the C code.
+const char *mp_pic_impl_name(void);
+
+void mp_pic_copy(void *dst, const void *src, size_t line_bytes, int h,
+                 ptrdiff_t dst_stride, ptrdiff_t src_stride, bool stream);
+void mp_pic_set(void *dst, int fill, size_t line_bytes, int h,
+                ptrdiff_t stride, bool stream);
+void mp_pic_set16(void *dst, uint16_t fill, size_t units, int h,
+                  ptrdiff_t stride, bool stream);
+
+#endif
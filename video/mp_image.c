@@ -35,6 +35,8 @@
 #include "mp_image.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
+#include "memcpy_pic.h"
+#include "slice_threads.h"
 
 #include "video/filter/vf.h"
 
@@ -104,12 +106,26 @@ static bool m_refcount_is_unique(struct m_refcount *ref)
     return true;
 }
 
-static bool mp_image_alloc_planes(struct mp_image *mpi)
+static void free_av_buffer(void *arg)
+{
+    AVBufferRef *buf = arg;
+    av_buffer_unref(&buf);
+}
+
+static bool av_buffer_is_unique(void *arg)
+{
+    return av_buffer_is_writable(arg);
+}
+
+// Allocate the image data as a single AVBuffer, and return it. The planes
+// and strides are aligned to MP_IMAGE_BYTE_ALIGN, like libavfilter's and
+// libavcodec's own buffers, so the data can be passed to them as it is.
+static AVBufferRef *mp_image_alloc_planes(struct mp_image *mpi)
 {
     assert(!mpi->planes[0]);
 
     if (!mp_image_params_valid(&mpi->params) || mpi->fmt.flags & MP_IMGFLAG_HWACCEL)
-        return false;
+        return NULL;
 
     // Note: for non-mod-2 4:2:0 YUV frames, we have to allocate an additional
     //       top/right border. This is needed for correct handling of such
@@ -119,7 +135,7 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     for (int n = 0; n < MP_MAX_PLANES; n++) {
         int alloc_h = MP_ALIGN_UP(mpi->h, 32) >> mpi->fmt.ys[n];
         int line_bytes = (mp_image_plane_w(mpi, n) * mpi->fmt.bpp[n] + 7) / 8;
-        mpi->stride[n] = FFALIGN(line_bytes, SWS_MIN_BYTE_ALIGN);
+        mpi->stride[n] = FFALIGN(line_bytes, MP_IMAGE_BYTE_ALIGN);
         plane_size[n] = mpi->stride[n] * alloc_h;
     }
     if (mpi->fmt.flags & MP_IMGFLAG_PAL)
@@ -129,15 +145,20 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     for (int n = 0; n < MP_MAX_PLANES; n++)
         sum += plane_size[n];
 
-    uint8_t *data = av_malloc(FFMAX(sum, 1));
-    if (!data)
-        return false;
+    // av_malloc() might guarantee less alignment than we want, so allocate
+    // room to align the start. The padding at the end allows SIMD code to
+    // read a full vector past the last pixel.
+    AVBufferRef *buf = av_buffer_alloc(sum + MP_IMAGE_BYTE_ALIGN * 2);
+    if (!buf)
+        return NULL;
 
+    uint8_t *data = (uint8_t *)MP_ALIGN_UP((uintptr_t)buf->data,
+                                           MP_IMAGE_BYTE_ALIGN);
     for (int n = 0; n < MP_MAX_PLANES; n++) {
         mpi->planes[n] = plane_size[n] ? data : NULL;
         data += plane_size[n];
     }
-    return true;
+    return buf;
 }
 
 void mp_image_setfmt(struct mp_image *mpi, int out_fmt)
@@ -198,12 +219,14 @@ struct mp_image *mp_image_alloc(int imgfmt, int w, int h)
 
     mp_image_set_size(mpi, w, h);
     mp_image_setfmt(mpi, imgfmt);
-    if (!mp_image_alloc_planes(mpi)) {
+    AVBufferRef *buf = mp_image_alloc_planes(mpi);
+    if (!buf) {
         talloc_free(mpi);
         return NULL;
     }
-    mpi->refcount->free = av_free;
-    mpi->refcount->arg = mpi->planes[0];
+    mpi->refcount->ext_is_unique = av_buffer_is_unique;
+    mpi->refcount->free = free_av_buffer;
+    mpi->refcount->arg = buf;
     return mpi;
 }
 
@@ -285,6 +308,27 @@ struct mp_image *mp_image_new_custom_ref(struct mp_image *img, void *free_arg,
     return mp_image_new_external_ref(img, free_arg, NULL, free);
 }
 
+// Return a reference counted reference to img, whose data is owned by buf.
+// The caller's reference to buf is taken over, and unreffed when the last
+// reference to the image is free'd. The image is writeable as long as buf is.
+// All planes of img must point into buf.
+struct mp_image *mp_image_new_av_buffer_ref(struct mp_image *img,
+                                            struct AVBufferRef *buf)
+{
+    return mp_image_new_external_ref(img, buf, av_buffer_is_unique,
+                                     free_av_buffer);
+}
+
+// Return the AVBuffer containing all planes of img, or NULL if the image data
+// is not backed by a single AVBuffer (e.g. hwaccel surfaces, or images
+// wrapping foreign memory). The returned reference is owned by img.
+struct AVBufferRef *mp_image_get_av_buffer(struct mp_image *img)
+{
+    if (!img->refcount || img->refcount->free != free_av_buffer)
+        return NULL;
+    return img->refcount->arg;
+}
+
 bool mp_image_is_writeable(struct mp_image *img)
 {
     if (!img->refcount)
@@ -326,17 +370,54 @@ void mp_image_unrefp(struct mp_image **p_img)
     *p_img = NULL;
 }
 
+// Rows [*py0, *py1) of the given plane, which correspond to the image rows
+// [y0, y1). y0 must be aligned to align_y, y1 too, unless it's the last row.
+static void plane_rows(struct mp_image *img, int plane, int y0, int y1,
+                       int *py0, int *py1)
+{
+    *py0 = y0 >> img->fmt.ys[plane];
+    *py1 = y1 >= img->h ? mp_image_plane_h(img, plane)
+                        : y1 >> img->fmt.ys[plane];
+}
+
+static size_t image_bytes(struct mp_image *img)
+{
+    size_t bytes = 0;
+    for (int n = 0; n < img->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(img, n) * img->fmt.bpp[n] + 7) / 8;
+        bytes += (size_t)line_bytes * mp_image_plane_h(img, n);
+    }
+    return bytes;
+}
+
+struct copy_slices {
+    struct mp_image *dst, *src;
+    bool stream;
+};
+
+static void copy_slice(void *ctx, int y0, int y1)
+{
+    struct copy_slices *c = ctx;
+    struct mp_image *dst = c->dst, *src = c->src;
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int py0, py1;
+        plane_rows(dst, n, y0, y1, &py0, &py1);
+        mp_pic_copy(dst->planes[n] + py0 * dst->stride[n],
+                    src->planes[n] + py0 * src->stride[n],
+                    line_bytes, py1 - py0, dst->stride[n], src->stride[n],
+                    c->stream);
+    }
+}
+
 void mp_image_copy(struct mp_image *dst, struct mp_image *src)
 {
     assert(dst->imgfmt == src->imgfmt);
     assert(dst->w == src->w && dst->h == src->h);
     assert(mp_image_is_writeable(dst));
-    for (int n = 0; n < dst->num_planes; n++) {
-        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
-        int plane_h = mp_image_plane_h(dst, n);
-        memcpy_pic(dst->planes[n], src->planes[n], line_bytes, plane_h,
-                   dst->stride[n], src->stride[n]);
-    }
+    size_t bytes = image_bytes(dst);
+    struct copy_slices ctx = {dst, src, mp_pic_want_stream(bytes)};
+    mp_slice_run(dst->h, dst->fmt.align_y, bytes * 2, copy_slice, &ctx);
     // Watch out for AV_PIX_FMT_FLAG_PSEUDOPAL retardation
     if ((dst->fmt.flags & MP_IMGFLAG_PAL) && dst->planes[1] && src->planes[1])
         memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
@@ -392,6 +473,32 @@ void mp_image_crop_rc(struct mp_image *img, struct mp_rect rc)
     mp_image_crop(img, rc.x0, rc.y0, rc.x1, rc.y1);
 }
 
+struct clear_slices {
+    struct mp_image *img;
+    uint32_t plane_clear[MP_MAX_PLANES];
+    bool stream;
+};
+
+static void clear_slice(void *ctx, int y0, int y1)
+{
+    struct clear_slices *c = ctx;
+    struct mp_image *img = c->img;
+    for (int p = 0; p < img->num_planes; p++) {
+        int bpp = img->fmt.bpp[p];
+        int bytes = (mp_image_plane_w(img, p) * bpp + 7) / 8;
+        int py0, py1;
+        plane_rows(img, p, y0, y1, &py0, &py1);
+        void *dst = img->planes[p] + py0 * img->stride[p];
+        if (bpp <= 8) {
+            mp_pic_set(dst, c->plane_clear[p], bytes, py1 - py0,
+                       img->stride[p], c->stream);
+        } else {
+            mp_pic_set16(dst, c->plane_clear[p], (bytes + 1) / 2, py1 - py0,
+                         img->stride[p], c->stream);
+        }
+    }
+}
+
 // Bottom/right border is allowed not to be aligned, but it might implicitly
 // overwrite pixel data until the alignment (align_x/align_y) is reached.
 void mp_image_clear(struct mp_image *img, int x0, int y0, int x1, int y1)
@@ -405,7 +512,8 @@ void mp_image_clear(struct mp_image *img, int x0, int y0, int x1, int y1)
     struct mp_image area = *img;
     mp_image_crop(&area, x0, y0, x1, y1);
 
-    uint32_t plane_clear[MP_MAX_PLANES] = {0};
+    struct clear_slices ctx = {.img = &area};
+    uint32_t *plane_clear = ctx.plane_clear;
 
     if (area.imgfmt == IMGFMT_YUYV) {
         plane_clear[0] = av_le2ne16(0x8000);
@@ -421,17 +529,9 @@ void mp_image_clear(struct mp_image *img, int x0, int y0, int x1, int y1)
             plane_clear[1] = plane_clear[2] = chroma_clear;
     }
 
-    for (int p = 0; p < area.num_planes; p++) {
-        int bpp = area.fmt.bpp[p];
-        int bytes = (mp_image_plane_w(&area, p) * bpp + 7) / 8;
-        if (bpp <= 8) {
-            memset_pic(area.planes[p], plane_clear[p], bytes,
-                       mp_image_plane_h(&area, p), area.stride[p]);
-        } else {
-            memset16_pic(area.planes[p], plane_clear[p], (bytes + 1) / 2,
-                         mp_image_plane_h(&area, p), area.stride[p]);
-        }
-    }
+    size_t bytes = image_bytes(&area);
+    ctx.stream = mp_pic_want_stream(bytes);
+    mp_slice_run(area.h, area.fmt.align_y, bytes, clear_slice, &ctx);
 }
 
 void mp_image_vflip(struct mp_image *img)
@@ -691,6 +791,46 @@ static void free_img(void *opaque, uint8_t *data)
     talloc_free(img);
 }
 
+// If the image data is backed by AVBuffers, add new references to them to
+// frame->buf[], and return true. This way libavfilter & co. see the real
+// reference count, and can write to the data once all other references are
+// gone, instead of having to make a copy.
+static bool ref_av_buffers(struct AVFrame *frame, struct mp_image *img)
+{
+    AVBufferRef *bufs[AV_NUM_DATA_POINTERS] = {0};
+    if (mp_image_get_av_buffer(img)) {
+        bufs[0] = mp_image_get_av_buffer(img);
+    } else if (img->refcount && img->refcount->free == frame_free) {
+        AVFrame *src = img->refcount->arg;
+        if (src->nb_extended_buf)
+            return false;
+        for (int n = 0; n < AV_NUM_DATA_POINTERS; n++)
+            bufs[n] = src->buf[n];
+    }
+    if (!bufs[0])
+        return false;
+    for (int n = 0; n < AV_NUM_DATA_POINTERS; n++) {
+        if (bufs[n]) {
+            frame->buf[n] = av_buffer_ref(bufs[n]);
+            if (!frame->buf[n])
+                abort();
+        }
+    }
+    return true;
+}
+
+// Whether mp_image_to_av_frame_and_unref() can pass the image data to the
+// AVFrame as AVBuffer references (see ref_av_buffers()).
+bool mp_image_is_av_buffer_backed(struct mp_image *img)
+{
+    if (mp_image_get_av_buffer(img))
+        return true;
+    if (!img->refcount || img->refcount->free != frame_free)
+        return false;
+    AVFrame *src = img->refcount->arg;
+    return src->buf[0] && !src->nb_extended_buf;
+}
+
 // Convert the mp_image reference to a AVFrame reference.
 // Warning: img is unreferenced (i.e. free'd). This is asymmetric to
 //          mp_image_from_av_frame(). It's done this way to allow marking the
@@ -709,6 +849,10 @@ struct AVFrame *mp_image_to_av_frame_and_unref(struct mp_image *img)
         return NULL;
     }
     mp_image_copy_fields_to_av_frame(frame, new_ref);
+    if (ref_av_buffers(frame, new_ref)) {
+        talloc_free(new_ref);
+        return frame;
+    }
     // Caveat: if img has shared references, and all other references disappear
     //         at a later point, the AVFrame will still be read-only.
     int flags = 0;
@@ -729,50 +873,3 @@ struct AVFrame *mp_image_to_av_frame_and_unref(struct mp_image *img)
     talloc_free(new_ref);
     return frame;
 }
-
-void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
-                int dstStride, int srcStride)
-{
-    if (bytesPerLine == dstStride && dstStride == srcStride && height) {
-        if (srcStride < 0) {
-            src = (uint8_t*)src + (height - 1) * srcStride;
-            dst = (uint8_t*)dst + (height - 1) * dstStride;
-            srcStride = -srcStride;
-        }
-
-        memcpy(dst, src, srcStride * (height - 1) + bytesPerLine);
-    } else {
-        for (int i = 0; i < height; i++) {
-            memcpy(dst, src, bytesPerLine);
-            src = (uint8_t*)src + srcStride;
-            dst = (uint8_t*)dst + dstStride;
-        }
-    }
-}
-
-void memset_pic(void *dst, int fill, int bytesPerLine, int height, int stride)
-{
-    if (bytesPerLine == stride && height) {
-        memset(dst, fill, stride * (height - 1) + bytesPerLine);
-    } else {
-        for (int i = 0; i < height; i++) {
-            memset(dst, fill, bytesPerLine);
-            dst = (uint8_t *)dst + stride;
-        }
-    }
-}
-
-void memset16_pic(void *dst, int fill, int unitsPerLine, int height, int stride)
-{
-    if (fill == 0) {
-        memset_pic(dst, 0, unitsPerLine * 2, height, stride);
-    } else {
-        for (int i = 0; i < height; i++) {
-            uint16_t *line = dst;
-            uint16_t *end = line + unitsPerLine;
-            while (line < end)
-                *line++ = fill;
-            dst = (uint8_t *)dst + stride;
-        }
-    }
-}
@@ -30,6 +30,11 @@
 
 #define MP_PALETTE_SIZE (256 * 4)
 
+// Alignment of planes and strides of images allocated by mp_image_alloc(), and
+// the padding after the image data. Large enough for libavcodec/libavfilter
+// SIMD code (up to AVX-512), so that they can use our images without copying.
+#define MP_IMAGE_BYTE_ALIGN 64
+
 #define MP_IMGFIELD_TOP_FIRST 0x02
 #define MP_IMGFIELD_REPEAT_FIRST 0x04
 #define MP_IMGFIELD_INTERLACED 0x20
@@ -128,6 +133,10 @@ void mp_image_steal_data(struct mp_image *dst, struct mp_image *src);
 
 struct mp_image *mp_image_new_custom_ref(struct mp_image *img, void *arg,
                                          void (*free)(void *arg));
+struct AVBufferRef;
+struct mp_image *mp_image_new_av_buffer_ref(struct mp_image *img,
+                                            struct AVBufferRef *buf);
+struct AVBufferRef *mp_image_get_av_buffer(struct mp_image *img);
 
 void mp_image_params_guess_csp(struct mp_image_params *params);
 
@@ -152,7 +161,10 @@ void mp_image_copy_fields_to_av_frame(struct AVFrame *dst,
                                       struct mp_image *src);
 struct mp_image *mp_image_from_av_frame(struct AVFrame *av_frame);
 struct AVFrame *mp_image_to_av_frame_and_unref(struct mp_image *img);
+bool mp_image_is_av_buffer_backed(struct mp_image *img);
 
+// Implemented in memcpy_pic.c. Large operations are split into slices (see
+// slice_threads.h), and use non-temporal stores if it's worth it.
 void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
                 int dstStride, int srcStride);
 void memset_pic(void *dst, int fill, int bytesPerLine, int height, int stride);
@@ -22,6 +22,8 @@
 #include <pthread.h>
 #include <assert.h>
 
+#include <libavutil/buffer.h>
+
 #include "talloc.h"
 
 #include "common/common.h"
@@ -108,6 +110,11 @@ static void unref_image(void *ptr)
         talloc_free(img);
 }
 
+static void unref_image_buffer(void *opaque, uint8_t *data)
+{
+    unref_image(opaque);
+}
+
 // Return a new image of given format/size. Unlike mp_image_pool_get(), this
 // returns NULL if there is no free image of this format/size.
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
@@ -139,6 +146,19 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
     assert(!it->referenced && it->pool_alive);
     it->referenced = true;
     it->order = ++pool->lru_counter;
+    // If the pool memory is an AVBuffer (the default allocator), hand it out
+    // as a new AVBuffer, so that it can be passed to libavfilter and
+    // libavcodec as real reference, without copying or wrapping.
+    struct AVBufferRef *buf = mp_image_get_av_buffer(new);
+    if (buf) {
+        struct AVBufferRef *ref = av_buffer_create(buf->data, buf->size,
+                                                   unref_image_buffer, new, 0);
+        if (!ref) {
+            unref_image(new);
+            return NULL;
+        }
+        return mp_image_new_av_buffer_ref(new, ref);
+    }
     return mp_image_new_custom_ref(new, new, unref_image);
 }
 
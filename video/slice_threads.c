@@ -0,0 +1,185 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "misc/thread_pool.h"
+
+#include "slice_threads.h"
+
+#define MAX_SLICES 64
+
+// Splitting something smaller than this costs more than it gains.
+#define MIN_SLICE_BYTES (256 * 1024)
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+static struct mp_thread_pool *pool; // created on first use
+static int pool_threads;            // number of threads in pool
+static int pool_active;             // mp_slice_run() calls using pool
+static int num_threads = 1;         // configured thread count
+static int num_users;
+
+void mp_slice_threads_init(int threads)
+{
+    if (threads <= 0)
+        threads = av_cpu_count();
+    pthread_mutex_lock(&pool_lock);
+    num_users++;
+    num_threads = MPCLAMP(threads, 1, MAX_SLICES);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void mp_slice_threads_uninit(void)
+{
+    struct mp_thread_pool *to_free = NULL;
+    pthread_mutex_lock(&pool_lock);
+    assert(num_users > 0);
+    num_users--;
+    if (!num_users) {
+        while (pool_active)
+            pthread_cond_wait(&pool_idle, &pool_lock);
+        to_free = pool;
+        pool = NULL;
+        pool_threads = 0;
+        num_threads = 1;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    // Waits for the worker threads to exit.
+    talloc_free(to_free);
+}
+
+int mp_slice_threads_count(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    int r = num_threads;
+    pthread_mutex_unlock(&pool_lock);
+    return r;
+}
+
+struct slice_job {
+    void (*fn)(void *ctx, int y0, int y1);
+    void *ctx;
+    int y0, y1;
+    struct slice_wait *wait;
+};
+
+struct slice_wait {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int pending;
+};
+
+static void slice_worker(void *arg)
+{
+    struct slice_job *job = arg;
+    struct slice_wait *wait = job->wait;
+    job->fn(job->ctx, job->y0, job->y1);
+    pthread_mutex_lock(&wait->lock);
+    wait->pending--;
+    if (!wait->pending)
+        pthread_cond_signal(&wait->done);
+    pthread_mutex_unlock(&wait->lock);
+}
+
+// Return the pool with at least threads-1 workers, or NULL. If a pool is
+// returned, put_pool() must be called when done.
+// Only one mp_slice_run() call uses the pool at a time. Others, including
+// calls from within a slice, get NULL. This avoids waiting on the pool from
+// one of its own workers, and oversubscribing the CPU.
+static struct mp_thread_pool *get_pool(int *threads)
+{
+    pthread_mutex_lock(&pool_lock);
+    *threads = num_threads;
+    if (*threads > 1 && !pool) {
+        pool = mp_thread_pool_create(NULL, *threads - 1);
+        pool_threads = pool ? *threads - 1 : 0;
+    }
+    // The pool doesn't grow if the thread count is raised after first use.
+    *threads = MPMIN(*threads, pool_threads + 1);
+    struct mp_thread_pool *r = pool_active ? NULL : pool;
+    if (r)
+        pool_active++;
+    pthread_mutex_unlock(&pool_lock);
+    return r;
+}
+
+static void put_pool(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_active--;
+    if (!pool_active)
+        pthread_cond_broadcast(&pool_idle);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void mp_slice_run(int h, int align, size_t bytes,
+                  void (*fn)(void *ctx, int y0, int y1), void *ctx)
+{
+    if (h <= 0)
+        return;
+    align = MPMAX(align, 1);
+
+    int slices = MPMIN(bytes / MIN_SLICE_BYTES, h / align);
+    struct mp_thread_pool *p = NULL;
+    if (slices > 1) {
+        int threads;
+        p = get_pool(&threads);
+        slices = MPMIN(slices, threads);
+    }
+    if (!p || slices < 2) {
+        fn(ctx, 0, h);
+        if (p)
+            put_pool();
+        return;
+    }
+
+    struct slice_wait wait = {.pending = slices - 1};
+    pthread_mutex_init(&wait.lock, NULL);
+    pthread_cond_init(&wait.done, NULL);
+
+    struct slice_job jobs[MAX_SLICES];
+    int units = h / align;
+    for (int n = 0; n < slices; n++) {
+        jobs[n] = (struct slice_job){
+            .fn = fn,
+            .ctx = ctx,
+            .y0 = units * n / slices * align,
+            .y1 = n == slices - 1 ? h : units * (n + 1) / slices * align,
+            .wait = &wait,
+        };
+    }
+
+    // The first slice runs on this thread.
+    for (int n = 1; n < slices; n++)
+        mp_thread_pool_queue(p, slice_worker, &jobs[n]);
+    fn(ctx, jobs[0].y0, jobs[0].y1);
+
+    pthread_mutex_lock(&wait.lock);
+    while (wait.pending)
+        pthread_cond_wait(&wait.done, &wait.lock);
+    pthread_mutex_unlock(&wait.lock);
+
+    pthread_mutex_destroy(&wait.lock);
+    pthread_cond_destroy(&wait.done);
+    put_pool();
+}
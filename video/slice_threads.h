@@ -0,0 +1,45 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_SLICE_THREADS_H
+#define MP_SLICE_THREADS_H
+
+#include <stddef.h>
+
+// Process-wide worker pool for processing images in horizontal slices. The
+// player calls mp_slice_threads_init() with the --video-slice-threads value
+// (0 means one thread per CPU), and mp_slice_threads_uninit() when it's
+// destroyed. With multiple users (e.g. several libmpv instances), the
+// thread count of the last init call is used. Without any user, all work
+// runs on the calling thread.
+void mp_slice_threads_init(int threads);
+void mp_slice_threads_uninit(void);
+
+// Number of threads mp_slice_run() currently uses at most (>= 1).
+int mp_slice_threads_count(void);
+
+// Run fn(ctx, y0, y1) for slices covering the rows [0, h), and wait until all
+// are done. The calls can happen concurrently on different threads. y0 is
+// always a multiple of align (e.g. for chroma subsampling), and the last
+// slice ends at h. bytes is the approximate amount of memory touched by the
+// whole operation; small operations are not split. While the pool is busy
+// with another call (from another thread, or from within fn()), everything
+// runs on the calling thread.
+void mp_slice_run(int h, int align, size_t bytes,
+                  void (*fn)(void *ctx, int y0, int y1), void *ctx);
+
+#endif
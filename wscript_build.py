@@ -91,11 +91,13 @@ def build(ctx):
         ## Audio
         ( "audio/audio.c" ),
         ( "audio/audio_buffer.c" ),
+        ( "audio/audio_ring.c" ),
         ( "audio/chmap.c" ),
         ( "audio/chmap_sel.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
         ( "audio/mixer.c" ),
+        ( "audio/sample_ops.c" ),
         ( "audio/decode/ad_lavc.c" ),
         ( "audio/decode/ad_spdif.c" ),
         ( "audio/decode/dec_audio.c" ),
@@ -200,6 +202,7 @@ def build(ctx):
         ( "misc/json.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/thread_pool.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -282,8 +285,10 @@ def build(ctx):
         ( "video/fmt-conversion.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
+        ( "video/memcpy_pic.c" ),
         ( "video/mp_image.c" ),
         ( "video/mp_image_pool.c" ),
+        ( "video/slice_threads.c" ),
         ( "video/sws_utils.c" ),
         ( "video/vaapi.c",                       "vaapi" ),
         ( "video/vdpau.c",                       "vdpau" ),
@@ -418,7 +423,8 @@ def build(ctx):
                 ctx.path.find_node('osdep/mpv.rc'),
                 ctx.path.find_node(node))
 
-    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test'):
+    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test') \
+            or ctx.dependency_satisfied('bench'):
         ctx(
             target       = "objects",
             source       = ctx.filtered_sources(sources),
@@ -464,6 +470,17 @@ def build(ctx):
                 features = "c cprogram",
             )
 
+    if ctx.dependency_satisfied('bench'):
+        for bench in ctx.path.ant_glob("bench/*.c"):
+            ctx(
+                target       = os.path.splitext(bench.srcpath())[0],
+                source       = bench.srcpath(),
+                use          = ctx.dependencies_use() + ['objects'],
+                includes     = _all_includes(ctx),
+                features     = "c cprogram",
+                install_path = None,
+            )
+
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')
     if build_shared or build_static: